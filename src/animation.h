@@ -14,6 +14,8 @@ struct Animation {
     int             frameIndex, framePrev, framesCount;
 
     TR::AnimFrame   *frameA, *frameB;
+    TR::AnimRot     *rotA, *rotB;   // pre-decoded rotations of frameA and frameB
+    int             rotCount;
     vec3            offset, jump;
     float           rot;
     bool            isEnded, isPrepareToNext;
@@ -22,9 +24,9 @@ struct Animation {
     quat            *overrides;   // left & right arms animation frames
     int             overrideMask;
 
-    Animation() : overrides(NULL) {}
+    Animation() : rotCount(0), overrides(NULL) {}
 
-    Animation(TR::Level *level, const TR::Model *model, bool smooth = true) : level(level), model(NULL), smooth(smooth), overrides(NULL), overrideMask(0) {
+    Animation(TR::Level *level, const TR::Model *model, bool smooth = true) : level(level), model(NULL), rotCount(0), smooth(smooth), overrides(NULL), overrideMask(0) {
         setModel(model);
     }
 
@@ -129,6 +131,8 @@ struct Animation {
             fIndexB = (fIndex + 1) % fCount;
 
         frameA = getFrame(anim, fIndexA);
+        rotA   = level->getAnimRots(int(anim - level->anims), fIndexA);
+        rotCount = rotA ? level->animRotsCount[anim - level->anims] : 0;
  
         int frameNext = frameIndex + 1;
         isPrepareToNext = !fIndexB;
@@ -141,10 +145,14 @@ struct Animation {
 
         getCommand(anim, frameNext, NULL, NULL, &rot);
 
-        if (smooth)
+        if (smooth) {
             frameB = getFrame(anim, fIndexB);
-        else
+            rotB   = level->getAnimRots(int(anim - level->anims), fIndexB);
+            rotCount = rotB ? min(rotCount, (int)level->animRotsCount[anim - level->anims]) : 0;
+        } else {
             frameB = frameA;
+            rotB   = rotA;
+        }
     }
 
     bool isFrameActive(int index) {
@@ -248,6 +256,8 @@ struct Animation {
     }
 
     quat getJointRot(int joint) {
+        if (joint < rotCount)
+            return quat(rotA[joint]).lerp(rotB[joint], delta);
         return lerpAngle(frameA->getAngle(level->version, joint), frameB->getAngle(level->version, joint), delta);
     }
 
@@ -297,6 +307,42 @@ struct Animation {
         return basis;
     }
 
+    // pose of the whole skeleton, same as getJoints(matrix, -1, true, joints)
+    // but composes quaternion bases instead of matrices
+    void getPose(const Basis &root, Basis *joints) {
+        ASSERT(model);
+        Basis basis = root;
+
+        vec3 offset = isPrepareToNext ? this->offset : vec3(0.0f);
+        basis.translate(((vec3)frameA->pos).lerp(offset + frameB->pos, delta));
+
+        TR::Node *node = (int)model->node < level->nodesDataSize ? (TR::Node*)&level->nodesData[model->node] : NULL;
+
+        int sIndex = 0;
+        Basis stack[16];
+
+        for (int i = 0; i < model->mCount; i++) {
+
+            if (i > 0 && node) {
+                TR::Node &t = node[i - 1];
+
+                if (t.flags & 0x01) basis = stack[--sIndex];
+                if (t.flags & 0x02) stack[sIndex++] = basis;
+
+                ASSERT(sIndex >= 0 && sIndex < COUNT(stack));
+
+                basis.translate(vec3((float)t.x, (float)t.y, (float)t.z));
+            }
+
+            if (overrideMask & (1 << i))
+                basis.rotate(overrides[i]);
+            else
+                basis.rotate(getJointRot(i).normal());
+
+            joints[i] = basis;
+        }
+    }
+
     Box getBoundingBox(const vec3 &pos, int dir) {
         if (!model)
             return Box(pos, pos);
@@ -5,6 +5,7 @@
 #include "format.h"
 #include "controller.h"
 #include "camera.h"
+#include "watersim.h"
 
 #define NO_WATER_HEIGHT  1000000.0f
 
@@ -16,11 +17,21 @@
     #define EARLY_CLEAR
 #endif
 
+#if defined(_GAPI_SW)
+    #define WATER_SIM_CPU // no render targets, simulate water surfaces on CPU
+#endif
+
 struct ShaderCache {
-    enum Effect { FX_NONE = 0, FX_UNDERWATER = 1, FX_ALPHA_TEST = 2 };
+    enum Effect { FX_NONE = 0, FX_UNDERWATER = 1, FX_ALPHA_TEST = 2, FX_PALETTE = 4 };
 
-    Shader *shaders[Core::passMAX][Shader::MAX][(FX_UNDERWATER | FX_ALPHA_TEST) + 1];
-    PSO    *pso[Core::passMAX][Shader::MAX][(FX_UNDERWATER | FX_ALPHA_TEST) + 1][bmMAX];
+#ifdef USE_ATLAS_INDEXED
+    enum { FX_COUNT = (FX_UNDERWATER | FX_ALPHA_TEST | FX_PALETTE) + 1 };
+#else
+    enum { FX_COUNT = (FX_UNDERWATER | FX_ALPHA_TEST) + 1 };
+#endif
+
+    Shader *shaders[Core::passMAX][Shader::MAX][FX_COUNT];
+    PSO    *pso[Core::passMAX][Shader::MAX][FX_COUNT][bmMAX];
 
     ShaderCache() {
         memset(shaders, 0, sizeof(shaders));
@@ -118,6 +129,31 @@ struct ShaderCache {
         compile(Core::passGUI, Shader::DEFAULT, fx, RS_COLOR_WRITE | RS_BLEND_ALPHA);
     }
 
+#ifdef USE_ATLAS_INDEXED
+    // variants for the indexed atlases, compiled by the level when its atlases fit into the palette
+    void preparePalette() {
+        prepareCompose(FX_PALETTE);
+        prepareAmbient(FX_PALETTE);
+
+        if (Core::settings.detail.shadows > Core::Settings::LOW)
+            prepareShadows(FX_PALETTE);
+
+        prepareSky(FX_PALETTE); // TR2-3 sky model
+    }
+#endif
+
+    // only the atlas textured types look the color up in the palette
+    static int getEffect(Core::Pass pass, Shader::Type type, int fx) {
+    #ifdef USE_ATLAS_INDEXED
+        if ((pass == Core::passCompose || pass == Core::passShadow || pass == Core::passAmbient) &&
+            (type == Shader::ROOM || type == Shader::ENTITY || type == Shader::SPRITE))
+            return fx;
+        if (pass == Core::passSky && (type == Shader::DEFAULT || type == Shader::SKY_CLOUDS))
+            return fx;
+    #endif
+        return fx & ~FX_PALETTE;
+    }
+
     #undef rsBase
     #undef rsBlend
     #undef rsFull
@@ -127,6 +163,8 @@ struct ShaderCache {
         if (rs & RS_DISCARD)
             fx |= FX_ALPHA_TEST;
 
+        fx = getEffect(pass, type, fx);
+
     #ifndef FFP
         if (shaders[pass][type][fx])
             return shaders[pass][type][fx];
@@ -154,6 +192,7 @@ struct ShaderCache {
 
                 if (fx & FX_UNDERWATER) SD_ADD(UNDERWATER);
                 if (fx & FX_ALPHA_TEST) SD_ADD(ALPHA_TEST);
+                if (fx & FX_PALETTE)    SD_ADD(OPT_PALETTE);
 
                 if (pass == Core::passCompose) {
                     if (Core::settings.detail.lighting > Core::Settings::MEDIUM && (type == Shader::ENTITY))
@@ -167,7 +206,11 @@ struct ShaderCache {
                 }
                 break;
             }
-            case Core::passSky     : def[defCount++] = SD_SKY_TEXTURE + type;    break;
+            case Core::passSky     : {
+                def[defCount++] = SD_SKY_TEXTURE + type;
+                if (fx & FX_PALETTE) SD_ADD(OPT_PALETTE);
+                break;
+            }
             case Core::passWater   : def[defCount++] = SD_WATER_DROP + type;     break;
             case Core::passFilter  : def[defCount++] = SD_FILTER_UPSCALE + type; break;
             case Core::passGUI     : break;
@@ -195,6 +238,8 @@ struct ShaderCache {
     void bind(Core::Pass pass, Shader::Type type, int fx) {
         Core::pass = pass;
 
+        fx = getEffect(pass, type, fx);
+
         Shader *shader = getShader(pass, type, fx);
         if (shader) {
             shader->setup();
@@ -204,6 +249,19 @@ struct ShaderCache {
     }
 };
 
+// per sector 6-direction ambient (+X, -X, +Y, -Y, +Z, -Z)
+// rendered on demand from the environment cubes, AMBIENT_CACHE_CPU precomputes it at level load
+// from the lit room geometry of the room and its portal neighbours and persists it in the cache dir
+
+#if defined(_GAPI_SW) || defined(_GAPI_GU) || defined(_GAPI_C3D) || defined(FFP)
+    #define AMBIENT_CACHE_CPU // no render targets or too slow to render the cubes
+#endif
+
+//#define AMBIENT_CACHE_CPU
+
+#define AMBIENT_CACHE_MAGIC   FOURCC("AMB2")
+#define AMBIENT_CACHE_ALBEDO  0.5f  // average texture brightness of the room geometry
+
 struct AmbientCache {
     IGame     *game;
     TR::Level *level;
@@ -215,7 +273,13 @@ struct AmbientCache {
         vec4 colors[6]; // TODO: ubyte4[6]
     } *items;
     int *offsets;
+    int count;
+
+    char name[64];
 
+    static ENGINE_TLS AmbientCache *current; // valid target of the cache read request
+
+#ifndef AMBIENT_CACHE_CPU
     struct Task {
         int  room;
         int  flip;
@@ -225,32 +289,297 @@ struct AmbientCache {
     int tasksCount;
 
     Texture *textures[6 * 4]; // 64, 16, 4, 1 
+#endif
 
-    AmbientCache(IGame *game) : game(game), level(game->getLevel()), tasksCount(0) {
+    struct Header {
+        uint32 magic;
+        uint32 hash;
+        int32  count;
+    };
+
+    struct Surface {
+        vec3  pos;
+        vec3  normal;
+        vec3  color;
+        float area;
+    };
+
+    AmbientCache(IGame *game) : game(game), level(game->getLevel()) {
         items   = NULL;
         offsets = new int[level->roomsCount];
-        int sectors = 0;
+        count   = 0;
         for (int i = 0; i < level->roomsCount; i++) {
             TR::Room &r = level->rooms[i];
-            offsets[i] = sectors;
-            sectors += r.xSectors * r.zSectors * (r.alternateRoom > -1 ? 2 : 1); // x2 for flipped rooms
+            offsets[i] = count;
+            count += r.xSectors * r.zSectors * (r.alternateRoom > -1 ? 2 : 1); // x2 for flipped rooms
         }
     // init cache buffer
-        items = new Cube[sectors];
-        memset(items, 0, sizeof(Cube) * sectors);
+        items = new Cube[count];
+        memset(items, 0, sizeof(Cube) * count);
+
+    #ifndef AMBIENT_CACHE_CPU
+        tasksCount = 0;
     // init downsample textures
         for (int j = 0; j < 6; j++)
             for (int i = 0; i < 4; i++)
                 textures[j * 4 + i] = new Texture(64 >> (i << 1), 64 >> (i << 1), 1, FMT_RGBA, OPT_TARGET | OPT_NEAREST);
+    #else
+        sprintf(name, "ambient_%d_%s", int(level->version), TR::LEVEL_INFO[level->id].name);
+        current = this;
+        Stream::cacheRead(name, loadAsync, this);
+    #endif
     }
 
     ~AmbientCache() {
+        Stream::cancel(this);
+        if (current == this)
+            current = NULL;
         delete[] items;
         delete[] offsets;
+    #ifndef AMBIENT_CACHE_CPU
         for (int i = 0; i < 6 * 4; i++)
             delete textures[i];
+    #endif
+    }
+
+    static uint32 getHash(const TR::Room &r, uint32 hash) {
+        const TR::Room::Data &d = r.data;
+        for (int i = 0; i < d.vCount; i++) {
+            hash = fnv32((char*)&d.vertices[i].pos, sizeof(d.vertices[i].pos), hash);
+            hash = fnv32((char*)&d.vertices[i].color, sizeof(d.vertices[i].color), hash);
+        }
+        for (int i = 0; i < r.lightsCount; i++) {
+            const TR::Room::Light &light = r.lights[i];
+            hash = fnv32((char*)&light.x, sizeof(light.x) * 3, hash);
+            hash = fnv32((char*)&light.radius, sizeof(light.radius), hash);
+            hash = fnv32((char*)&light.intensity, sizeof(light.intensity), hash);
+            hash = fnv32((char*)&light.color, sizeof(light.color), hash);
+        }
+        return hash;
+    }
+
+    // rooms of the flip pairs are hashed in the unflipped order, so the hash doesn't depend on the flip state at load
+    uint32 getHash() {
+        bool *alternate = new bool[level->roomsCount];
+        memset(alternate, 0, sizeof(bool) * level->roomsCount);
+        for (int i = 0; i < level->roomsCount; i++)
+            if (level->rooms[i].alternateRoom > -1)
+                alternate[level->rooms[i].alternateRoom] = true;
+
+        uint32 hash = fnv32((char*)&count, sizeof(count));
+        for (int i = 0; i < level->roomsCount; i++) {
+            if (alternate[i]) continue; // hashed with its base room
+            hash = getHash(getGeometry(i, 0), hash);
+            if (level->rooms[i].alternateRoom > -1)
+                hash = getHash(getGeometry(i, 1), hash);
+        }
+
+        delete[] alternate;
+        return hash;
+    }
+
+    static void loadAsync(Stream *stream, void *userData) {
+        AmbientCache *cache = current;
+        if (cache != userData || (stream && strcmp(stream->name, cache->name))) {
+            delete stream; // the cache was released before the request completed
+            return;
+        }
+        current = NULL;
+
+        if (!cache->load(stream)) {
+            cache->precompute();
+            cache->save();
+        }
+        delete stream;
+    }
+
+    bool load(Stream *stream) {
+        if (!stream || stream->size != int(sizeof(Header) + sizeof(Color32) * 6 * count))
+            return false;
+
+        Header header;
+        stream->raw(&header, sizeof(header));
+        if (header.magic != AMBIENT_CACHE_MAGIC || header.count != count || header.hash != getHash())
+            return false;
+
+        Color32 *colors = new Color32[count * 6];
+        stream->raw(colors, sizeof(Color32) * 6 * count);
+
+        for (int i = 0; i < count; i++) {
+            Cube &cube = items[i];
+            for (int j = 0; j < 6; j++) {
+                Color32 &c = colors[i * 6 + j];
+                cube.colors[j] = vec4(c.r, c.g, c.b, c.a) * (1.0f / 255.0f);
+            }
+            cube.status = Cube::READY;
+        }
+
+        delete[] colors;
+
+        LOG("ambient: %d sectors loaded\n", count);
+        return true;
+    }
+
+    void save() {
+        int size = sizeof(Header) + sizeof(Color32) * 6 * count;
+        char *data = new char[size];
+
+        Header &header = *(Header*)data;
+        header.magic = AMBIENT_CACHE_MAGIC;
+        header.hash  = getHash();
+        header.count = count;
+
+        Color32 *colors = (Color32*)(data + sizeof(Header));
+        for (int i = 0; i < count; i++)
+            for (int j = 0; j < 6; j++) {
+                const vec4 &c = items[i].colors[j];
+                colors[i * 6 + j] = Color32(clamp(int(c.x * 255.0f), 0, 255),
+                                            clamp(int(c.y * 255.0f), 0, 255),
+                                            clamp(int(c.z * 255.0f), 0, 255),
+                                            clamp(int(c.w * 255.0f), 0, 255));
+            }
+
+        Stream::cacheWrite(name, data, size);
+        delete[] data;
+    }
+
+    static vec3 getSectorPos(const TR::Room &r, int sector) {
+        const TR::Room::Sector &s = r.sectors[sector];
+        return vec3(float((sector / r.zSectors) * 1024 + 512 + r.info.x), 
+                    float(max((s.floor - 2) * 256, (s.floor + s.ceiling) * 256 / 2)),
+                    float((sector % r.zSectors) * 1024 + 512 + r.info.z));
+    }
+
+    // room lights with the attenuation of the compose shader
+    static vec3 getLighting(const TR::Room &r, const vec3 &pos, const vec3 &normal) {
+        vec3 lighting(0.0f);
+        for (int i = 0; i < r.lightsCount; i++) {
+            const TR::Room::Light &light = r.lights[i];
+            if (light.intensity > 8192 || !light.radius) continue;
+
+            vec3  lv  = (vec3(float(light.x), float(light.y), float(light.z)) - pos) * (1.0f / float(light.radius));
+            float att = 1.0f - lv.length2();
+            if (att <= 0.0f) continue;
+
+            float lum = normal.dot(lv.normal());
+            if (lum <= 0.0f) continue;
+
+            lighting += vec3(light.color.r, light.color.g, light.color.b) * (lum * att / 255.0f);
+        }
+        return lighting;
     }
 
+    static void addSurfaces(const TR::Room &r, Array<Surface> &surfaces) {
+        const TR::Room::Data &d = r.data;
+        vec3 offset = vec3(float(r.info.x), 0.0f, float(r.info.z));
+
+        for (int i = 0; i < d.fCount; i++) {
+            const TR::Face &f = d.faces[i];
+            if (f.water) continue;
+
+            int n = f.triangle ? 3 : 4;
+
+            vec3 p[4], color(0.0f);
+            for (int j = 0; j < n; j++) {
+                const TR::Room::Data::Vertex &v = d.vertices[f.vertices[j]];
+                p[j]   = vec3(v.pos.x, v.pos.y, v.pos.z) + offset;
+                color += vec3(v.color.r, v.color.g, v.color.b);
+            }
+
+            vec3 normal = (p[1] - p[0]).cross(p[2] - p[0]);
+            if (n == 4)
+                normal += (p[2] - p[0]).cross(p[3] - p[0]);
+
+            float area = normal.length();
+            if (area < EPS) continue;
+
+            Surface s;
+            s.pos    = n == 4 ? (p[0] + p[1] + p[2] + p[3]) * 0.25f : (p[0] + p[1] + p[2]) * (1.0f / 3.0f);
+            s.normal = normal * (1.0f / area);
+            s.color  = (color * (1.0f / (255.0f * n)) + getLighting(r, s.pos, s.normal)) * AMBIENT_CACHE_ALBEDO;
+            s.area   = area * 0.5f;
+            surfaces.push(s);
+        }
+    }
+
+    // average radiance of the visible surfaces per direction, weighted by the solid angle
+    // and by the squared direction cosine (as the compose shader blends the cube faces)
+    static void calcAmbient(const vec3 &pos, const Array<Surface> &surfaces, vec4 *colors) {
+        vec3  sum[6];
+        float weight[6];
+        for (int i = 0; i < 6; i++) {
+            sum[i]    = vec3(0.0f);
+            weight[i] = 0.0f;
+        }
+
+        for (int i = 0; i < surfaces.length; i++) {
+            const Surface &s = surfaces.items[i];
+            vec3  d     = s.pos - pos;
+            float dist2 = max(d.length2(), 256.0f * 256.0f);
+            d *= 1.0f / sqrtf(dist2);
+
+            float omega = min(s.area * fabsf(s.normal.dot(d)) / dist2, PI);
+
+            vec3 w = d * d * omega;
+            int  x = d.x >= 0.0f ? 0 : 1;
+            int  y = d.y >= 0.0f ? 2 : 3;
+            int  z = d.z >= 0.0f ? 4 : 5;
+
+            sum[x] += s.color * w.x; weight[x] += w.x;
+            sum[y] += s.color * w.y; weight[y] += w.y;
+            sum[z] += s.color * w.z; weight[z] += w.z;
+        }
+
+        for (int i = 0; i < 6; i++)
+            colors[i] = weight[i] > 0.0f ? vec4(sum[i] * (1.0f / weight[i]), 1.0f) : vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    // the second half of a flipped room sectors is the alternate geometry
+    const TR::Room& getGeometry(int room, int half) {
+        const TR::Room &r = level->rooms[room];
+        if (half == int(level->state.flags.flipped))
+            return r;
+        return level->rooms[r.alternateRoom];
+    }
+
+    static void precomputeRoom(int thread, int index, void *userData) {
+        AmbientCache *cache = (AmbientCache*)userData;
+        TR::Room &room = cache->level->rooms[index];
+
+        int halves  = room.alternateRoom > -1 ? 2 : 1;
+        int sectors = room.xSectors * room.zSectors;
+
+        Array<Surface> surfaces(1024);
+
+        for (int half = 0; half < halves; half++) {
+            const TR::Room &r = cache->getGeometry(index, half);
+
+            surfaces.reset();
+            addSurfaces(r, surfaces);
+            for (int i = 0; i < r.portalsCount; i++) {
+                int neighbour = r.portals[i].roomIndex;
+                if (cache->level->rooms[neighbour].alternateRoom > -1)
+                    addSurfaces(cache->getGeometry(neighbour, half), surfaces);
+                else
+                    addSurfaces(cache->level->rooms[neighbour], surfaces);
+            }
+
+            for (int i = 0; i < sectors; i++) {
+                if (r.sectors[i].floor == TR::NO_FLOOR) continue;
+                Cube &cube = cache->items[cache->offsets[index] + half * sectors + i];
+                calcAmbient(getSectorPos(r, i), surfaces, cube.colors);
+                cube.status = Cube::READY;
+            }
+        }
+    }
+
+    void precompute() {
+        int startTime = osGetTimeMS();
+        Core::jobs.run(level->roomsCount, precomputeRoom, this);
+        LOG("ambient: %d sectors precomputed in %d ms\n", count, osGetTimeMS() - startTime);
+    }
+
+#ifndef AMBIENT_CACHE_CPU
     void addTask(int room, int sector) {
         if (tasksCount >= COUNT(tasks)) return;
 
@@ -266,11 +595,7 @@ struct AmbientCache {
         PROFILE_MARKER("PASS_AMBIENT");
                 
         TR::Room &r = level->rooms[room];
-        TR::Room::Sector &s = r.sectors[sector];
-            
-        vec3 pos = vec3(float((sector / r.zSectors) * 1024 + 512 + r.info.x), 
-                        float(max((s.floor - 2) * 256, (s.floor + s.ceiling) * 256 / 2)),
-                        float((sector % r.zSectors) * 1024 + 512 + r.info.z));
+        vec3 pos = getSectorPos(r, sector);
 
         Core::setClearColor(vec4(0, 0, 0, 1));
 
@@ -335,6 +660,9 @@ struct AmbientCache {
         }
         tasksCount = 0;
     }
+#else
+    void processQueue() {}
+#endif
 
     Cube* getAmbient(int roomIndex, int x, int z) {
         TR::Room &r = level->rooms[roomIndex];
@@ -350,8 +678,10 @@ struct AmbientCache {
             sector += r.xSectors * r.zSectors;
 
         Cube *cube = &items[offsets[roomIndex] + sector];
+    #ifndef AMBIENT_CACHE_CPU
         if (cube->status == Cube::BLANK)
             addTask(roomIndex, sector);
+    #endif
 
         return cube->status == Cube::READY ? cube : NULL;
     }
@@ -424,6 +754,8 @@ struct AmbientCache {
     }
 };
 
+ENGINE_TLS AmbientCache *AmbientCache::current = NULL;
+
 struct WaterCache {
     #define MAX_SURFACES       16
     #define MAX_INVISIBLE_TIME 5.0f
@@ -431,6 +763,7 @@ struct WaterCache {
     #define WATER_TILE_SIZE    64
     #define DETAIL             (WATER_TILE_SIZE / 1024.0f)
     #define MAX_DROPS          32
+    #define WATER_SIM_CAUSTICS 512 // same as the render target of the GPU version
 
     IGame     *game;
     TR::Level *level;
@@ -448,13 +781,19 @@ struct WaterCache {
         Texture *mask;
         Texture *caustics;
         Texture *data[2];
+        WaterSim *sim;
+        bool    dirty;
+        int     steps;
+        int64   time;
 
         Item() {
             mask = caustics = data[0] = data[1] = NULL;
+            sim  = NULL;
         }
 
         Item(int from, int to) : from(from), to(to), caust(to), timer(SIMULATE_TIMESTEP), visible(true), blank(true) {
             mask = caustics = data[0] = data[1] = NULL;
+            sim  = NULL;
         }
 
         void init(IGame *game) {
@@ -518,6 +857,10 @@ struct WaterCache {
                     m[(x - minX) + w * (z - minZ)] = hasWater ? 0xFF : 0x00; // TODO: flow map
                 }
             mask = new Texture(w, h, 1, FMT_LUMINANCE, OPT_NEAREST, m);
+        #ifdef WATER_SIM_CPU
+            sim   = new WaterSim(w, h, m, WATER_TILE_SIZE, Core::noiseData, WATER_SIM_CAUSTICS, PLANE_DETAIL);
+            dirty = false;
+        #endif
             delete[] m;
 
             size = vec3(float((maxX - minX) * 512), 1.0f, float((maxZ - minZ) * 512)); // half size
@@ -525,11 +868,23 @@ struct WaterCache {
 
             int *mf = new int[4 * w * h * SQR(WATER_TILE_SIZE)];
             memset(mf, 0, sizeof(int) * 4 * w * h * SQR(WATER_TILE_SIZE));
+        #ifdef WATER_SIM_CPU
+            data[0] = new Texture(w * WATER_TILE_SIZE, h * WATER_TILE_SIZE, 1, FMT_RG_HALF, OPT_VERTEX, mf);
+            data[1] = NULL;
+        #else
             data[0] = new Texture(w * WATER_TILE_SIZE, h * WATER_TILE_SIZE, 1, FMT_RG_HALF, OPT_TARGET | OPT_VERTEX, mf);
             data[1] = new Texture(w * WATER_TILE_SIZE, h * WATER_TILE_SIZE, 1, FMT_RG_HALF, OPT_TARGET | OPT_VERTEX);
+        #endif
             delete[] mf;
 
-            caustics = Core::settings.detail.water > Core::Settings::MEDIUM ? new Texture(512, 512, 1, FMT_RGBA, OPT_TARGET | OPT_DEPEND) : NULL;
+            if (Core::settings.detail.water > Core::Settings::MEDIUM) {
+            #ifdef WATER_SIM_CPU
+                caustics = new Texture(WATER_SIM_CAUSTICS, WATER_SIM_CAUSTICS, 1, FMT_RGBA, 0);
+            #else
+                caustics = new Texture(512, 512, 1, FMT_RGBA, OPT_TARGET | OPT_DEPEND);
+            #endif
+            } else
+                caustics = NULL;
             
             blank = false;
         }
@@ -539,7 +894,9 @@ struct WaterCache {
             delete data[1];
             delete caustics;
             delete mask;
+            delete sim;
             mask = caustics = data[0] = data[1] = NULL;
+            sim  = NULL;
         }
 
     } items[MAX_SURFACES];
@@ -554,8 +911,24 @@ struct WaterCache {
         Drop(const vec3 &pos, float radius, float strength) : pos(pos), radius(radius), strength(strength) {}
     } drops[MAX_DROPS];
 
+#ifdef WATER_SIM_CPU
+    Item  *simItems[MAX_SURFACES];
+    int   simCount;
+    float simNoiseTime;
+    int   simSteps;
+    int64 simTime;
+    char  *simData;
+    int   simDataSize;
+#endif
+
     WaterCache(IGame *game) : game(game), level(game->getLevel()), screen(NULL), refract(NULL), count(0), dropCount(0) {
         reflect = new Texture(512, 512, 1, FMT_RGBA, OPT_TARGET);
+    #ifdef WATER_SIM_CPU
+        simSteps    = 0;
+        simTime     = 0;
+        simData     = NULL;
+        simDataSize = 0;
+    #endif
     }
 
     ~WaterCache() {
@@ -564,6 +937,11 @@ struct WaterCache {
         delete reflect;
         for (int i = 0; i < count; i++)
             items[i].deinit();
+    #ifdef WATER_SIM_CPU
+        delete[] simData;
+        if (simSteps)
+            LOG("water: %d surface steps, %d us per step\n", simSteps, int(simTime / simSteps));
+    #endif
     }
 
     void update() {
@@ -578,8 +956,86 @@ struct WaterCache {
             item.timer += Core::deltaTime;
             i++;
         }
+    #ifdef WATER_SIM_CPU
+        simulateCPU();
+    #endif
+    }
+
+#ifdef WATER_SIM_CPU
+    static void simulateItem(int thread, int index, void *userData) {
+        WaterCache *cache = (WaterCache*)userData;
+        Item &item = *cache->simItems[index];
+
+        int64 startTime = Profiler::getTime();
+
+        for (int i = 0; i < cache->dropCount; i++) {
+            Drop &drop = cache->drops[i];
+            float x = (drop.pos.x - (item.pos.x - item.size.x)) * DETAIL;
+            float z = (drop.pos.z - (item.pos.z - item.size.z)) * DETAIL;
+            item.sim->drop(x, z, drop.radius * DETAIL, drop.strength);
+        }
+
+        item.steps = 0;
+        while (item.timer >= SIMULATE_TIMESTEP) {
+            item.sim->step(cache->simNoiseTime);
+            item.timer -= SIMULATE_TIMESTEP;
+            item.steps++;
+        }
+
+        if (item.steps && item.caustics)
+            item.sim->calcCaustics();
+
+        item.dirty = true;
+        item.time  = Profiler::getTime() - startTime;
     }
 
+    // drops and simulation steps of the visible surfaces, one job per surface
+    // the textures are updated by simulate() on the render side
+    void simulateCPU() {
+        simCount = 0;
+        for (int i = 0; i < count; i++) {
+            Item &item = items[i];
+            if (item.visible && item.sim && (item.timer >= SIMULATE_TIMESTEP || dropCount))
+                simItems[simCount++] = &item;
+        }
+
+        if (simCount) {
+            simNoiseTime = Core::params.x;
+            Core::jobs.run(simCount, simulateItem, this, 1);
+
+            for (int i = 0; i < simCount; i++) {
+                simSteps += simItems[i]->steps;
+                simTime  += simItems[i]->time;
+            }
+        }
+
+        dropCount = 0;
+    }
+
+    void uploadCPU(Item &item) {
+        Texture *tex = item.data[0];
+        if (tex->fmt == FMT_RG_HALF || tex->fmt == FMT_RG_FLOAT) {
+            int size = item.sim->width * item.sim->height * (tex->fmt == FMT_RG_HALF ? 4 : 8);
+            if (size > simDataSize) {
+                delete[] simData;
+                simData     = new char[size];
+                simDataSize = size;
+            }
+            item.sim->getData(TexFormat(tex->fmt), simData);
+            tex->update(simData);
+        }
+
+        if (item.caustics) {
+            Color32 *data = new Color32[SQR(WATER_SIM_CAUSTICS)];
+            item.sim->getCaustics(data);
+            item.caustics->update(data);
+            delete[] data;
+        }
+
+        item.dirty = false;
+    }
+#endif
+
     void reset() {
         for (int i = 0; i < count; i++)
             items[i].visible = false;
@@ -848,6 +1304,14 @@ struct WaterCache {
 
     void simulate() {
         PROFILE_MARKER("WATER_SIMULATE");
+    #ifdef WATER_SIM_CPU
+        for (int i = 0; i < count; i++) {
+            Item &item = items[i];
+            if (item.visible && item.sim && item.dirty)
+                uploadCPU(item);
+        }
+        return;
+    #endif
     // simulate water
         Core::setDepthTest(false);
         Core::setBlendMode(bmNone);
@@ -1180,7 +1644,7 @@ struct ZoneCache {
     }
 };
 
-ShaderCache *shaderCache;
+ENGINE_TLS ShaderCache *shaderCache;
 
 #undef UNDERWATER_COLOR
 
@@ -277,14 +277,12 @@ struct Character : Controller {
         for (int i = 0; i < count; i++)
             if (mask & (1 << i)) {
                 vec3 sprPos = spheres[i].center + (vec3(randf(), randf(), randf()) * 2.0f - 1.0f) * spheres[i].radius;
-                game->addEntity(TR::Entity::SPARKLES, getRoomIndex(), sprPos);
+                game->addParticle(TR::Entity::SPARKLES, getRoomIndex(), sprPos);
             }
     }
 
     void addBlood(const vec3 &sprPos, const vec3 &sprVel) {
-        Sprite *sprite = (Sprite*)game->addEntity(TR::Entity::BLOOD, getRoomIndex(), sprPos, 0);
-        if (sprite)
-            sprite->velocity = sprVel;
+        game->addParticle(TR::Entity::BLOOD, getRoomIndex(), sprPos, sprVel);
     }
 
     void addBlood(float radius, float height, const vec3 &sprVel) {
@@ -83,6 +83,7 @@ struct IGame {
     virtual void renderView(int roomIndex, bool water, bool showUI, int roomsCount = 0, RoomDesc *roomsList = NULL) {}
     virtual void renderGame(bool showUI, bool invBG) {}
     virtual void setEffect(Controller *controller, TR::Effect::Type effect) {}
+    virtual void setDynamicLight(const vec3 &pos, bool enable) {}
 
     virtual vec4 projectPoint(const vec4 &p) { return vec4(0.0f); }
     virtual void checkTrigger(Controller *controller, bool heavy) {}
@@ -90,6 +91,7 @@ struct IGame {
 
     virtual Controller* addEntity(TR::Entity::Type type, int room, const vec3 &pos, float angle = 0.0f) { return NULL; }
     virtual void removeEntity(Controller *controller) {}
+    virtual void addParticle(TR::Entity::Type type, int room, const vec3 &pos, const vec3 &velocity = vec3(0.0f)) {}
 
     virtual void addMuzzleFlash(Controller *owner, int joint, const vec3 &offset, int lightIndex) {}
 
@@ -106,7 +108,7 @@ struct IGame {
 
 struct Controller {
 
-    static Controller *first;
+    static ENGINE_TLS Controller *first;
     Controller  *next;
 
     IGame       *game;
@@ -123,7 +125,7 @@ struct Controller {
     TR::Entity::Flags flags;
 
     Basis   *joints;
-    int     jointsFrame;
+    uint32  jointsFrame;
 
     vec4    ambient[6];
     float   specular;
@@ -137,6 +139,7 @@ struct Controller {
     bool mainLightFlip;
     bool invertAim;
     bool lockMatrix;
+    bool parallel;  // update() only writes own state and talks to the game through IGame
 
     struct MeshLayer {
         uint32   model;
@@ -160,6 +163,7 @@ struct Controller {
     Controller(IGame *game, int entity) : next(NULL), game(game), level(game->getLevel()), entity(entity), animation(level, getModel(), level->entities[entity].flags.smooth), state(animation.state), invertAim(false), layers(0), explodeMask(0), explodeParts(0), lastPos(0) {
         const TR::Entity &e = getEntity();
         lockMatrix  = false;
+        parallel    = false;
         matrix.identity();
 
         waterLevel = waterDepth = 0.0f;
@@ -624,6 +628,10 @@ struct Controller {
         return !flags.reverse;
     }
 
+    bool isParallel() const {
+        return parallel && !explodeMask;
+    }
+
     virtual bool isCollider() {
         const TR::Entity &e = getEntity();
         return e.isEnemy() ||
@@ -840,7 +848,7 @@ struct Controller {
         const TR::Model *m = getModel();
         ASSERT(m->mCount <= MAX_JOINTS);
 
-        int jFrame = jointsFrame;
+        uint32 jFrame = jointsFrame;
         updateJoints();
         jointsFrame = jFrame;
 
@@ -1121,13 +1129,8 @@ struct Controller {
             }
             case TR::Effect::INV_ON         : flags.invisible = true;  break;
             case TR::Effect::INV_OFF        : flags.invisible = false; break;
-            case TR::Effect::DYN_ON         :
-                Core::lightColor[1] = vec4(0.6f, 0.5f, 0.1f, 1.0f / 4096.0f);
-                Core::lightPos[1]   = getPos();
-                break;
-            case TR::Effect::DYN_OFF        :
-                Core::lightColor[1] = vec4(0, 0, 0, 1);
-                break;
+            case TR::Effect::DYN_ON         : game->setDynamicLight(getPos(), true);  break;
+            case TR::Effect::DYN_OFF        : game->setDynamicLight(getPos(), false); break;
             case TR::Effect::FOOTPRINT      : break; // TODO TR3
             default : ASSERT(false);
         }
@@ -1251,7 +1254,7 @@ struct Controller {
 
                 if (explode) {
                     explodeMask &= ~(1 << i);
-                    game->addEntity(TR::Entity::EXPLOSION, part.roomIndex, p);
+                    game->addParticle(TR::Entity::EXPLOSION, part.roomIndex, p);
                 }
             }
 
@@ -1430,7 +1433,7 @@ struct Controller {
     void updateJoints() {
         if (Core::stats.frame == jointsFrame)
             return;
-        animation.getJoints(getMatrix(), -1, true, joints);
+        animation.getPose(getMatrix(), joints);
         jointsFrame = Core::stats.frame;
     }
 
@@ -1513,7 +1516,7 @@ struct Controller {
     }
 
     void addRicochet(const vec3 &pos, bool sound) {
-        game->addEntity(TR::Entity::RICOCHET, getRoomIndex(), pos);
+        game->addParticle(TR::Entity::RICOCHET, getRoomIndex(), pos);
         if (sound)
             game->playSound(TR::SND_RICOCHET, pos, Sound::PAN);
     }
@@ -1527,6 +1530,6 @@ struct DummyController : Controller {
 };
 
 
-Controller *Controller::first = NULL;
+ENGINE_TLS Controller *Controller::first = NULL;
 
 #endif
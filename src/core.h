@@ -100,6 +100,15 @@
     #define _OS_BITTBOY 1
     #define _OS_LINUX   1
     #define _GAPI_SW    1
+#elif __HEADLESS__
+    #define _OS_HEADLESS 1
+    #define _GAPI_SW     1
+
+    // every host thread runs its own engine instance (see platform/headless)
+    // the engine state is thread-local, so the engine itself spawns no threads
+    #define ENGINE_INSTANCES
+
+    #undef OS_PTHREAD_MT
 #elif __GCW0__
     #define _OS_GCW0   1
     #define _GAPI_GL   1
@@ -218,6 +227,12 @@
     #undef OS_PTHREAD_MT
 #endif
 
+#ifdef ENGINE_INSTANCES
+    #define ENGINE_TLS thread_local
+#else
+    #define ENGINE_TLS
+#endif
+
 #if !defined(_OS_PSP) && !defined(_OS_TNS)
     #define USE_INFLATE
 #endif
@@ -246,7 +261,16 @@
     #define GENERATE_WATER_PLANE
 #endif
 
+// 8-bit room, object and sprite atlases + shared 256x1 palette texture, the color is looked up by the shader
+// (GLSL only, no filtering and mipmaps for the indexed atlases, falls back to RGBA for more than 256 colors)
+//#define USE_ATLAS_INDEXED
+
+#if defined(USE_ATLAS_INDEXED) && (!defined(_GAPI_GL) || defined(USE_ATLAS_RGBA16))
+    #undef USE_ATLAS_INDEXED
+#endif
+
 #include "utils.h"
+#include "profiler.h"
 
 #if defined(_OS_3DS)
     #define SHADOW_TEX_SIZE      512
@@ -332,11 +356,395 @@ namespace Core {
         ~Lock() { mutex.unlock(); }
     };
 
-    float deltaTime;
-    int   lastTime;
-    int   x, y, width, height;
+    #ifndef JOB_THREADS
+        #define JOB_THREADS 4  // including the calling thread
+    #endif
+
+    // persistent worker threads shared by TaskGraph and JobSystem, started on the first job
+    // every job belongs to a group of its owner, wait() executes the jobs of the group
+    // that are still in the queue on the calling thread, so a job can run nested jobs without a deadlock
+    // jobs run on the submitting thread if there is no threading support
+    ENGINE_TLS struct WorkerPool {
+        typedef void (Proc)(void *arg);
+
+        struct Group {
+            int submitted;
+            int completed;
+
+            Group() : submitted(0), completed(0) {}
+        };
+
+        struct Job {
+            Job   *next;
+            Group *group;
+            Proc  *proc;
+            void  *arg;
+            bool  done;
+        };
+
+    #ifdef OS_PTHREAD_MT
+        pthread_mutex_t lock;
+        pthread_cond_t  wake;
+        pthread_cond_t  finish;
+        Job  *first, *last;
+        void *threads[JOB_THREADS - 1];
+        int  count;
+        bool started;
+        bool quit;
+
+        WorkerPool() : first(NULL), last(NULL), count(0), started(false), quit(false) {
+            pthread_mutex_init(&lock, NULL);
+            pthread_cond_init(&wake, NULL);
+            pthread_cond_init(&finish, NULL);
+        }
+
+        // the first queued job (of the group), called under the lock
+        Job* pop(Group *group) {
+            Job *prev = NULL;
+            for (Job *job = first; job; prev = job, job = job->next) {
+                if (group && job->group != group)
+                    continue;
+                if (prev)
+                    prev->next = job->next;
+                else
+                    first = job->next;
+                if (last == job)
+                    last = prev;
+                return job;
+            }
+            return NULL;
+        }
+
+        // called under the lock, the job runs unlocked
+        void execute(Job *job) {
+            pthread_mutex_unlock(&lock);
+            job->proc(job->arg);
+            pthread_mutex_lock(&lock);
+            job->done = true;
+            job->group->completed++;
+            pthread_cond_broadcast(&finish);
+        }
+
+        static void worker(void *arg) {
+            WorkerPool *pool = (WorkerPool*)arg;
+            pthread_mutex_lock(&pool->lock);
+            while (1) {
+                Job *job = pool->pop(NULL);
+                if (!job) {
+                    if (pool->quit) break;
+                    pthread_cond_wait(&pool->wake, &pool->lock);
+                    continue;
+                }
+                pool->execute(job);
+            }
+            pthread_mutex_unlock(&pool->lock);
+            PROFILE_THREAD_EXIT();
+        }
+    #endif
+
+        void submit(Group &group, Job &job, Proc *proc, void *arg) {
+            job.next  = NULL;
+            job.group = &group;
+            job.proc  = proc;
+            job.arg   = arg;
+            job.done  = false;
+            group.submitted++;
+
+        #ifdef OS_PTHREAD_MT
+            pthread_mutex_lock(&lock);
+
+            if (!started) {
+                started = true;
+                for (int i = 0; i < JOB_THREADS - 1; i++) {
+                    if ((threads[count] = osThreadCreate(worker, this)))
+                        count++;
+                }
+            }
+
+            if (count) {
+                if (last)
+                    last->next = &job;
+                else
+                    first = &job;
+                last = &job;
+                pthread_cond_signal(&wake);
+            } else {
+                execute(&job);
+            }
+
+            pthread_mutex_unlock(&lock);
+        #else
+            proc(arg);
+            job.done = true;
+            group.completed++;
+        #endif
+        }
+
+        bool isDone(Job &job) {
+        #ifdef OS_PTHREAD_MT
+            pthread_mutex_lock(&lock);
+            bool done = job.done;
+            pthread_mutex_unlock(&lock);
+            return done;
+        #else
+            return job.done;
+        #endif
+        }
+
+        // wait for the completion of the given number of the group jobs
+        void wait(Group &group, int completed) {
+        #ifdef OS_PTHREAD_MT
+            pthread_mutex_lock(&lock);
+            while (group.completed < completed) {
+                Job *job = pop(&group);
+                if (job)
+                    execute(job);
+                else
+                    pthread_cond_wait(&finish, &lock);
+            }
+            pthread_mutex_unlock(&lock);
+        #endif
+        }
+
+        void stop() {
+        #ifdef OS_PTHREAD_MT
+            if (!started) return;
+
+            pthread_mutex_lock(&lock);
+            quit = true;
+            pthread_cond_broadcast(&wake);
+            pthread_mutex_unlock(&lock);
+
+            for (int i = 0; i < count; i++)
+                osThreadJoin(threads[i]);
+
+            count   = 0;
+            started = false;
+            quit    = false;
+        #endif
+        }
+    } pool;
+
+    #define TASK_DEP(index) (1u << (index))
+
+    // dependency graph of the independent jobs (level loading etc.)
+    // ready tasks run concurrently on the worker pool, tasks marked as "main"
+    // run on the calling thread (graphics API calls), serial if no threading support
+    struct TaskGraph {
+        typedef void (Proc)(void *userData);
+
+        enum { MAX_TASKS = 32 };
+
+        struct Task {
+            const char      *name;
+            Proc            *proc;
+            void            *userData;
+            uint32          deps;
+            bool            main;
+            bool            started;
+            bool            queued;
+            WorkerPool::Job job;
+            int             start;
+            int             time;
+        } tasks[MAX_TASKS];
+
+        int    count;
+        uint32 done;
+        int    time;
+
+        TaskGraph() : count(0), done(0), time(0) {}
+
+        int add(const char *name, Proc *proc, void *userData, uint32 deps = 0, bool main = false) {
+            ASSERT(count < MAX_TASKS);
+            Task &task = tasks[count];
+            task.name     = name;
+            task.proc     = proc;
+            task.userData = userData;
+            task.deps     = deps;
+            task.main     = main;
+            task.started  = false;
+            task.queued   = false;
+            task.start    = 0;
+            task.time     = 0;
+            return count++;
+        }
+
+        static void execute(void *arg) {
+            Task *task = (Task*)arg;
+            PROFILE_ZONE(task->name);
+            task->start = osGetTimeMS();
+            task->proc(task->userData);
+            task->time = osGetTimeMS() - task->start;
+        }
+
+        bool isReady(const Task &task) const {
+            return !task.started && (task.deps & done) == task.deps;
+        }
+
+        void run() {
+            int startTime = osGetTimeMS();
+            uint32 all = (count >= 32) ? 0xFFFFFFFFu : ((1u << count) - 1);
+
+            WorkerPool::Group group;
+            int completed = 0;
+
+            while (done != all) {
+                bool progress = false;
+
+            // start all ready worker tasks
+                for (int i = 0; i < count; i++) {
+                    Task &task = tasks[i];
+                    if (task.main || !isReady(task)) continue;
+
+                    task.started = true;
+                    task.queued  = true;
+                    pool.submit(group, task.job, execute, &task);
+                }
+
+            // collect the finished worker tasks
+                for (int i = 0; i < count; i++) {
+                    Task &task = tasks[i];
+                    if (!task.queued || !pool.isDone(task.job)) continue;
+
+                    task.queued = false;
+                    done |= TASK_DEP(i);
+                    completed++;
+                    progress = true;
+                }
+
+            // execute the first ready main thread task
+                for (int i = 0; i < count; i++) {
+                    Task &task = tasks[i];
+                    if (!task.main || !isReady(task)) continue;
+
+                    task.started = true;
+                    execute(&task);
+                    done |= TASK_DEP(i);
+                    progress = true;
+                    break;
+                }
+
+                if (progress) continue;
+
+            // nothing to do on the main thread, wait for any running task
+                if (completed < group.submitted) {
+                    pool.wait(group, completed + 1);
+                    continue;
+                }
+
+                ASSERT(false); // unresolved dependencies
+                break;
+            }
+
+            time = osGetTimeMS() - startTime;
+        }
+
+        void report(const char *title) const {
+            LOG("%s: %d ms\n", title, time);
+            if (!count) return;
+            int startTime = tasks[0].start;
+            for (int i = 1; i < count; i++)
+                startTime = min(startTime, tasks[i].start);
+            for (int i = 0; i < count; i++)
+                LOG("  %-16s %5d ms (at %d ms%s)\n", tasks[i].name, tasks[i].time, tasks[i].start - startTime, tasks[i].main ? ", main" : "");
+        }
+    };
+
+    #define JOB_BATCH   16     // min jobs per thread
+
+    // work-stealing scheduler for many short jobs of the same kind (controller updates)
+    // every thread owns a contiguous range of the job indices and takes jobs from its front,
+    // a thread that runs out of work steals from the back of the other ranges
+    // run() returns when all jobs are done, serial if no threading support
+    ENGINE_TLS struct JobSystem {
+        typedef void (Proc)(int thread, int index, void *userData);
+
+        struct Range {
+            Mutex mutex;
+            int   first;
+            int   last;
+        } ranges[JOB_THREADS];
+
+        struct Worker {
+            JobSystem       *system;
+            int             index;
+            WorkerPool::Job job;
+        } workers[JOB_THREADS];
+
+        Proc *proc;
+        void *userData;
+        int  threads;
+
+        JobSystem() : proc(NULL), userData(NULL), threads(1) {}
+
+        bool pop(int thread, int &index) {
+            Range &r = ranges[thread];
+            OS_LOCK(r.mutex);
+            if (r.first >= r.last)
+                return false;
+            index = r.first++;
+            return true;
+        }
 
-    struct Support {
+        bool steal(int thread, int &index) {
+            for (int i = 1; i < threads; i++) {
+                Range &r = ranges[(thread + i) % threads];
+                OS_LOCK(r.mutex);
+                if (r.first < r.last) {
+                    index = --r.last;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void work(int thread) {
+            int index;
+            while (pop(thread, index) || steal(thread, index))
+                proc(thread, index, userData);
+        }
+
+        static void execute(void *arg) {
+            Worker *worker = (Worker*)arg;
+            PROFILE_ZONE("job worker");
+            worker->system->work(worker->index);
+        }
+
+        void run(int count, Proc *proc, void *userData, int batch = JOB_BATCH) {
+            this->proc     = proc;
+            this->userData = userData;
+
+            threads = 1;
+        #ifdef OS_PTHREAD_MT
+            threads = clamp(count / batch, 1, JOB_THREADS);
+        #endif
+
+            for (int i = 0; i < threads; i++) {
+                ranges[i].first = count * i / threads;
+                ranges[i].last  = count * (i + 1) / threads;
+            }
+
+        // the ranges of the jobs that no worker has taken yet are stolen by the calling thread,
+        // wait() runs them on the calling thread afterwards with nothing left to do
+            WorkerPool::Group group;
+            for (int i = 1; i < threads; i++) {
+                Worker &worker = workers[i];
+                worker.system = this;
+                worker.index  = i;
+                pool.submit(group, worker.job, execute, &worker);
+            }
+
+            work(0);
+
+            pool.wait(group, group.submitted);
+        }
+    } jobs;
+
+    ENGINE_TLS float deltaTime;
+    ENGINE_TLS int   lastTime;
+    ENGINE_TLS int   x, y, width, height;
+
+    ENGINE_TLS struct Support {
         int  maxVectors;
         int  maxAniso;
         int  texMinSize;
@@ -363,7 +771,7 @@ namespace Core {
 #define SETTINGS_VERSION 7
 #define SETTINGS_READING 0xFF
 
-    struct Settings {
+    ENGINE_TLS struct Settings {
         enum Quality  { LOW, MEDIUM, HIGH };
         enum Stereo   { STEREO_OFF, STEREO_SBS, STEREO_ANAGLYPH, STEREO_SPLIT, STEREO_VR };
         enum Scale    { SCALE_25, SCALE_50, SCALE_75, SCALE_100 };
@@ -444,8 +852,8 @@ namespace Core {
         uint8 ctrlIndex;
     } settings;
 
-    bool resetState;
-    bool isQuit;
+    ENGINE_TLS bool resetState;
+    ENGINE_TLS bool isQuit;
 
     int getTime() {
         return osGetTimeMS();
@@ -474,15 +882,15 @@ void osToggleVR(bool enable) {
         int &result;
 
         TimingCPU(int &result) : result(result) {
-            result = Core::getTime();
+            result = int(Profiler::getTime());
         }
 
         ~TimingCPU() {
-            result = Core::getTime() - result;
+            result = int(Profiler::getTime()) - result;
         }
     };
 
-    #define PROFILE_CPU_TIMING(result)  TimingCPU timingCPU(result)
+    #define PROFILE_CPU_TIMING(result)  TimingCPU timingCPU(result); PROFILE_ZONE(#result)
 #else
     #define PROFILE_CPU_TIMING(result)
 #endif
@@ -617,7 +1025,8 @@ struct MeshRange {
     E( sNormal          ) \
     E( sReflect         ) \
     E( sShadow          ) \
-    E( sMask            )
+    E( sMask            ) \
+    E( sPalette         )
 
 #define SHADER_UNIFORMS(E) \
     E( uParam           ) \
@@ -671,7 +1080,8 @@ struct MeshRange {
     E( OPT_AMBIENT     ) \
     E( OPT_SHADOW      ) \
     E( OPT_CONTACT     ) \
-    E( OPT_CAUSTICS    )
+    E( OPT_CAUSTICS    ) \
+    E( OPT_PALETTE     )
 
 enum AttribType   { SHADER_ATTRIBS(DECL_ENUM)  aMAX };
 enum SamplerType  { SHADER_SAMPLERS(DECL_ENUM) sMAX };
@@ -693,34 +1103,35 @@ enum CullMode  { cmNone, cmBack,  cmFront, cmMAX };
 enum BlendMode { bmNone, bmAlpha, bmAdd, bmMult, bmPremult, bmMAX };
 
 namespace Core {
-    float eye;
-    float aspectFix = 1.0f;
-    Texture *eyeTex[2];
-    short4 viewport, viewportDef, scissor;
-    mat4 mModel, mView, mProj, mViewProj, mViewInv;
-    mat4 mLightProj;
-    Basis basis;
-    vec4 viewPos;
-    vec4 lightPos[MAX_LIGHTS];
-    vec4 lightColor[MAX_LIGHTS];
-    vec4 params;
-    vec4 contacts[MAX_CONTACTS];
-
-    struct LightStack {
+    ENGINE_TLS float eye;
+    ENGINE_TLS float aspectFix = 1.0f;
+    ENGINE_TLS Texture *eyeTex[2];
+    ENGINE_TLS short4 viewport, viewportDef, scissor;
+    ENGINE_TLS mat4 mModel, mView, mProj, mViewProj, mViewInv;
+    ENGINE_TLS mat4 mLightProj;
+    ENGINE_TLS Basis basis;
+    ENGINE_TLS vec4 viewPos;
+    ENGINE_TLS vec4 lightPos[MAX_LIGHTS];
+    ENGINE_TLS vec4 lightColor[MAX_LIGHTS];
+    ENGINE_TLS vec4 params;
+    ENGINE_TLS vec4 contacts[MAX_CONTACTS];
+
+    ENGINE_TLS struct LightStack {
         vec4 pos[MAX_LIGHTS];
         vec4 color[MAX_LIGHTS];
     } lightStack[LIGHT_STACK_SIZE];
-    int lightStackCount;
+    ENGINE_TLS int lightStackCount;
 
-    Texture *whiteTex, *whiteCube, *blackTex, *ditherTex, *noiseTex, *perlinTex;
+    ENGINE_TLS Texture *whiteTex, *whiteCube, *blackTex, *ditherTex, *noiseTex, *perlinTex;
+    ENGINE_TLS uint8   noiseData[SQR(NOISE_TEX_SIZE) * 4];
 
-    enum Pass { passCompose, passShadow, passAmbient, passSky, passWater, passFilter, passGUI, passMAX } pass;
+    ENGINE_TLS enum Pass { passCompose, passShadow, passAmbient, passSky, passWater, passFilter, passGUI, passMAX } pass;
 
-    GAPI::Texture *defaultTarget;
+    ENGINE_TLS GAPI::Texture *defaultTarget;
     
-    int32   renderState;
+    ENGINE_TLS int32   renderState;
 
-    struct Active {
+    ENGINE_TLS struct Active {
         const PSO     *pso;
         GAPI::Shader  *shader;
         GAPI::Texture *textures[8];
@@ -750,29 +1161,172 @@ namespace Core {
         Basis       *basis;
     } active;
     
-    struct ReqTarget {
+    ENGINE_TLS struct ReqTarget {
         GAPI::Texture *texture;
         uint32  op;
         uint32  face;
     } reqTarget;
 
-    struct Stats {
+    #define TELEMETRY_FRAMES    1024
+    #define TELEMETRY_BUCKETS   256     // 1 ms per bucket
+    #define TELEMETRY_HITCH     33333   // microseconds, two 60 Hz vsync intervals
+
+    // write telemetry.csv & telemetry.json into the cache dir on exit
+    //#define TELEMETRY_DUMP
+
+    // per-frame samples for the frame time percentiles and hitch counters
+    ENGINE_TLS struct Telemetry {
+        struct Sample {
+            int32  frame, update, render, mixer; // microseconds
+            uint32 dips, tris, rooms, allocs;
+        };
+
+        struct Timing {
+            int32 &result;
+            int64 start;
+
+            Timing(int32 &result) : result(result), start(Profiler::getTime()) {}
+            ~Timing() { result += int32(Profiler::getTime() - start); }
+        };
+
+        Sample samples[TELEMETRY_FRAMES];
+        Sample current;
+        uint32 count;
+        uint32 hitches;
+        uint32 histogram[TELEMETRY_BUCKETS]; // whole session
+        int64  lastTime;
+
+        Telemetry() : count(0), hitches(0), lastTime(0) {
+            memset(&current, 0, sizeof(current));
+            memset(histogram, 0, sizeof(histogram));
+        }
+
+        void add(uint32 dips, uint32 tris, uint32 rooms, uint32 allocs, int32 mixer) {
+            int64 time = Profiler::getTime();
+            if (lastTime) {
+                current.frame  = int32(time - lastTime);
+                current.dips   = dips;
+                current.tris   = tris;
+                current.rooms  = rooms;
+                current.allocs = allocs;
+                current.mixer  = mixer;
+
+                samples[count++ % TELEMETRY_FRAMES] = current;
+                histogram[min(current.frame / 1000, TELEMETRY_BUCKETS - 1)]++;
+                if (current.frame > TELEMETRY_HITCH)
+                    hitches++;
+            }
+            lastTime = time;
+            memset(&current, 0, sizeof(current));
+        }
+
+        static int cmp(const void *a, const void *b) {
+            return *(int32*)a - *(int32*)b;
+        }
+
+    // frame time percentiles of the rolling window in microseconds
+        void getPercentiles(int32 &p50, int32 &p95, int32 &p99, int32 &hitchesWindow) const {
+            int32 frames[TELEMETRY_FRAMES];
+            int n = min(count, uint32(TELEMETRY_FRAMES));
+            hitchesWindow = 0;
+            for (int i = 0; i < n; i++) {
+                frames[i] = samples[i].frame;
+                if (frames[i] > TELEMETRY_HITCH)
+                    hitchesWindow++;
+            }
+
+            if (!n) {
+                p50 = p95 = p99 = 0;
+                return;
+            }
+
+            ::qsort(frames, n, sizeof(frames[0]), cmp);
+            p50 = frames[(n - 1) * 50 / 100];
+            p95 = frames[(n - 1) * 95 / 100];
+            p99 = frames[(n - 1) * 99 / 100];
+        }
+
+    // whole session percentile in milliseconds (histogram bucket)
+        int getSessionPercentile(int percent) const {
+            uint32 total = 0;
+            for (int i = 0; i < TELEMETRY_BUCKETS; i++)
+                total += histogram[i];
+            uint32 target = (total * percent + 99) / 100;
+            uint32 sum = 0;
+            for (int i = 0; i < TELEMETRY_BUCKETS; i++) {
+                sum += histogram[i];
+                if (sum >= target && sum)
+                    return i + 1;
+            }
+            return 0;
+        }
+
+        void save(const char *name) const {
+            char fileName[255 + 16];
+            int n = min(count, uint32(TELEMETRY_FRAMES));
+            uint32 first = count - n;
+
+            sprintf(fileName, "%s.csv", name);
+            FILE *f = fopen(fileName, "wb");
+            if (f) {
+                fprintf(f, "frame,frame_us,update_us,render_us,mixer_us,dips,tris,rooms,allocs\n");
+                for (uint32 i = first; i < count; i++) {
+                    const Sample &s = samples[i % TELEMETRY_FRAMES];
+                    fprintf(f, "%d,%d,%d,%d,%d,%d,%d,%d,%d\n", i, s.frame, s.update, s.render, s.mixer, s.dips, s.tris, s.rooms, s.allocs);
+                }
+                fclose(f);
+            }
+
+            int32 p50, p95, p99, hitchesWindow;
+            getPercentiles(p50, p95, p99, hitchesWindow);
+
+            sprintf(fileName, "%s.json", name);
+            f = fopen(fileName, "wb");
+            if (f) {
+                fprintf(f, "{\n");
+                fprintf(f, "  \"frames\": %d,\n", count);
+                fprintf(f, "  \"hitches\": %d,\n", hitches);
+                fprintf(f, "  \"hitch_us\": %d,\n", TELEMETRY_HITCH);
+                fprintf(f, "  \"session_ms\": { \"p50\": %d, \"p95\": %d, \"p99\": %d },\n", getSessionPercentile(50), getSessionPercentile(95), getSessionPercentile(99));
+                fprintf(f, "  \"window_us\": { \"frames\": %d, \"p50\": %d, \"p95\": %d, \"p99\": %d, \"hitches\": %d }\n", n, p50, p95, p99, hitchesWindow);
+                fprintf(f, "}\n");
+                fclose(f);
+            }
+
+            LOG("telemetry: %d frames, p99 %d ms, %d hitches\n", count, getSessionPercentile(99), hitches);
+        }
+    } telemetry;
+
+    ENGINE_TLS struct Stats {
         uint32 dips, tris, rt, cb, frame, frameIndex, fps;
+        uint32 packets, states;
+        uint32 rooms, allocs;
+        uint32 streamBytes, streamWaits;
         int fpsTime;
     #ifdef PROFILE
         int tFrame;
         int video;
     #endif
 
-        Stats() : frame(0), frameIndex(0), fps(0), fpsTime(0) {}
+        Stats() : frame(0), frameIndex(0), fps(0), allocs(0), fpsTime(0) {}
 
         void start() {
             dips = tris = rt = cb = 0;
+            packets = states = 0;
+            rooms = 0;
+            streamBytes = streamWaits = 0;
         }
 
         void stop() {
+        #ifdef PROFILE
+            telemetry.add(dips, tris, rooms, allocs, Sound::stats.mixer);
+        #else
+            telemetry.add(dips, tris, rooms, allocs, 0);
+        #endif
+            allocs = 0;
+
             if (fpsTime < Core::getTime()) {
-                LOG("FPS: %d DIP: %d TRI: %d RT: %d\n", fps, dips, tris, rt);
+                LOG("FPS: %d DIP: %d TRI: %d RT: %d RQ: %d/%d\n", fps, dips, tris, rt, packets, states);
             #ifdef PROFILE
                 LOG("frame time: %d mcs\n", tFrame / 1000);
                 LOG("sound: mix %d rev %d ren %d/%d ogg %d\n", Sound::stats.mixer, Sound::stats.reverb, Sound::stats.render[0], Sound::stats.render[1], Sound::stats.ogg);
@@ -789,6 +1343,50 @@ namespace Core {
     } stats;
 }
 
+// count heap allocations per frame (replaces the global operator new / delete)
+//#define STATS_ALLOCS
+
+#ifdef STATS_ALLOCS
+#if __cplusplus >= 201103L
+    #define ALLOC_NOEXCEPT noexcept
+#else
+    #define ALLOC_NOEXCEPT throw()
+#endif
+
+// not inlined, GCC takes free() of a pointer from operator new for a mismatch
+#ifdef _MSC_VER
+    #define ALLOC_NOINLINE __declspec(noinline)
+#else
+    #define ALLOC_NOINLINE __attribute__((noinline))
+#endif
+
+void countAlloc() {
+#ifdef _MSC_VER
+    InterlockedIncrement((volatile LONG*)&Core::stats.allocs);
+#else
+    __sync_fetch_and_add(&Core::stats.allocs, 1);
+#endif
+}
+
+ALLOC_NOINLINE void* operator new(size_t size) {
+    countAlloc();
+    return malloc(size ? size : 1);
+}
+
+ALLOC_NOINLINE void* operator new[](size_t size) {
+    countAlloc();
+    return malloc(size ? size : 1);
+}
+
+ALLOC_NOINLINE void operator delete(void *ptr) ALLOC_NOEXCEPT {
+    free(ptr);
+}
+
+ALLOC_NOINLINE void operator delete[](void *ptr) ALLOC_NOEXCEPT {
+    free(ptr);
+}
+#endif
+
 #ifdef _GAPI_SW
     #include "gapi/sw.h"
 #elif _GAPI_GL
@@ -818,19 +1416,21 @@ namespace Core {
     static const char *version = __DATE__;
     static int defLang = 0;
 
-    void readPerlinAsync(Stream *stream, void *userData) {
-        int size = PERLIN_TEX_SIZE * PERLIN_TEX_SIZE * PERLIN_TEX_SIZE;
-        uint8 *perlinData = NULL;
+    #define PERLIN_TASKS 8
 
-        if (stream && stream->size == size) {
-            perlinData = new uint8[size];
-            stream->raw(perlinData, size);
-        } else {
-            perlinData = Noise::generate(123456, PERLIN_TEX_SIZE, 5, 8, 1.0f);
-            Stream::cacheWrite(PERLIN_TEX_NAME, (char*)perlinData, size);
-        }
-        delete stream;
+    ENGINE_TLS struct Startup {
+        int  start;
+        bool pending;   // until the startup graph is run by the game
+        bool cold;      // no perlin volume in the cache, it's generated by the startup graph
+    } startup;
 
+    ENGINE_TLS struct PerlinTask {
+        int zStart, zEnd;
+    } perlinTasks[PERLIN_TASKS];
+
+    ENGINE_TLS float *perlinNoise;
+
+    void initPerlinTex(uint8 *perlinData) {
         perlinTex = new Texture(PERLIN_TEX_SIZE, PERLIN_TEX_SIZE, PERLIN_TEX_SIZE, FMT_LUMINANCE, OPT_REPEAT | OPT_VOLUME, perlinData);
     /*/
         uint8 *pdata = new uint8[SQR(PERLIN_TEX_SIZE) * 4];
@@ -852,9 +1452,64 @@ namespace Core {
         delete[] perlinData;
     }
 
+    void taskPerlinSlices(void *userData) {
+        PerlinTask *task = (PerlinTask*)userData;
+        Noise::generate(perlinNoise, PERLIN_TEX_SIZE, 5, 8, 1.0f, task->zStart, task->zEnd);
+    }
+
+    void taskPerlinUpload(void *userData) {
+        int size = PERLIN_TEX_SIZE * PERLIN_TEX_SIZE * PERLIN_TEX_SIZE;
+        uint8 *perlinData = Noise::quantize(perlinNoise, size);
+        delete[] perlinNoise;
+        perlinNoise = NULL;
+
+        Stream::cacheWrite(PERLIN_TEX_NAME, (char*)perlinData, size);
+        initPerlinTex(perlinData);
+    }
+
+    // worker tasks generate the volume slices, the texture is created on the main thread
+    void addPerlinTasks(TaskGraph &graph) {
+        Noise::setSeed(123456);
+        perlinNoise = new float[PERLIN_TEX_SIZE * PERLIN_TEX_SIZE * PERLIN_TEX_SIZE];
+
+        uint32 deps = 0;
+        for (int i = 0; i < PERLIN_TASKS; i++) {
+            perlinTasks[i].zStart = PERLIN_TEX_SIZE * i / PERLIN_TASKS;
+            perlinTasks[i].zEnd   = PERLIN_TEX_SIZE * (i + 1) / PERLIN_TASKS;
+            deps |= TASK_DEP(graph.add("perlin", taskPerlinSlices, perlinTasks + i));
+        }
+        graph.add("perlin upload", taskPerlinUpload, NULL, deps, true);
+    }
+
+    void readPerlinAsync(Stream *stream, void *userData) {
+        int size = PERLIN_TEX_SIZE * PERLIN_TEX_SIZE * PERLIN_TEX_SIZE;
+
+        if (stream && stream->size == size) {
+            uint8 *perlinData = new uint8[size];
+            stream->raw(perlinData, size);
+            delete stream;
+            initPerlinTex(perlinData);
+            return;
+        }
+        delete stream;
+
+        startup.cold = true;
+        if (startup.pending)
+            return;
+
+        TaskGraph graph;
+        addPerlinTasks(graph);
+        graph.run();
+        graph.report("perlin");
+    }
+
     void init() {
         LOG("OpenLara (%s)\n", version);
 
+        startup.start   = osGetTimeMS();
+        startup.pending = true;
+        startup.cold    = false;
+
         x = y = 0;
         eyeTex[0] = eyeTex[1] = NULL;
         lightStackCount = 0;
@@ -864,7 +1519,7 @@ namespace Core {
         support.texMaxLevel = true;
         support.derivatives = true;
 
-        #ifdef USE_INFLATE
+        #if defined(USE_INFLATE) && !defined(ENGINE_INSTANCES) // shared tables, initialized once by the host
             tinf_init();
         #endif
 
@@ -935,13 +1590,11 @@ namespace Core {
             ditherTex = new Texture(8, 8, 1, FMT_LUMINANCE, OPT_REPEAT | OPT_NEAREST, &ditherData);
         }
 
-        { // generate noise texture
-            uint8 *noiseData = new uint8[SQR(NOISE_TEX_SIZE) * 4];
+        { // generate noise texture (the data is kept for CPU water simulation)
             for (int i = 0; i < SQR(NOISE_TEX_SIZE) * 4; i++) {
                 noiseData[i] = rand() % 255;
             }
             noiseTex = new Texture(NOISE_TEX_SIZE, NOISE_TEX_SIZE, 1, FMT_RGBA, OPT_REPEAT, noiseData);
-            delete[] noiseData;
         }
 
         perlinTex = NULL;
@@ -1106,6 +1759,10 @@ namespace Core {
         GAPI::deinit();
         NAPI::deinit();
         Sound::deinit();
+        pool.stop();
+    #ifdef OS_IO_THREAD
+        osIOFree();
+    #endif
         Stream::deinit();
     }
 
@@ -1395,6 +2052,111 @@ namespace Core {
         stats.dips++;
         stats.tris += range.iCount / 3;
     }
+
+// render queue
+// records draw packets and submits them sorted by (pass, state, texture, depth)
+// only the state that differs from the previous packet is applied
+// used for the opaque room geometry, entities stay immediate: every entity has its own state
+// (main light, ambient cube, joints), so sorting their parts wouldn't remove any state change,
+// and the blended passes must keep the back-to-front traversal order
+    ENGINE_TLS struct RenderQueue {
+        typedef void (*SetStateProc)(void *userData, int32 state);
+
+        struct Packet {
+            uint32     key;   // [31..29] - pass, [28..16] - state, [15..0] - texture
+            uint32     order; // [31..16] - depth, [15..0] - record index
+            int32      state;
+            GAPI::Mesh *mesh;
+            Texture    *atlas;
+            MeshRange  range;
+            short4     scissor;
+            Basis      basis;
+
+            static int cmp(const Packet &a, const Packet &b) {
+                if (a.key   != b.key)   return a.key   < b.key   ? -1 : 1;
+                if (a.order != b.order) return a.order < b.order ? -1 : 1;
+                return 0;
+            }
+        };
+
+        Array<Packet> packets;
+
+        RenderQueue() : packets(256) {}
+
+        static uint32 getKey(int state, uint16 tile) {
+            return (uint32(Core::pass) << 29) | ((uint32(state) & 0x1FFF) << 16) | tile;
+        }
+
+        void add(int32 state, int stateIndex, GAPI::Mesh *mesh, const MeshRange &range, Texture *atlas, const short4 &scissor, const Basis &basis, float depth) {
+            Packet p;
+            p.key     = getKey(stateIndex, atlas ? range.tile : 0);
+            p.order   = (uint32(clamp(depth, 0.0f, 65535.0f)) << 16) | (packets.length & 0xFFFF);
+            p.state   = state;
+            p.mesh    = mesh;
+            p.atlas   = atlas;
+            p.range   = range;
+            p.scissor = scissor;
+            p.basis   = basis;
+            packets.push(p);
+        }
+
+        void submit(SetStateProc setState, void *userData) {
+            if (!packets.length)
+                return;
+
+            packets.sort();
+
+            int32   state   = -1;
+            Basis   *basis  = NULL;
+            short4  scissor = Core::scissor;
+        #ifdef SPLIT_BY_TILE
+            Texture *atlas  = NULL;
+            uint16  tile    = 0xFFFF;
+            uint16  clut    = 0xFFFF;
+        #endif
+
+            for (int i = 0; i < packets.length; i++) {
+                Packet &p = packets[i];
+
+                if (p.state != state) {
+                    state = p.state;
+                    setState(userData, state);
+                    basis = NULL; // shader may be changed, force basis update
+                    stats.states++;
+                }
+
+                if (p.scissor != scissor) {
+                    scissor = p.scissor;
+                    setScissor(scissor);
+                    stats.states++;
+                }
+
+                if (!basis || basis->pos != p.basis.pos || basis->rot != p.basis.rot) {
+                    basis = &p.basis;
+                    setBasis(basis, 1);
+                    mModel.identity();
+                    mModel.setRot(basis->rot);
+                    mModel.setPos(basis->pos);
+                    stats.states++;
+                }
+
+            #ifdef SPLIT_BY_TILE
+                if (p.atlas && (p.atlas != atlas || p.range.tile != tile || p.range.clut != clut)) {
+                    atlas = p.atlas;
+                    tile  = p.range.tile;
+                    clut  = p.range.clut;
+                    atlas->bindTile(tile, clut);
+                    stats.states++;
+                }
+            #endif
+
+                Core::DIP(p.mesh, p.range);
+                stats.packets++;
+            }
+
+            packets.reset();
+        }
+    } renderQueue;
 }
 
 #include "mesh.h"
@@ -646,6 +646,52 @@ namespace Debug {
             }
         }
 
+        // getJoints timing for every animation frame of every model, pre-decoded vs. packed angles
+        void benchJoints(TR::Level *level) {
+            const int ITERATIONS = 16;
+
+            Basis joints[256];
+            mat4 matrix;
+            matrix.identity();
+            int calls = 0, timeRots = 0, timeAngles = 0;
+
+            for (int i = 0; i < level->modelsCount; i++) {
+                TR::Model &model = level->models[i];
+                if (model.animation >= level->animsCount || !model.mCount) continue;
+
+                int animEnd = level->animsCount;
+                for (int j = 0; j < level->modelsCount; j++)
+                    if (level->models[j].animation > model.animation && level->models[j].animation < animEnd)
+                        animEnd = level->models[j].animation;
+
+                Animation anim(level, &model);
+
+                for (int j = 0; j < animEnd - model.animation; j++) {
+                    anim.setAnim(j);
+
+                    for (int pass = 0; pass < 2; pass++) {
+                        int rotCount = anim.rotCount;
+                        if (pass) anim.rotCount = 0;
+
+                        int startTime = osGetTimeMS();
+                        for (int k = 0; k < ITERATIONS; k++)
+                            for (int f = 0; f < anim.framesCount; f++) {
+                                anim.time = f / 30.0f;
+                                anim.updateInfo();
+                                if (pass) anim.rotCount = 0;
+                                anim.getJoints(matrix, -1, false, joints);
+                            }
+                        (pass ? timeAngles : timeRots) += osGetTimeMS() - startTime;
+
+                        anim.rotCount = rotCount;
+                    }
+                    calls += ITERATIONS * anim.framesCount;
+                }
+            }
+
+            LOG("getJoints bench (level %d): %d calls, pre-decoded %d ms, packed %d ms\n", level->id, calls, timeRots, timeAngles);
+        }
+
         void dumpPalette(TR::Level *level, int index)
         {
             char buf[255];
@@ -747,6 +793,16 @@ namespace Debug {
             char buf[255];
             sprintf(buf, "DIP = %d, TRI = %d, SND = %d, active = %d", Core::stats.dips, Core::stats.tris, Sound::channelsCount, activeCount);
             Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
+            int32 p50, p95, p99, hitches;
+            Core::telemetry.getPercentiles(p50, p95, p99, hitches);
+            sprintf(buf, "frame p50 = %.1f, p95 = %.1f, p99 = %.1f ms, hitches = %d / %d", p50 / 1000.0f, p95 / 1000.0f, p99 / 1000.0f, hitches, Core::telemetry.hitches);
+            Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
+            sprintf(buf, "stream = %d KB, waits = %d", Core::stats.streamBytes / 1024, Core::stats.streamWaits);
+            Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
+        #ifdef OS_IO_THREAD
+            sprintf(buf, "io = %d, depth = %d / %d, latency = %d / %d ms", ioStats.requests, ioStats.depth, ioStats.maxDepth, ioStats.latency, ioStats.maxLatency);
+            Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
+        #endif
             vec3 angle = controller->angle * RAD2DEG;
             sprintf(buf, "pos = (%d, %d, %d), angle = (%d, %d), room = %d (camera: %d [%d, %d, %d])", int(controller->pos.x), int(controller->pos.y), int(controller->pos.z), (int)angle.x, (int)angle.y, controller->getRoomIndex(), game->getCamera()->getRoomIndex(), int(viewPos.x), int(viewPos.y), int(viewPos.z));
             Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
@@ -0,0 +1,210 @@
+#ifndef H_DEFERRED
+#define H_DEFERRED
+
+#include "core.h"
+#include "controller.h"
+
+// parallel-safe controllers (Controller::parallel) are updated by the job threads
+// and see this proxy as their IGame for the duration of update()
+// queries go to the real game, sounds, effects, triggers, map and level changes are recorded
+// and replayed on the main thread in the controllers list order (see Level::updateControllers)
+// calls that need an immediate result from the game state (spawns, inventory, path finding)
+// or belong to the rendering are not available for them
+
+struct DeferredGame : IGame {
+    enum Type {
+        CMD_SOUND,
+        CMD_EFFECT,
+        CMD_DYN_LIGHT,
+        CMD_PARTICLE,
+        CMD_WATER_DROP,
+        CMD_SHAKE,
+        CMD_FLIP_MAP,
+        CMD_NEXT_LEVEL,
+        CMD_REMOVE,
+        CMD_LOAD_LEVEL,
+        CMD_SAVE_GAME,
+        CMD_LOAD_GAME,
+        CMD_TRIGGER,
+        CMD_MUZZLE_FLASH,
+        CMD_INV_SHOW,
+        CMD_INV_ADD,
+        CMD_PLAY_TRACK,
+        CMD_STOP_TRACK,
+    };
+
+    struct Command {
+        int        job;
+        int        order;
+        uint8      type;
+        int        id;      // sound, effect, particle or item type, level id, save slot, inventory page or track
+        int        param;   // sound flags, particle room, item count or index, light index or bool arguments
+        int        index;   // joint or player index
+        vec3       pos;
+        vec3       vec;     // particle velocity, water drop radius & strength, shake value
+        Controller *controller;
+
+        static int cmp(const Command &a, const Command &b) {
+            if (a.job != b.job)
+                return a.job - b.job;
+            return a.order - b.order;
+        }
+
+        void execute(IGame *game) const {
+            switch (type) {
+                case CMD_SOUND        : game->playSound(id, pos, param); break;
+                case CMD_EFFECT       : game->setEffect(controller, TR::Effect::Type(id)); break;
+                case CMD_DYN_LIGHT    : game->setDynamicLight(pos, param != 0); break;
+                case CMD_PARTICLE     : game->addParticle(TR::Entity::Type(id), param, pos, vec); break;
+                case CMD_WATER_DROP   : game->waterDrop(pos, vec.x, vec.y); break;
+                case CMD_SHAKE        : game->shakeCamera(vec.x, param != 0); break;
+                case CMD_FLIP_MAP     : game->flipMap(param != 0); break;
+                case CMD_NEXT_LEVEL   : game->loadNextLevel(); break;
+                case CMD_REMOVE       : game->removeEntity(controller); break;
+                case CMD_LOAD_LEVEL   : game->loadLevel(TR::LevelID(id)); break;
+                case CMD_SAVE_GAME    : game->saveGame(TR::LevelID(id), (param & 1) != 0, (param & 2) != 0); break;
+                case CMD_LOAD_GAME    : game->loadGame(id); break;
+                case CMD_TRIGGER      : game->checkTrigger(controller, param != 0); break;
+                case CMD_MUZZLE_FLASH : game->addMuzzleFlash(controller, index, pos, param); break;
+                case CMD_INV_SHOW     : game->invShow(index, id, param); break;
+                case CMD_INV_ADD      : game->invAdd(TR::Entity::Type(id), param); break;
+                case CMD_PLAY_TRACK   : game->playTrack(uint8(id), param != 0); break;
+                case CMD_STOP_TRACK   : game->stopTrack(); break;
+                default               : ASSERT(false);
+            }
+        }
+    };
+
+    IGame          *game;
+    int            job;
+    Array<Command> commands;
+
+    DeferredGame() : game(NULL), job(0) {}
+
+    void reset(IGame *game) {
+        this->game = game;
+        commands.reset();
+    }
+
+    void add(Type type, Controller *controller = NULL, int id = 0, int param = 0, const vec3 &pos = vec3(0.0f), const vec3 &vec = vec3(0.0f), int index = 0) {
+        Command cmd;
+        cmd.job        = job;
+        cmd.order      = commands.length;
+        cmd.type       = type;
+        cmd.id         = id;
+        cmd.param      = param;
+        cmd.index      = index;
+        cmd.pos        = pos;
+        cmd.vec        = vec;
+        cmd.controller = controller;
+        commands.push(cmd);
+    }
+
+// queries
+    virtual TR::Level*   getLevel()                  { return game->getLevel(); }
+    virtual MeshBuilder* getMesh()                   { return game->getMesh(); }
+    virtual ICamera*     getCamera(int index = -1)   { return game->getCamera(index); }
+    virtual Controller*  getLara(int index = 0)      { return game->getLara(index); }
+    virtual Controller*  getLara(const vec3 &pos)    { return game->getLara(pos); }
+    virtual bool         isCutscene()                { return game->isCutscene(); }
+    virtual vec4         projectPoint(const vec4 &p) { return game->projectPoint(p); }
+
+// recorded side effects
+    virtual void loadLevel(TR::LevelID id) {
+        add(CMD_LOAD_LEVEL, NULL, id);
+    }
+
+    virtual void saveGame(TR::LevelID id, bool checkpoint, bool updateStats) {
+        add(CMD_SAVE_GAME, NULL, id, (checkpoint ? 1 : 0) | (updateStats ? 2 : 0));
+    }
+
+    virtual void loadGame(int slot) {
+        add(CMD_LOAD_GAME, NULL, slot);
+    }
+
+    virtual void loadNextLevel() {
+        add(CMD_NEXT_LEVEL);
+    }
+
+    virtual void flipMap(bool water = true) {
+        add(CMD_FLIP_MAP, NULL, 0, water);
+    }
+
+    virtual void waterDrop(const vec3 &pos, float radius, float strength) {
+        add(CMD_WATER_DROP, NULL, 0, 0, pos, vec3(radius, strength, 0.0f));
+    }
+
+    virtual void setEffect(Controller *controller, TR::Effect::Type effect) {
+        add(CMD_EFFECT, controller, effect);
+    }
+
+    virtual void setDynamicLight(const vec3 &pos, bool enable) {
+        add(CMD_DYN_LIGHT, NULL, 0, enable, pos);
+    }
+
+    virtual void shakeCamera(float value, bool additive = false) {
+        add(CMD_SHAKE, NULL, 0, additive, vec3(0.0f), vec3(value, 0.0f, 0.0f));
+    }
+
+    virtual void removeEntity(Controller *controller) {
+        add(CMD_REMOVE, controller);
+    }
+
+    virtual void addParticle(TR::Entity::Type type, int room, const vec3 &pos, const vec3 &velocity = vec3(0.0f)) {
+        add(CMD_PARTICLE, NULL, type, room, pos, velocity);
+    }
+
+    virtual void checkTrigger(Controller *controller, bool heavy) {
+        add(CMD_TRIGGER, controller, 0, heavy);
+    }
+
+    virtual void addMuzzleFlash(Controller *owner, int joint, const vec3 &offset, int lightIndex) {
+        add(CMD_MUZZLE_FLASH, owner, 0, lightIndex, offset, vec3(0.0f), joint);
+    }
+
+    virtual void invShow(int playerIndex, int page, int itemIndex = -1) {
+        add(CMD_INV_SHOW, NULL, page, itemIndex, vec3(0.0f), vec3(0.0f), playerIndex);
+    }
+
+    virtual void invAdd(TR::Entity::Type type, int count = 1) {
+        add(CMD_INV_ADD, NULL, type, count);
+    }
+
+    virtual Sound::Sample* playSound(int id, const vec3 &pos = vec3(0.0f), int flags = 0) const {
+        ((DeferredGame*)this)->add(CMD_SOUND, NULL, id, flags, pos);
+        return NULL;
+    }
+
+    virtual void playTrack(uint8 track, bool background = false) {
+        add(CMD_PLAY_TRACK, NULL, track, background);
+    }
+
+    virtual void stopTrack() {
+        add(CMD_STOP_TRACK);
+    }
+
+// not available to parallel controllers (Controller::parallel must be false for their users)
+    virtual void applySettings(const Core::Settings &settings) { ASSERT(false); }
+
+    virtual uint16 getRandomBox(uint16 zone, uint16 *zones) { ASSERT(false); return 0; }
+    virtual uint16 findPath(int ascend, int descend, bool big, int boxStart, int boxEnd, uint16 *zones, uint16 **boxes) { ASSERT(false); return 0; }
+
+    virtual Controller* addEntity(TR::Entity::Type type, int room, const vec3 &pos, float angle = 0.0f) { ASSERT(false); return NULL; }
+
+    virtual bool invUse(int playerIndex, TR::Entity::Type type)       { ASSERT(false); return false; }
+    virtual int* invCount(TR::Entity::Type type)                      { ASSERT(false); return NULL; }
+    virtual bool invChooseKey(int playerIndex, TR::Entity::Type hole) { ASSERT(false); return false; }
+
+    virtual void setWaterParams(float height) { ASSERT(false); }
+    virtual void setShader(Core::Pass pass, Shader::Type type, bool underwater = false, bool alphaTest = false) { ASSERT(false); }
+    virtual void setRoomParams(int roomIndex, Shader::Type type, float diffuse, float ambient, float specular, float alpha, bool alphaTest = false) { ASSERT(false); }
+    virtual void setupBinding() { ASSERT(false); }
+    virtual void getVisibleRooms(RoomDesc *roomsList, int &roomsCount, int from, int to, const vec4 &viewPort, bool water, int count = 0) { ASSERT(false); }
+    virtual void renderEnvironment(int roomIndex, const vec3 &pos, Texture **targets, int stride = 0, Core::Pass pass = Core::passAmbient) { ASSERT(false); }
+    virtual void renderModelFull(int modelIndex, bool underwater, Basis *joints) { ASSERT(false); }
+    virtual void renderCompose(int roomIndex) { ASSERT(false); }
+    virtual void renderView(int roomIndex, bool water, bool showUI, int roomsCount = 0, RoomDesc *roomsList = NULL) { ASSERT(false); }
+    virtual void renderGame(bool showUI, bool invBG) { ASSERT(false); }
+};
+
+#endif
@@ -293,7 +293,7 @@ struct Enemy : Character {
         ASSERT(target);
         target->hit(damage, this);
         if (joint >= 0)
-            game->addEntity(TR::Entity::BLOOD, target->getRoomIndex(), getJoint(joint) * offset);
+            game->addParticle(TR::Entity::BLOOD, target->getRoomIndex(), getJoint(joint) * offset);
     }
 
     Mood getMoodFixed() {
@@ -2489,9 +2489,12 @@ struct Doppelganger : Enemy {
                 pos += velocity * (30.0f * Core::deltaTime);
             }
         } else {
-            animation.frameA = target->animation.frameA;
-            animation.frameB = target->animation.frameB;
-            animation.delta  = target->animation.delta;
+            animation.frameA   = target->animation.frameA;
+            animation.frameB   = target->animation.frameB;
+            animation.rotA     = target->animation.rotA;
+            animation.rotB     = target->animation.rotB;
+            animation.rotCount = min(target->animation.rotCount, (int)animation.model->mCount);
+            animation.delta    = target->animation.delta;
         }
     }
 
@@ -2528,7 +2531,7 @@ struct ScionTarget : Enemy {
 
                 if (index != int(timer / 0.3f)) {
                     vec3 p = pos + vec3((randf() * 2.0f - 1.0f) * 512.0f, (randf() * 2.0f - 1.0f) * 64.0f - 500.0f, (randf() * 2.0f - 1.0f) * 512.0f);
-                    game->addEntity(TR::Entity::EXPLOSION, getRoomIndex(), p);
+                    game->addParticle(TR::Entity::EXPLOSION, getRoomIndex(), p);
                     game->shakeCamera(0.5f);
                 }
 
@@ -2598,7 +2601,7 @@ struct Human : Enemy {
 
         if (targetDist < HUMAN_DIST_SHOT && randf() < ((HUMAN_DIST_SHOT - targetDist) / HUMAN_DIST_SHOT - 0.25f)) {
             bite(-1, vec3(0.0f), damage);
-            game->addEntity(TR::Entity::BLOOD, target->getRoomIndex(), target->getJoint(rand() % target->getModel()->mCount).pos);
+            game->addParticle(TR::Entity::BLOOD, target->getRoomIndex(), target->getJoint(rand() % target->getModel()->mCount).pos);
             game->playSound(target->stand == STAND_UNDERWATER ? TR::SND_HIT_UNDERWATER : TR::SND_HIT, target->pos, Sound::PAN);
             return true;
         }
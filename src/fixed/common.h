@@ -4,7 +4,9 @@
 //#define PROFILING
 #ifdef PROFILING
     #define STATIC_ITEMS
-    #define PROFILE_FRAMETIME
+    #ifndef PROFILE_STAGETIME
+        #define PROFILE_FRAMETIME
+    #endif
 //    #define PROFILE_SOUNDTIME
 #endif
 
@@ -53,8 +55,24 @@
 
     #define USE_FMT     (LVL_FMT_PKD)
 
+    #define USE_TILED_FLUSH
+
     #define _CRT_SECURE_NO_WARNINGS
     #include <windows.h>
+#elif defined(__GBA_LINUX__)
+    #define USE_DIV_TABLE
+
+    #define MODE4
+    #define FRAME_WIDTH  240
+    #define FRAME_HEIGHT 160
+
+    #define USE_FMT     (LVL_FMT_PKD)
+
+    #define USE_TILED_FLUSH
+
+    #include <stdlib.h>
+    #include <stdint.h>
+    #include <time.h>
 #elif defined(__GBA__)
     #define USE_DIV_TABLE
     #define ROM_READ
@@ -261,18 +279,21 @@
     #define ALIGN4      __declspec(align(4))
     #define ALIGN8      __declspec(align(8))
     #define ALIGN16     __declspec(align(16))
+    #define X_TLS       __declspec(thread)
 #elif defined(__WATCOMC__) || defined(__3DO__)
     #define X_INLINE    inline
     #define X_NOINLINE
     #define ALIGN4
     #define ALIGN8
     #define ALIGN16
+    #define X_TLS
 #else
     #define X_INLINE    __attribute__((always_inline)) inline
     #define X_NOINLINE  __attribute__((noinline))
     #define ALIGN4      __attribute__((aligned(4)))
     #define ALIGN8      __attribute__((aligned(8)))
     #define ALIGN16     __attribute__((aligned(16)))
+    #define X_TLS       __thread
 #endif
 
 #if defined(__3DO__)
@@ -300,11 +321,15 @@ typedef uint16             divTableInt;
 
 #define ADDR_ALIGN4(x)  ((uint8*)x += ((intptr_t(x) + 3) & ~3) - intptr_t(x))
 
+#ifdef USE_TILED_FLUSH
+#include <new> // the host workers use the standard threads
+#else
 //#include <new>
 inline void* operator new(size_t, void *ptr)
 {
     return ptr;
 }
+#endif
 
 #if defined(__3DO__) || defined(__32X__)
 X_INLINE int32 abs(int32 x) {
@@ -318,6 +343,8 @@ X_INLINE int32 abs(int32 x) {
     #define int2str(x,str) sprintf(str, "%d", x)
 #elif defined(__TNS__)
     #define int2str(x,str) __itoa(x, str, 10)
+#elif defined(__GBA_LINUX__)
+    #define int2str(x,str) sprintf(str, "%d", x)
 #else
     #define int2str(x,str) _itoa(x, str, 10)
 #endif
@@ -342,7 +369,7 @@ X_INLINE int32 abs(int32 x) {
     #define STATIC_ASSERT(x)
 #endif
 
-#if defined(__GBA_WIN__)
+#if defined(__GBA_WIN__) || defined(__GBA_LINUX__)
     extern uint16 fb[FRAME_WIDTH * FRAME_HEIGHT];
 #elif defined(__GBA__)
     extern uint32 fb;
@@ -392,7 +419,7 @@ extern uint8* vramPtr;
     #define SND_DECODE(x)    ((x) - 128)
     #define SND_MIN          -128
     #define SND_MAX          127
-#elif defined(__GBA_WIN__)
+#elif defined(__GBA_WIN__) || defined(__GBA_LINUX__)
     #define SND_SAMPLES      1024
     #define SND_OUTPUT_FREQ  22050
     #define SND_SAMPLE_FREQ  22050
@@ -523,6 +550,11 @@ extern uint8* vramPtr;
 #define OT_SHIFT        4
 #define OT_SIZE         ((VIEW_MAX_F >> (FIXED_SHIFT + OT_SHIFT)) + 1)
 
+#ifdef USE_TILED_FLUSH
+    #define TILE_COUNT      4   // horizontal screen bands, flushed in parallel with the same OT order
+    #define TILE_HEIGHT     ((FRAME_HEIGHT + TILE_COUNT - 1) / TILE_COUNT)
+#endif
+
 // system keys (keys)
 enum InputKey {
     IK_NONE     = 0,
@@ -809,7 +841,7 @@ struct RoomVertex
 {
 #if defined(__3DO__)
     uint16 xyz565;
-#elif defined(__GBA__) || defined(__GBA_WIN__) || defined(__32X__)
+#elif defined(__GBA__) || defined(__GBA_WIN__) || defined(__GBA_LINUX__) || defined(__32X__)
     uint8 x, y, z, g;
 #else
     uint8 x, y, z, g;
@@ -2807,7 +2839,7 @@ void matrixFrame_c(const void* pos, const void* angles);
 void matrixFrameLerp(const void* pos, const void* anglesA, const void* anglesB, int32 delta, int32 rate);
 void matrixSetView(const vec3i &pos, int32 angleX, int32 angleY);
 
-#if defined(__GBA__) || defined(__GBA_WIN__)
+#if defined(__GBA__) || defined(__GBA_WIN__) || defined(__GBA_LINUX__)
 #define renderInit()
 #define renderFree()
 #define renderSwap()
@@ -2900,6 +2932,11 @@ void osSetPalette(const uint16* palette);
 const void* osLoadScreen(LevelID id);
 const void* osLoadLevel(LevelID id);
 
+#ifdef USE_TILED_FLUSH
+typedef void (*TaskProc)(int32 index);
+void osParallelFor(int32 count, TaskProc proc); // calls proc(0..count-1) on worker threads, returns when all are done
+#endif
+
 #ifdef PROFILING
     #define PROFILE_FRAME\
         CNT_UPDATE,\
@@ -2962,6 +2999,17 @@ const void* osLoadLevel(LevelID id);
             QueryPerformanceCounter(&g_current);\
             value += uint32(g_current.QuadPart - g_timer.QuadPart);\
         }
+    #elif defined(__GBA_LINUX__)
+        extern uint32 g_timer;
+        uint32 osGetSystemTimeUS();
+
+        #define PROFILE_START() {\
+            g_timer = osGetSystemTimeUS();\
+        }
+
+        #define PROFILE_STOP(value) {\
+            value += osGetSystemTimeUS() - g_timer;\
+        }
     #elif defined(__GBA__)
         #ifdef PROFILE_SOUNDTIME
             #define TIMER_FREQ_DIV 1
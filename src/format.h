@@ -1689,10 +1689,10 @@ namespace TR {
     };
 
     // used for access from ::cmp func
-    static TextureInfo   *gObjectTextures = NULL;
-    static TextureInfo   *gSpriteTextures = NULL;
-    static int            gObjectTexturesCount;
-    static int            gSpriteTexturesCount;
+    static ENGINE_TLS TextureInfo   *gObjectTextures = NULL;
+    static ENGINE_TLS TextureInfo   *gSpriteTextures = NULL;
+    static ENGINE_TLS int            gObjectTexturesCount;
+    static ENGINE_TLS int            gSpriteTexturesCount;
 
     struct Face {
         union {
@@ -2074,11 +2074,7 @@ namespace TR {
         Vertex      *vertices;
         Face        *faces;
 
-        Mesh() : vertices(0), faces(0) {}
-        ~Mesh() {
-            delete[] vertices;
-            delete[] faces;
-        }
+        Mesh() : vertices(0), faces(0) {} // vertices and faces are owned by Level::arena
     };
 
     struct Entity {
@@ -2713,9 +2709,59 @@ namespace TR {
             return vec3(0);
         }
 
+        // decode rotations of the first count joints in one pass over the angles stream
+        void getAngles(Version version, int count, vec3 *result) {
+            if (version & VER_TR1) {
+                for (int i = 0; i < count; i++)
+                    result[i] = getAngle(version, i);
+                return;
+            }
+
+            int index = 0;
+            for (int i = 0; i < count; i++) {
+                uint16 a = angles[index++];
+
+                float rot;
+                if (((version & VER_VERSION) >= VER_TR4)) {
+                    rot = float(a & 0x0FFF) * (PI2 / 4096.0f);
+                } else {
+                    rot = float(a & 0x03FF) * (PI2 / 1024.0f);
+                }
+
+                switch (a & 0xC000) {
+                    case 0x4000 : result[i] = vec3(rot, 0, 0); break;
+                    case 0x8000 : result[i] = vec3(0, rot, 0); break;
+                    case 0xC000 : result[i] = vec3(0, 0, rot); break;
+                    default     : result[i] = unpack(a, angles[index++]);
+                }
+            }
+        }
+
         #undef ANGLE_SCALE
     };
 
+    // joint rotation quaternion of the pre-decoded animation frame
+    struct AnimRot {
+        int16 x, y, z, w;
+
+        #define ANIM_ROT_SCALE 32767.0f
+
+        AnimRot() {}
+
+        AnimRot(const quat &q) {
+            x = int16(q.x * ANIM_ROT_SCALE);
+            y = int16(q.y * ANIM_ROT_SCALE);
+            z = int16(q.z * ANIM_ROT_SCALE);
+            w = int16(q.w * ANIM_ROT_SCALE);
+        }
+
+        operator quat() const {
+            return quat(float(x), float(y), float(z), float(w)) * (1.0f / ANIM_ROT_SCALE);
+        }
+
+        #undef ANIM_ROT_SCALE
+    };
+
     struct AnimTexture {
         uint16 count;
         uint16 *textures;
@@ -2879,6 +2925,8 @@ namespace TR {
         Version         version;
         LevelID         id;
 
+        Arena           arena;  // rooms and meshes geometry, released on level unload
+
         int32           tilesCount;
 
         uint16          roomsCount;
@@ -2914,6 +2962,10 @@ namespace TR {
         int32           frameDataSize;
         uint16          *frameData;
 
+        AnimRot         *animRots;      // pre-decoded joint rotations of all animation frames
+        int32           *animRotsStart; // first frame rotations of animation or -1
+        uint8           *animRotsCount; // joints per frame of animation
+
         int32           modelsCount;
         Model           *models;
 
@@ -3157,8 +3209,25 @@ namespace TR {
         uint32 tsubCount;
         uint8 *tsub;
 
-        Level(Stream &stream) {
+        bool detached;   // parsed off the main thread, MAIN.SFX is requested on the move into the game
+        bool sfxPending;
+
+        // the data of a level parsed by a detached instance is moved into this one (see prefetchLevel)
+        Level(Stream &stream, Level *parsed = NULL, bool detached = false) {
+            if (parsed) {
+                memcpy((void*)this, (void*)parsed, sizeof(*this));
+                memset((void*)parsed, 0, sizeof(*parsed));
+                this->detached = false;
+                initTextureGlobals();
+                if (sfxPending) {
+                    sfxPending = false;
+                    requestSamples();
+                }
+                return;
+            }
+
             memset(this, 0, sizeof(*this));
+            this->detached = detached;
             version     = VER_UNKNOWN;
             cutEntity   = -1;
             meshesCount = 0;
@@ -3248,18 +3317,12 @@ namespace TR {
         }
 
         ~Level() {
-        // rooms
-            for (int i = 0; i < roomsCount; i++) {
-                Room &r = rooms[i];
-                delete[] r.data.vertices;
-                delete[] r.data.faces;
-                delete[] r.data.sprites;
-                delete[] r.portals;
-                delete[] r.sectors;
-                delete[] r.lights;
-                delete[] r.meshes;
+            Stream::cancel(this); // sound samples request
+        // rooms and meshes data
+            if (arena.allocs) { // not moved out
+                LOG("level arena: %d allocs, %d KB peak\n", arena.allocs, arena.peak / 1024);
             }
-            delete[] rooms;
+            arena.release();
             delete[] floors;
             delete[] meshOffsets;
             delete[] anims;
@@ -3475,7 +3538,7 @@ namespace TR {
             readSoundMap(stream);
             readSoundOffsets(stream);
 
-            new Stream(getGameSoundsFile(version), sfxLoadAsync, this);
+            requestSamples();
         }
 
         void loadTR2_PSX (Stream &stream) {
@@ -3537,7 +3600,7 @@ namespace TR {
             readDemoData(stream);
             readSoundMap(stream);
             readSoundOffsets(stream);
-            new Stream(getGameSoundsFile(version), sfxLoadAsync, this);
+            requestSamples();
         }
 
         void loadTR3_PSX (Stream &stream) {
@@ -3716,7 +3779,7 @@ namespace TR {
                 stream.seek(4);            
             }
 
-            rooms = stream.read(roomsCount) ? new Room[roomsCount] : NULL;
+            rooms = stream.read(roomsCount) ? arena.alloc<Room>(roomsCount) : NULL;
             for (int i = 0; i < roomsCount; i++) {
                 readRoom(stream, i);
             }
@@ -4032,7 +4095,7 @@ namespace TR {
                     case SAT_ROOMDATA :
                         ASSERTV(stream.readBE32() == 0x00000044);
                         roomsCount = stream.readBE32();
-                        rooms = new Room[roomsCount];
+                        rooms = arena.alloc<Room>(roomsCount);
                         memset(rooms, 0, sizeof(Room) * roomsCount);
                         break;
                     case SAT_ROOMNUMB :
@@ -4052,7 +4115,7 @@ namespace TR {
                         if (flag == 0x00000014) {
                             room->meshesCount = stream.readBE32();
 
-                            room->meshes = room->meshesCount ? new Room::Mesh[room->meshesCount] : NULL;
+                            room->meshes = room->meshesCount ? arena.alloc<Room::Mesh>(room->meshesCount) : NULL;
                             for (int i = 0; i < room->meshesCount; i++) {
                                 Room::Mesh &m = room->meshes[i];
                                 m.x = stream.readBE32();
@@ -4076,7 +4139,7 @@ namespace TR {
 
                         data.size = stream.readBE32();
                         data.vCount = stream.readBE16();
-                        data.vertices = new Room::Data::Vertex[data.vCount];
+                        data.vertices = arena.alloc<Room::Data::Vertex>(data.vCount);
                         for (int j = 0; j < data.vCount; j++) {
                             Room::Data::Vertex &v = data.vertices[j];
                             v.pos.x      = stream.readBE16();
@@ -4087,8 +4150,8 @@ namespace TR {
                         }
 
                         data.fCount  = stream.readBE16();
-                        data.faces   = new Face[data.fCount];
-                        data.sprites = new Room::Data::Sprite[data.fCount];
+                        data.faces   = arena.alloc<Face>(data.fCount);
+                        data.sprites = arena.alloc<Room::Data::Sprite>(data.fCount);
 
                         enum {
                             TYPE_R_TRANSP    = 33,
@@ -4174,7 +4237,7 @@ namespace TR {
                         ASSERT(room && room->sectors == NULL);
 
                         room->portalsCount = stream.readBE32();
-                        room->portals = new Room::Portal[room->portalsCount];
+                        room->portals = arena.alloc<Room::Portal>(room->portalsCount);
 
                         for (int j = 0; j < room->portalsCount; j++) {
                             Room::Portal &p = room->portals[j];
@@ -4202,7 +4265,7 @@ namespace TR {
                         int32 count = stream.readBE32();
                         ASSERT(count == room->xSectors * room->zSectors);
 
-                        room->sectors = count ? new Room::Sector[count] : NULL;
+                        room->sectors = count ? arena.alloc<Room::Sector>(count) : NULL;
 
                         for (int i = 0; i < count; i++) {
                             Room::Sector &s = room->sectors[i];
@@ -4246,7 +4309,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000014);
                         ASSERT(room && room->lights == NULL);
                         room->lightsCount = stream.readBE32();
-                        room->lights = room->lightsCount ? new Room::Light[room->lightsCount] : NULL;
+                        room->lights = room->lightsCount ? arena.alloc<Room::Light>(room->lightsCount) : NULL;
                         for (int i = 0; i < room->lightsCount; i++) {
                             Room::Light &light = room->lights[i];
                             light.x = stream.readBE32();
@@ -4799,10 +4862,17 @@ namespace TR {
 
             initRoomMeshes();
             initAnimTex();
+            initAnimRots();
             initExtra();
             initCutscene();
             initTextureTypes();
 
+            if (!detached) // the globals are shared with the level in use, set on the move
+                initTextureGlobals();
+        }
+
+        // textures of the face and sprite sort (MeshBuilder)
+        void initTextureGlobals() {
             gObjectTextures      = objectTextures;
             gSpriteTextures      = spriteTextures;
             gObjectTexturesCount = objectTexturesCount;
@@ -4827,6 +4897,15 @@ namespace TR {
             }
         }
 
+        // TR2-3 PC samples are in the separate MAIN.SFX file
+        void requestSamples() {
+            if (detached) {
+                sfxPending = true;
+                return;
+            }
+            new Stream(getGameSoundsFile(version), sfxLoadAsync, this);
+        }
+
         static void sfxLoadAsync(Stream *stream, void *userData) {
             if (!stream) {
                 LOG("! can't load MAIN.SFX\n");
@@ -5161,12 +5240,12 @@ namespace TR {
                 stream.setPos(startOffset + d.size * 2);
 
                 d.fCount   = d.rCount + d.tCount;
-                d.faces    = d.fCount ? new Face[d.fCount] : NULL;
-                d.vertices = d.vCount ? new Room::Data::Vertex[d.vCount] : NULL;
+                d.faces    = d.fCount ? arena.alloc<Face>(d.fCount) : NULL;
+                d.vertices = d.vCount ? arena.alloc<Room::Data::Vertex>(d.vCount) : NULL;
 
                 d.vCount = d.fCount = 0;
             } else {
-                d.vertices = stream.read(d.vCount) ? new Room::Data::Vertex[d.vCount] : NULL;
+                d.vertices = stream.read(d.vCount) ? arena.alloc<Room::Data::Vertex>(d.vCount) : NULL;
             }
 
             if (version == VER_TR3_PSX) {
@@ -5328,7 +5407,7 @@ namespace TR {
                 stream.setPos(tmp);
 
                 d.fCount = d.rCount + d.tCount;
-                d.faces  = d.fCount ? new Face[d.fCount] : NULL;
+                d.faces  = d.fCount ? arena.alloc<Face>(d.fCount) : NULL;
 
                 int idx = 0;
 
@@ -5393,7 +5472,7 @@ namespace TR {
                 d.sprites = NULL;
                 d.sCount  = 0;
             } else {
-                stream.read(d.sprites, stream.read(d.sCount));
+                stream.read(d.sprites, stream.read(d.sCount), arena);
             }
 
             if (version == VER_TR3_PSX && partsCount != 0) {
@@ -5404,7 +5483,7 @@ namespace TR {
             stream.setPos(startOffset + d.size * 2);
 
         // portals
-            stream.read(r.portals, stream.read(r.portalsCount));
+            stream.read(r.portals, stream.read(r.portalsCount), arena);
 
             if (version == VER_TR2_PSX || version == VER_TR3_PSX) {
                 for (int i = 0; i < r.portalsCount; i++) {
@@ -5418,7 +5497,7 @@ namespace TR {
         // sectors
             stream.read(r.zSectors);
             stream.read(r.xSectors);
-            r.sectors = (r.zSectors * r.xSectors > 0) ? new Room::Sector[r.zSectors * r.xSectors] : NULL;
+            r.sectors = (r.zSectors * r.xSectors > 0) ? arena.alloc<Room::Sector>(r.zSectors * r.xSectors) : NULL;
 
             for (int i = 0; i < r.zSectors * r.xSectors; i++) {
                 Room::Sector &s = r.sectors[i];
@@ -5456,7 +5535,7 @@ namespace TR {
             }
 
         // lights
-            r.lights = stream.read(r.lightsCount) ? new Room::Light[r.lightsCount] : NULL;
+            r.lights = stream.read(r.lightsCount) ? arena.alloc<Room::Light>(r.lightsCount) : NULL;
             for (int i = 0; i < r.lightsCount; i++) {
                 Room::Light &light = r.lights[i];
                 stream.read(light.x);
@@ -5517,7 +5596,7 @@ namespace TR {
             }
         // meshes
             stream.read(r.meshesCount);
-            r.meshes = r.meshesCount ? new Room::Mesh[r.meshesCount] : NULL;
+            r.meshes = r.meshesCount ? arena.alloc<Room::Mesh>(r.meshesCount) : NULL;
             for (int i = 0; i < r.meshesCount; i++) {
                 Room::Mesh &m = r.meshes[i];
                 stream.read(m.x);
@@ -5613,7 +5692,7 @@ namespace TR {
 
             switch (version) {
                 case VER_TR1_SAT : {
-                    mesh.vertices = new Mesh::Vertex[mesh.vCount];
+                    mesh.vertices = arena.alloc<Mesh::Vertex>(mesh.vCount);
                     for (int i = 0; i < mesh.vCount; i++) {
                         short4 &c = mesh.vertices[i].coord;
                         c.x = stream.readBE16();
@@ -5638,7 +5717,7 @@ namespace TR {
                     }
 
                     mesh.fCount = stream.readBE16();
-                    mesh.faces = new Face[mesh.fCount];
+                    mesh.faces = arena.alloc<Face>(mesh.fCount);
                     mesh.tCount = mesh.rCount = 0;
 
                     enum {
@@ -5769,7 +5848,7 @@ namespace TR {
                 case VER_TR3_PC : 
                 case VER_TR4_PC :
                 case VER_TR5_PC : {
-                    mesh.vertices = new Mesh::Vertex[mesh.vCount];
+                    mesh.vertices = arena.alloc<Mesh::Vertex>(mesh.vCount);
                     for (int i = 0; i < mesh.vCount; i++) {
                         short4 &c = mesh.vertices[i].coord;
                         stream.read(c.x);
@@ -5815,7 +5894,7 @@ namespace TR {
                     mesh.rCount = rCount + crCount;
                     mesh.tCount = tCount + ctCount;
                     mesh.fCount = mesh.rCount + mesh.tCount;
-                    mesh.faces  = mesh.fCount ? new Face[mesh.fCount] : NULL;
+                    mesh.faces  = mesh.fCount ? arena.alloc<Face>(mesh.fCount) : NULL;
 
                     int idx = 0;
                     stream.seek(sizeof(rCount));  for (int i = 0; i < rCount; i++)  readFace(stream, mesh.faces[idx++], false, false, false);
@@ -5840,7 +5919,7 @@ namespace TR {
                 case VER_TR2_PSX : {
                     int nCount = mesh.vCount;
                     mesh.vCount = abs(mesh.vCount);
-                    mesh.vertices = new Mesh::Vertex[mesh.vCount];
+                    mesh.vertices = arena.alloc<Mesh::Vertex>(mesh.vCount);
 
                     for (int i = 0; i < mesh.vCount; i++)
                         stream.read(mesh.vertices[i].coord);
@@ -5872,7 +5951,7 @@ namespace TR {
                     stream.setPos(tmp);
 
                     mesh.fCount = mesh.rCount + mesh.tCount;
-                    mesh.faces  = mesh.fCount ? new Face[mesh.fCount] : NULL;
+                    mesh.faces  = mesh.fCount ? arena.alloc<Face>(mesh.fCount) : NULL;
 
                     int idx = 0;
                     stream.seek(sizeof(mesh.rCount)); for (int i = 0; i < mesh.rCount; i++) readFace(stream, mesh.faces[idx++], false, false, false);
@@ -5909,7 +5988,7 @@ namespace TR {
                         break;
                     }
 
-                    mesh.vertices = new Mesh::Vertex[mesh.vCount];
+                    mesh.vertices = arena.alloc<Mesh::Vertex>(mesh.vCount);
 
                     for (int i = 0; i < mesh.vCount; i++)
                         stream.read(mesh.vertices[i].coord);
@@ -5930,7 +6009,7 @@ namespace TR {
                         stream.read(mesh.rCount);
                     }
                     mesh.fCount = mesh.rCount + mesh.tCount;
-                    mesh.faces  = mesh.fCount ? new Face[mesh.fCount] : NULL;
+                    mesh.faces  = mesh.fCount ? arena.alloc<Face>(mesh.fCount) : NULL;
 
                 // read triangles
                     int idx = 0;
@@ -6273,8 +6352,7 @@ namespace TR {
                         i++;
 
                 if (!data.sCount && data.sprites) {
-                    delete[] data.sprites;
-                    data.sprites = NULL;
+                    data.sprites = NULL; // stays in the arena until level unload
                 }
             }
         }
@@ -6341,6 +6419,94 @@ namespace TR {
             }
         }
 
+        // transcode animation frames to fixed-stride joint quaternions
+        // TR2+ angles are packed with the variable length and can't be indexed directly
+        void initAnimRots() {
+            animRotsStart = arena.alloc<int32>(animsCount);
+            animRotsCount = arena.alloc<uint8>(animsCount);
+
+        // get joints count for animations of every model
+            for (int i = 0; i < animsCount; i++)
+                animRotsStart[i] = -1;
+
+            for (int i = 0; i < modelsCount; i++) {
+                Model &model = models[i];
+                if (model.animation >= animsCount || !model.mCount) continue;
+
+                int animEnd = animsCount;
+                for (int j = 0; j < modelsCount; j++)
+                    if (models[j].animation > model.animation && models[j].animation < animEnd)
+                        animEnd = models[j].animation;
+
+                for (int j = model.animation; j < animEnd; j++) {
+                    uint8 &count = animRotsCount[j];
+                    if (count && count != model.mCount) {
+                        if (version & VER_TR1) // TR1 frame size depends on the joints count
+                            animRotsStart[j] = -2;
+                        count = max(count, uint8(model.mCount));
+                    } else
+                        count = uint8(model.mCount);
+                }
+            }
+
+        // get frames count
+            int total = 0;
+            for (int i = 0; i < animsCount; i++) {
+                Animation &anim = anims[i];
+                int count = animRotsCount[i];
+                if (!count || animRotsStart[i] == -2 || anim.frameEnd < anim.frameStart) {
+                    animRotsStart[i] = -1;
+                    continue;
+                }
+
+                int frameSize   = anim.frameSize ? anim.frameSize : (sizeof(AnimFrame) / 2 + count * 2);
+                int framesCount = (anim.frameEnd - anim.frameStart) / max((int)anim.frameRate, 1) + 1;
+
+                if (anim.frameOffset / 2 + framesCount * frameSize > uint32(frameDataSize)) {
+                    LOG("! anim %d frames out of range\n", i);
+                    continue;
+                }
+
+                animRotsStart[i] = total;
+                total += framesCount * count;
+            }
+
+        // decode
+            animRots = arena.alloc<AnimRot>(total);
+
+            vec3 angles[256];
+            for (int i = 0; i < animsCount; i++) {
+                if (animRotsStart[i] == -1) continue;
+
+                Animation &anim = anims[i];
+                int count       = animRotsCount[i];
+                int frameSize   = anim.frameSize ? anim.frameSize : (sizeof(AnimFrame) / 2 + count * 2);
+                int framesCount = (anim.frameEnd - anim.frameStart) / max((int)anim.frameRate, 1) + 1;
+
+                AnimRot *rot = animRots + animRotsStart[i];
+                for (int j = 0; j < framesCount; j++) {
+                    AnimFrame *frame = (AnimFrame*)&frameData[anim.frameOffset / 2 + j * frameSize];
+                    frame->getAngles(version, count, angles);
+                    for (int k = 0; k < count; k++)
+                        *rot++ = AnimRot(rotYXZ(angles[k]));
+                }
+            }
+
+            LOG("anim rotations: %d KB\n", int(total * sizeof(AnimRot) / 1024));
+        }
+
+        AnimRot* getAnimRots(int animIndex, int frameIndex) {
+            int32 start = animRotsStart[animIndex];
+            if (start == -1)
+                return NULL;
+
+            Animation &anim = anims[animIndex];
+            if (frameIndex < 0 || frameIndex > (anim.frameEnd - anim.frameStart) / max((int)anim.frameRate, 1))
+                return NULL;
+
+            return animRots + start + frameIndex * animRotsCount[animIndex];
+        }
+
         void initAnimTex() {
             for (int i = 0; i < animTexturesCount; i++) {
                 uint8 transp = 0;
@@ -11,10 +11,104 @@
 
 #define MAX_CHEAT_SEQUENCE 8
 
+// the expected next level file is read by the I/O thread and parsed by a pool worker during gameplay,
+// the level transition takes over the parsed data (the file content is handed over as a memory stream
+// for the case the parsing isn't done in time or the stream is loaded another way)
+#ifndef LEVEL_PREFETCH_BUDGET
+    #define LEVEL_PREFETCH_BUDGET (32 * 1024 * 1024)
+#endif
+
+ENGINE_TLS struct LevelPrefetch {
+    char                    name[64];
+    char                    *data;
+    int                     size;
+    TR::Level               *level;
+    Core::WorkerPool::Group group;
+    Core::WorkerPool::Job   job;
+} levelPrefetch;
+
+void prefetchFree() {
+    Core::pool.wait(levelPrefetch.group, levelPrefetch.group.submitted);
+    delete levelPrefetch.level;
+    delete[] levelPrefetch.data;
+    levelPrefetch.name[0] = 0;
+    levelPrefetch.data    = NULL;
+    levelPrefetch.size    = 0;
+    levelPrefetch.level   = NULL;
+    levelPrefetch.group   = Core::WorkerPool::Group();
+}
+
+#ifdef OS_IO_THREAD
+// the detached level has no side effects on the engine state, the MAIN.SFX request and the texture globals wait for the move
+void taskParseLevel(void *userData) {
+    PROFILE_ZONE("PREFETCH_PARSE");
+    LevelPrefetch *prefetch = (LevelPrefetch*)userData;
+    Stream stream(prefetch->name, prefetch->data, prefetch->size);
+    prefetch->level = new TR::Level(stream, NULL, true);
+    if (prefetch->level->version == TR::VER_UNKNOWN) {
+        delete prefetch->level;
+        prefetch->level = NULL;
+    }
+}
+
+void prefetchLevelAsync(Stream *stream, void *userData) {
+    if (!stream) return;
+
+    if (!levelPrefetch.data && !strcmp(stream->name, levelPrefetch.name)) { // ignore outdated requests
+        if (stream->size <= LEVEL_PREFETCH_BUDGET) {
+            levelPrefetch.data = new char[stream->size];
+            levelPrefetch.size = stream->size;
+            memcpy(levelPrefetch.data, stream->data, stream->size);
+            LOG("prefetch: %s (%d KB)\n", levelPrefetch.name, levelPrefetch.size / 1024);
+            Core::pool.submit(levelPrefetch.group, levelPrefetch.job, taskParseLevel, &levelPrefetch);
+        } else {
+            LOG("prefetch: %s is over the budget\n", levelPrefetch.name);
+        }
+    }
+
+    delete stream;
+}
+#endif
+
+void prefetchLevel(TR::Version version, TR::LevelID id) {
+    prefetchFree();
+#ifdef OS_IO_THREAD
+    if (id >= TR::LVL_MAX || TR::isTitleLevel(id))
+        return;
+
+    TR::getGameLevelFile(levelPrefetch.name, version, id);
+
+    char path[255];
+    Stream *stream = new Stream(levelPrefetch.name, NULL, 0, prefetchLevelAsync);
+    stream->getFilePath(path);
+    osIORequest(stream, IO_READ, path);
+#endif
+}
+
+// the data stays valid until the next prefetch
+Stream* getPrefetchedLevel(const char *name) {
+    if (!levelPrefetch.data || strcmp(levelPrefetch.name, name))
+        return NULL;
+    return new Stream(levelPrefetch.name, levelPrefetch.data, levelPrefetch.size);
+}
+
+// the parsed level of the prefetched file, waits for the parsing if it's still in progress
+// (for any other file too, so no parsing runs along with the level load)
+TR::Level* takePrefetchedLevel(const char *name) {
+    if (!levelPrefetch.group.submitted)
+        return NULL;
+    Core::pool.wait(levelPrefetch.group, levelPrefetch.group.submitted);
+    if (!name || strcmp(levelPrefetch.name, name))
+        return NULL;
+    TR::Level *level = levelPrefetch.level;
+    levelPrefetch.level = NULL;
+    return level;
+}
+
 namespace Game {
-    Level      *level;
-    Stream     *nextLevel;
-    ControlKey cheatSeq[MAX_PLAYERS][MAX_CHEAT_SEQUENCE];
+    ENGINE_TLS Level      *level;
+    ENGINE_TLS Stream     *nextLevel;
+    ENGINE_TLS ControlKey cheatSeq[MAX_PLAYERS][MAX_CHEAT_SEQUENCE];
 
     void cheatControl(int32 playerIndex) {
         ControlKey key = Input::lastState[playerIndex];
@@ -69,7 +163,12 @@ namespace Game {
             playVideo = !saveSlots[loadSlot].isCheckpoint();
 
         delete level;
-        level = new Level(*lvl);
+        {
+            PROFILE_ZONE("LEVEL_LOAD");
+            TR::Level *parsed = takePrefetchedLevel(lvl->name);
+            level = new Level(*lvl, parsed);
+            delete parsed;
+        }
 
         bool playLogo = level->level.isTitle() && id == TR::LVL_MAX;
         playVideo = playVideo && (id != level->level.id);
@@ -79,6 +178,9 @@ namespace Game {
 
         level->init(playLogo, playVideo);
 
+        if (!level->level.isTitle())
+            prefetchLevel(level->level.version, level->getNextLevelId());
+
         UI::game = level;
         #if !defined(INV_GAMEPAD_ONLY)
             UI::helpTipTime = 5.0f;
@@ -95,6 +197,14 @@ void loadLevelAsync(Stream *stream, void *userData) {
     Game::nextLevel = stream;
 }
 
+static void taskShaders(void *userData) {
+    shaderCache = new ShaderCache();
+}
+
+static void taskStartLevel(void *userData) {
+    Game::startLevel((Stream*)userData);
+}
+
 void loadSettings(Stream *stream, void *userData) {
     if (stream) {
         uint8 version;
@@ -118,8 +228,17 @@ void loadSettings(Stream *stream, void *userData) {
         Core::settings.detail.water    = Core::Settings::LOW;
     #endif
 
-    shaderCache = new ShaderCache();
-    Game::startLevel((Stream*)userData);
+// independent startup work: perlin volume on a cold start, shaders and the first level
+    Core::TaskGraph graph;
+    if (Core::startup.cold && !Core::perlinTex)
+        Core::addPerlinTasks(graph);
+    int shaders = graph.add("shaders", taskShaders, NULL, 0, true);
+    graph.add("level", taskStartLevel, userData, TASK_DEP(shaders), true);
+    graph.run();
+
+    Core::startup.pending = false;
+    graph.report(Core::startup.cold ? "startup (cold)" : "startup (warm)");
+    LOG("startup: %d ms since init\n", osGetTimeMS() - Core::startup.start);
 }
 
 static void readSlotAsync(Stream *stream, void *userData) {
@@ -194,6 +313,15 @@ namespace Game {
     }
 
     void deinit() {
+    #ifdef TELEMETRY_DUMP
+        if (cacheDir[0]) {
+            char name[255];
+            strcpy(name, cacheDir);
+            strcat(name, "telemetry");
+            Core::telemetry.save(name);
+        }
+    #endif
+
         freeSaveSlots();
 
         #ifdef DEBUG_RENDER
@@ -204,6 +332,7 @@ namespace Game {
         UI::deinit();
         delete shaderCache;
         Core::deinit();
+        prefetchFree();
     }
 
     void updateTick() {
@@ -269,11 +398,16 @@ namespace Game {
     }
 
     bool update() {
+    #ifdef OS_IO_THREAD
+        osIOUpdate(); // completion callbacks of the finished file requests
+    #endif
+
     // async load for settings
         if (Core::settings.version == SETTINGS_READING)
             return true;
 
         PROFILE_MARKER("UPDATE");
+        Core::Telemetry::Timing timingUpdate(Core::telemetry.current.update);
 
         if (!Core::update())
             return false;
@@ -295,10 +429,21 @@ namespace Game {
         }
     #endif
 
+    #ifdef PROFILE
+        if (Input::down[ikF11]) {
+            Profiler::dump("trace.json");
+            Input::down[ikF11] = false;
+        }
+    #endif
+
     #ifdef _DEBUG_SHADERS
         if (Input::down[ikCtrl] && Input::down[ik1]) {
             delete shaderCache;
             shaderCache = new ShaderCache();
+            #ifdef USE_ATLAS_INDEXED
+                if (level && level->atlasPalette)
+                    shaderCache->preparePalette();
+            #endif
             Input::down[ik1] = false;
         }
     #endif
@@ -328,6 +473,24 @@ namespace Game {
         return true;
     }
 
+    // fixed step without the frame timer and the debug keys (headless hosts)
+    bool simulate(float delta) {
+        if (Core::settings.version == SETTINGS_READING)
+            return true;
+
+        if (nextLevel) {
+            startLevel(nextLevel);
+            nextLevel = NULL;
+        }
+
+        if (!level || level->isEnded)
+            return !Core::isQuit;
+
+        Core::deltaTime = delta;
+        Game::updateTick();
+        return !Core::isQuit;
+    }
+
     bool frameBegin() {
         if (Core::settings.version == SETTINGS_READING) return false;
         Core::reset();
@@ -343,6 +506,7 @@ namespace Game {
 
         PROFILE_MARKER("RENDER");
         PROFILE_TIMING(Core::stats.tFrame);
+        Core::Telemetry::Timing timingRender(Core::telemetry.current.render);
 
         level->render();
         #ifdef DEBUG_RENDER
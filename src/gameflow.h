@@ -8,8 +8,8 @@
 
 namespace TR {
 
-    bool useEasyStart;
-    bool isGameEnded;
+    ENGINE_TLS bool useEasyStart;
+    ENGINE_TLS bool isGameEnded;
 
     enum {
         NO_TRACK = 0xFF,
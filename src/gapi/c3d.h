@@ -4,7 +4,7 @@
 #include <citro3d.h>
 #include "core.h"
 
-#define PROFILE_MARKER(title)
+#define PROFILE_MARKER(title) PROFILE_ZONE(title)
 #define PROFILE_LABEL(id, name, label)
 #define PROFILE_TIMING(time)
 
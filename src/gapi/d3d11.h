@@ -26,11 +26,11 @@
         }
     };
 
-    #define PROFILE_MARKER(title) Marker marker(title)
+    #define PROFILE_MARKER(title) Marker marker(title); PROFILE_ZONE(title)
     #define PROFILE_LABEL(id, child, label) Marker::setLabel(child, label)
     #define PROFILE_TIMING(time)
 #else
-    #define PROFILE_MARKER(title)
+    #define PROFILE_MARKER(title) PROFILE_ZONE(title)
     #define PROFILE_LABEL(id, child, label)
     #define PROFILE_TIMING(time)
 #endif
@@ -519,20 +519,20 @@ namespace GAPI {
             SAFE_RELEASE(ID[1]);
         }
 
-        void update(Index *indices, int iCount, ::Vertex *vertices, int vCount) {
+        void update(Index *indices, int iCount, ::Vertex *vertices, int vCount, int iStart = 0, int vStart = 0) {
             ASSERT(sizeof(GAPI::Vertex) == sizeof(::Vertex));
 
             D3D11_MAPPED_SUBRESOURCE mapped;
          
             if (indices && iCount) {
-                osContext->Map(ID[0], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-                memcpy(mapped.pData, indices, iCount * sizeof(indices[0]));
+                osContext->Map(ID[0], 0, iStart ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+                memcpy((Index*)mapped.pData + iStart, indices, iCount * sizeof(indices[0]));
                 osContext->Unmap(ID[0], 0);
             }
 
             if (vertices && vCount) {
-                osContext->Map(ID[1], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped);
-                memcpy(mapped.pData, vertices, vCount * sizeof(vertices[0]));
+                osContext->Map(ID[1], 0, vStart ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD, 0, &mapped);
+                memcpy((::Vertex*)mapped.pData + vStart, vertices, vCount * sizeof(vertices[0]));
                 osContext->Unmap(ID[1], 0);
             }
         }
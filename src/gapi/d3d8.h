@@ -3,7 +3,7 @@
 
 #include "core.h"
 
-#define PROFILE_MARKER(title)
+#define PROFILE_MARKER(title) PROFILE_ZONE(title)
 #define PROFILE_LABEL(id, name, label)
 #define PROFILE_TIMING(time)
 
@@ -467,7 +467,7 @@ namespace GAPI {
             VB->Release();
         }
 
-        void update(Index *indices, int iCount, ::Vertex *vertices, int vCount) {
+        void update(Index *indices, int iCount, ::Vertex *vertices, int vCount, int iStart = 0, int vStart = 0) {
             ASSERT(sizeof(GAPI::Vertex) == sizeof(::Vertex));
 
             void* ptr;
@@ -475,14 +475,14 @@ namespace GAPI {
 
             if (indices && iCount) {
                 size = iCount * sizeof(indices[0]);
-                D3DCHECK(IB->Lock(0, 0, (BYTE**)&ptr, 0));
+                D3DCHECK(IB->Lock(iStart * sizeof(indices[0]), size, (BYTE**)&ptr, 0));
                 memcpy(ptr, indices, size);
                 D3DCHECK(IB->Unlock());
             }
 
             if (vertices && vCount) {
                 size = vCount * sizeof(vertices[0]);
-                D3DCHECK(VB->Lock(0, 0, (BYTE**)&ptr, 0));
+                D3DCHECK(VB->Lock(vStart * sizeof(vertices[0]), size, (BYTE**)&ptr, 0));
                 memcpy(ptr, vertices, size);
                 D3DCHECK(VB->Unlock());
             }
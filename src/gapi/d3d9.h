@@ -4,7 +4,7 @@
 #include "core.h"
 #include <d3d9.h>
 
-#define PROFILE_MARKER(title)
+#define PROFILE_MARKER(title) PROFILE_ZONE(title)
 #define PROFILE_LABEL(id, name, label)
 #define PROFILE_TIMING(time)
 
@@ -415,7 +415,7 @@ namespace GAPI {
             VB->Release();
         }
 
-        void update(Index *indices, int iCount, ::Vertex *vertices, int vCount) {
+        void update(Index *indices, int iCount, ::Vertex *vertices, int vCount, int iStart = 0, int vStart = 0) {
             ASSERT(sizeof(GAPI::Vertex) == sizeof(::Vertex));
 
             void* ptr;
@@ -423,14 +423,14 @@ namespace GAPI {
 
             if (indices && iCount) {
                 size = iCount * sizeof(indices[0]);
-                D3DCHECK(IB->Lock(0, 0, &ptr, dynamic ? D3DLOCK_DISCARD : 0));
+                D3DCHECK(IB->Lock(iStart * sizeof(indices[0]), size, &ptr, dynamic ? (iStart ? D3DLOCK_NOOVERWRITE : D3DLOCK_DISCARD) : 0));
                 memcpy(ptr, indices, size);
                 D3DCHECK(IB->Unlock());
             }
 
             if (vertices && vCount) {
                 size = vCount * sizeof(vertices[0]);
-                D3DCHECK(VB->Lock(0, 0, &ptr, dynamic ? D3DLOCK_DISCARD: 0));
+                D3DCHECK(VB->Lock(vStart * sizeof(vertices[0]), size, &ptr, dynamic ? (vStart ? D3DLOCK_NOOVERWRITE : D3DLOCK_DISCARD) : 0));
                 memcpy(ptr, vertices, size);
                 D3DCHECK(VB->Unlock());
             }
@@ -472,7 +472,7 @@
         }
     };
 
-    #define PROFILE_MARKER(title)               Marker marker(title)
+    #define PROFILE_MARKER(title)               Marker marker(title); PROFILE_ZONE(title)
     #define PROFILE_LABEL(id, name, label)      Marker::setLabel(GL_##id, name, label)
     #define PROFILE_TIMING(result)              Timing timing(result)
 #else
@@ -1058,7 +1058,7 @@ namespace GAPI {
             }
         }
 
-        void update(Index *indices, int iCount, ::Vertex *vertices, int vCount) {
+        void update(Index *indices, int iCount, ::Vertex *vertices, int vCount, int iStart = 0, int vStart = 0) {
             ASSERT(sizeof(GAPI::Vertex) == sizeof(::Vertex));
 
             if (Core::support.VAO && Core::active.VAO != 0)
@@ -1066,18 +1066,18 @@ namespace GAPI {
 
             if (indices && iCount) {
                 if (iBuffer) {
-                    memcpy(iBuffer, indices, iCount * sizeof(Index));
+                    memcpy(iBuffer + iStart, indices, iCount * sizeof(Index));
                 } else {
                     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Core::active.iBuffer = ID[0]);
-                    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, iCount * sizeof(Index), indices);
+                    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, iStart * sizeof(Index), iCount * sizeof(Index), indices);
                 }
             }
             if (vertices && vCount) {
                 if (vBuffer) {
-                    memcpy(vBuffer, vertices, vCount * sizeof(GAPI::Vertex));
+                    memcpy(vBuffer + vStart, vertices, vCount * sizeof(GAPI::Vertex));
                 } else {
                     glBindBuffer(GL_ARRAY_BUFFER, Core::active.vBuffer = ID[1]);
-                    glBufferSubData(GL_ARRAY_BUFFER, 0, vCount * sizeof(GAPI::Vertex), vertices);
+                    glBufferSubData(GL_ARRAY_BUFFER, vStart * sizeof(GAPI::Vertex), vCount * sizeof(GAPI::Vertex), vertices);
                 }
             }
         }
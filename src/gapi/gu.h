@@ -6,7 +6,7 @@
 #include <pspgu.h>
 #include <pspgum.h>
 
-#define PROFILE_MARKER(title)
+#define PROFILE_MARKER(title) PROFILE_ZONE(title)
 #define PROFILE_LABEL(id, name, label)
 #define PROFILE_TIMING(time)
 
@@ -7,7 +7,7 @@
 #include <psp2/gxm.h>
 #include <psp2/gxt.h>
 
-#define PROFILE_MARKER(title)
+#define PROFILE_MARKER(title) PROFILE_ZONE(title)
 #define PROFILE_LABEL(id, name, label)
 #define PROFILE_TIMING(time)
 
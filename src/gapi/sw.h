@@ -3,7 +3,7 @@
 
 #include "core.h"
 
-#define PROFILE_MARKER(title)
+#define PROFILE_MARKER(title) PROFILE_ZONE(title)
 #define PROFILE_LABEL(id, name, label)
 #define PROFILE_TIMING(time)
 
@@ -42,20 +42,20 @@ namespace GAPI {
     #endif
     typedef uint16 DepthSW;
 
-    uint8   *swLightmap;
-    uint8   swLightmapNone[32 * 256];
-    uint8   swLightmapShade[32 * 256];
-    ColorSW *swPalette;
-    ColorSW swPaletteColor[256];
-    ColorSW swPaletteWater[256];
-    ColorSW swPaletteGray[256];
-    uint8   swGradient[256];
-    Tile8   *curTile;
+    ENGINE_TLS uint8   *swLightmap;
+    ENGINE_TLS uint8   swLightmapNone[32 * 256];
+    ENGINE_TLS uint8   swLightmapShade[32 * 256];
+    ENGINE_TLS ColorSW *swPalette;
+    ENGINE_TLS ColorSW swPaletteColor[256];
+    ENGINE_TLS ColorSW swPaletteWater[256];
+    ENGINE_TLS ColorSW swPaletteGray[256];
+    ENGINE_TLS uint8   swGradient[256];
+    ENGINE_TLS Tile8   *curTile;
 
-    uint8 ambient;
-    int32 lightsCount;
+    ENGINE_TLS uint8 ambient;
+    ENGINE_TLS int32 lightsCount;
 
-    struct LightSW {
+    ENGINE_TLS struct LightSW {
         uint32 intensity;
         vec3   pos;
         float  radius;
@@ -151,13 +151,13 @@ namespace GAPI {
             delete[] vBuffer;
         }
 
-        void update(Index *indices, int iCount, ::Vertex *vertices, int vCount) {
+        void update(Index *indices, int iCount, ::Vertex *vertices, int vCount, int iStart = 0, int vStart = 0) {
             if (indices) {
-                memcpy(iBuffer, indices, iCount * sizeof(indices[0]));
+                memcpy(iBuffer + iStart, indices, iCount * sizeof(indices[0]));
             }
 
             if (vertices) {
-                memcpy(vBuffer, vertices, vCount * sizeof(vertices[0]));
+                memcpy(vBuffer + vStart, vertices, vCount * sizeof(vertices[0]));
             }
         }
 
@@ -169,11 +169,11 @@ namespace GAPI {
     };
 
 
-    int cullMode, blendMode;
+    ENGINE_TLS int cullMode, blendMode;
 
-    ColorSW *swColor;
-    DepthSW *swDepth;
-    short4  swClipRect;
+    ENGINE_TLS ColorSW *swColor;
+    ENGINE_TLS DepthSW *swDepth;
+    ENGINE_TLS short4  swClipRect;
 
     struct VertexSW {
         int32 x, y, z, w;
@@ -228,10 +228,10 @@ namespace GAPI {
         }
     };
 
-    Array<VertexSW> swVertices;
-    Array<Index>    swIndices;
-    Array<int32>    swTriangles;
-    Array<int32>    swQuads;
+    ENGINE_TLS Array<VertexSW> swVertices;
+    ENGINE_TLS Array<Index>    swIndices;
+    ENGINE_TLS Array<int32>    swTriangles;
+    ENGINE_TLS Array<int32>    swQuads;
 
     void init() {
         LOG("Renderer : %s\n", "Software");
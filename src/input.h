@@ -11,32 +11,32 @@
 #define INPUT_JOY_DZ_TRIGGER   0.01f
 
 namespace Input {
-    InputKey lastKey;
-    bool down[ikMAX];
-    bool state[MAX_PLAYERS][cMAX];
-    ControlKey lastState[MAX_PLAYERS];
+    ENGINE_TLS InputKey lastKey;
+    ENGINE_TLS bool down[ikMAX];
+    ENGINE_TLS bool state[MAX_PLAYERS][cMAX];
+    ENGINE_TLS ControlKey lastState[MAX_PLAYERS];
 
-    struct Mouse {
+    ENGINE_TLS struct Mouse {
         vec2 pos;
         struct {
             vec2 L, R, M;
         } start;
     } mouse;
 
-    struct Joystick {
+    ENGINE_TLS struct Joystick {
         vec2   L, R;
         float  LT, RT;
         JoyKey lastKey;
         bool   down[jkMAX];
     } joy[INPUT_JOY_COUNT];
 
-    struct Touch {
+    ENGINE_TLS struct Touch {
         int  id;
         vec2 start;
         vec2 pos;
     } touch[6];
 
-    struct HMD {
+    ENGINE_TLS struct HMD {
         mat4 head;
         mat4 eye[2];
         mat4 proj[2];
@@ -63,14 +63,14 @@ namespace Input {
     enum TouchButton { bMove, bWeapon, bWalk, bAction, bJump, bInventory, bMAX };
     enum TouchZone   { zMove, zLook, zButton, zMAX };
 
-    float       touchTimerVis, touchTimerTap;
-    InputKey    touchKey[zMAX];
+    ENGINE_TLS float       touchTimerVis, touchTimerTap;
+    ENGINE_TLS InputKey    touchKey[zMAX];
 
-    TouchButton btn;
-    vec2        btnPos[bMAX];
-    bool        btnEnable[bMAX];
-    float       btnRadius;
-    bool        doubleTap;
+    ENGINE_TLS TouchButton btn;
+    ENGINE_TLS vec2        btnPos[bMAX];
+    ENGINE_TLS bool        btnEnable[bMAX];
+    ENGINE_TLS float       btnRadius;
+    ENGINE_TLS bool        doubleTap;
 
     void setDown(InputKey key, bool value, int index = 0) {
         if (down[key] == value)
@@ -24,7 +24,7 @@
 #define TITLE_LOADING         64.0f
 #define LINE_HEIGHT           20.0f
 
-static const struct OptionItem *waitForKey = NULL;
+static ENGINE_TLS const struct OptionItem *waitForKey = NULL;
 
 struct OptionItem {
     enum Type {
@@ -207,7 +207,7 @@ static const OptionItem optControls[] = {
     OptionItem( OptionItem::TYPE_KEY,    STR_CTRL_FIRST + cStart     , SETTINGS( controls[0].keys[ cStart     ] ), STR_KEY_FIRST ),
 };
 
-static OptionItem optControlsPlayer[COUNT(optControls)];
+static ENGINE_TLS OptionItem optControlsPlayer[COUNT(optControls)];
 
 struct Inventory {
 
@@ -609,6 +609,7 @@ struct Inventory {
     }
 
     ~Inventory() {
+        Stream::cancel(this); // video and title requests
         delete video;
         clear();
     }
@@ -2100,7 +2101,7 @@ struct Inventory {
     }
 };
 
-Inventory *inventory;
+ENGINE_TLS Inventory *inventory;
 
 #undef SETTINGS
 #undef LINE_HEIGHT
@@ -327,7 +327,7 @@ const char *helpText =
 #include "lang/hu.h"
 #include "lang/sv.h"
 
-char **STR = NULL;
+ENGINE_TLS char **STR = NULL;
 
 void ensureLanguage(int lang) {
     ASSERT(COUNT(STR_EN) == STR_MAX);
@@ -1097,10 +1097,10 @@ struct Lara : Character {
                 ((Character*)arm->target)->hit(wpnGetDamage(), this);
                 hit -= d * 64.0f;
                 if (type != TR::Entity::SCION_TARGET)
-                    game->addEntity(TR::Entity::BLOOD, room, hit);
+                    game->addParticle(TR::Entity::BLOOD, room, hit);
             } else {
                 hit -= d * 64.0f;
-                game->addEntity(TR::Entity::RICOCHET, room, hit);
+                game->addParticle(TR::Entity::RICOCHET, room, hit);
 
                 float dist = (hit - p).length();
                 if (dist < nearDist) {
@@ -1579,7 +1579,7 @@ struct Lara : Character {
         game->playSound(TR::SND_BUBBLE, pos, Sound::PAN);
         vec3 head = getJoint(jointHead) * vec3(0.0f, 0.0f, 50.0f);
         for (int i = 0; i < count; i++)
-            game->addEntity(TR::Entity::BUBBLE, getRoomIndex(), head, 0);
+            game->addParticle(TR::Entity::BUBBLE, getRoomIndex(), head);
     }
 
     virtual void cmdEffect(int fx) {
@@ -2274,7 +2274,7 @@ struct Lara : Character {
 
     void waterSplash() {
         if (level->extra.waterSplash > -1)
-            game->addEntity(TR::Entity::WATER_SPLASH, getRoomIndex(), vec3(pos.x, waterLevel, pos.z));
+            game->addParticle(TR::Entity::WATER_SPLASH, getRoomIndex(), vec3(pos.x, waterLevel, pos.z));
         specular = LARA_WET_SPECULAR;
     }
 
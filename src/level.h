@@ -9,6 +9,8 @@
 #include "camera.h"
 #include "lara.h"
 #include "objects.h"
+#include "particles.h"
+#include "deferred.h"
 #include "inventory.h"
 #include "savegame.h"
 #include "network.h"
@@ -26,10 +28,11 @@
 #define SKY_TIME_PERIOD   (1.0f / 0.005f)
 
 extern void loadLevelAsync(Stream *stream, void *userData);
+extern Stream* getPrefetchedLevel(const char *name);
 
-extern Array<SaveSlot> saveSlots;
-extern SaveResult saveResult;
-extern int loadSlot;
+extern ENGINE_TLS Array<SaveSlot> saveSlots;
+extern ENGINE_TLS SaveResult saveResult;
+extern ENGINE_TLS int loadSlot;
 
 struct Level : IGame {
 
@@ -38,6 +41,7 @@ struct Level : IGame {
     Texture     *atlasObjects;
     Texture     *atlasSprites;
     Texture     *atlasGlyphs;
+    Texture     *atlasPalette; // 256x1 colors of the indexed atlases (USE_ATLAS_INDEXED), NULL for RGBA ones
     MeshBuilder *mesh;
 
     Lara        *players[2], *player;
@@ -55,6 +59,12 @@ struct Level : IGame {
     AmbientCache *ambientCache;
     WaterCache   *waterCache;
 
+    ParticleSystem particles;
+
+    Array<Controller*> parallelControllers;
+    DeferredGame       deferred[JOB_THREADS];
+    Array<DeferredGame::Command> deferredCommands;
+
     Sound::Sample *sndTrack, *sndWater;
     bool waitTrack;
 
@@ -99,7 +109,7 @@ struct Level : IGame {
     //        id = TR::LVL_TR1_TITLE;
     //    else
     //#endif
-        id = (level.isEnd() || level.isHome()) ? level.getTitleId() : TR::LevelID(level.id + 1);
+        id = getNextLevelId();
 
         TR::isGameEnded = level.isEnd();
 
@@ -117,6 +127,10 @@ struct Level : IGame {
         loadLevel(id);
     }
 
+    TR::LevelID getNextLevelId() {
+        return (level.isEnd() || level.isHome()) ? level.getTitleId() : TR::LevelID(level.id + 1);
+    }
+
     virtual void invShow(int playerIndex, int page, int itemIndex = -1) {
         if (itemIndex != -1 || page == Inventory::PAGE_SAVEGAME)
             inventory->pageItemIndex[page] = itemIndex;
@@ -339,6 +353,7 @@ struct Level : IGame {
 
     void clearEntities() {
         Controller::first = NULL;
+        particles.count = 0;
         for (int i = 0; i < level.entitiesCount; i++) {
             TR::Entity &e = level.entities[i];
             Controller *controller = (Controller*)e.controller;
@@ -405,12 +420,17 @@ struct Level : IGame {
         #if !defined(_GAPI_D3D8) && !defined(_GAPI_D3D9) && !defined(_GAPI_D3D11) && !defined(_GAPI_GXM)
             delete shaderCache;
             shaderCache = new ShaderCache();
+            #ifdef USE_ATLAS_INDEXED
+                if (atlasPalette)
+                    shaderCache->preparePalette();
+            #endif
         #endif
         }
 
         if (rebuildMesh) {
             delete mesh;
-            mesh = new MeshBuilder(&level, atlasRooms);
+            mesh = new MeshBuilder(&level);
+            mesh->upload(atlasRooms);
         }
 
         if (rebuildAmbient) {
@@ -514,7 +534,7 @@ struct Level : IGame {
     }
 
     virtual void setShader(Core::Pass pass, Shader::Type type, bool underwater = false, bool alphaTest = false) {
-        shaderCache->bind(pass, type, (underwater ? ShaderCache::FX_UNDERWATER : 0) | (alphaTest ? ShaderCache::FX_ALPHA_TEST : 0));
+        shaderCache->bind(pass, type, (underwater ? ShaderCache::FX_UNDERWATER : 0) | (alphaTest ? ShaderCache::FX_ALPHA_TEST : 0) | (atlasPalette ? ShaderCache::FX_PALETTE : 0));
     }
 
     virtual void setRoomParams(int roomIndex, Shader::Type type, float diffuse, float ambient, float specular, float alpha, bool alphaTest = false) {
@@ -605,6 +625,7 @@ struct Level : IGame {
         Core::whiteTex->bind(sMask);
         Core::whiteTex->bind(sReflect);
         atlasRooms->bind(sDiffuse);
+        if (atlasPalette) atlasPalette->bind(sPalette);
 
         if (Core::pass != Core::passShadow) {
             Texture *shadowMap = shadow[player ? player->camera->cameraIndex : 0];
@@ -730,6 +751,14 @@ struct Level : IGame {
         }
     }
 
+    virtual void setDynamicLight(const vec3 &pos, bool enable) {
+        if (enable) {
+            Core::lightColor[1] = vec4(0.6f, 0.5f, 0.1f, 1.0f / 4096.0f);
+            Core::lightPos[1]   = pos;
+        } else
+            Core::lightColor[1] = vec4(0, 0, 0, 1);
+    }
+
     virtual void checkTrigger(Controller *controller, bool heavy) {
         players[0]->checkTrigger(controller, heavy);
     }
@@ -794,6 +823,10 @@ struct Level : IGame {
         delete controller;
     }
 
+    virtual void addParticle(TR::Entity::Type type, int room, const vec3 &pos, const vec3 &velocity) {
+        particles.emit(type, room, pos, velocity);
+    }
+
     virtual void addMuzzleFlash(Controller *owner, int joint, const vec3 &offset, int lightIndex) {
         MuzzleFlash *mf = (MuzzleFlash*)addEntity(TR::Entity::MUZZLE_FLASH, owner->getRoomIndex(), offset, 0);
         if (mf) {
@@ -936,7 +969,7 @@ struct Level : IGame {
     }
 //==============================
 
-    Level(Stream &stream) : level(stream), waitTrack(false), isEnded(false), cutsceneWaitTimer(0.0f), animTexTimer(0.0f), statsTimeDelta(0.0f) {
+    Level(Stream &stream, TR::Level *parsed = NULL) : level(stream, parsed), waitTrack(false), isEnded(false), cutsceneWaitTimer(0.0f), animTexTimer(0.0f), statsTimeDelta(0.0f) {
         paused = false;
 
         level.simpleItems = Core::settings.detail.simple == 1;
@@ -966,8 +999,9 @@ struct Level : IGame {
             saveStats.level = level.id;
         }
 
-        initTextures();
-        mesh = new MeshBuilder(&level, atlasRooms);
+        particles.init(this, &level);
+
+        initResources();
         initEntities();
 
         shadow[0] = shadow[1] = NULL;
@@ -1034,6 +1068,11 @@ struct Level : IGame {
         loadNextLevel();
     #endif
 
+    #if BENCH_JOINTS
+        Debug::Level::benchJoints(&level);
+        loadNextLevel();
+    #endif
+
     #if DUMP_PALETTE
         Debug::Level::dumpPalette(&level, level.id);
         loadNextLevel();
@@ -1051,6 +1090,8 @@ struct Level : IGame {
     }
 
     virtual ~Level() {
+        Stream::cancel(this); // save game request
+
         UI::init(NULL);
 
         Network::stop();
@@ -1058,6 +1099,9 @@ struct Level : IGame {
         for (int i = 0; i < level.entitiesCount; i++)
             delete (Controller*)level.entities[i].controller;
 
+        for (PoolStats *pool = PoolStats::first; pool; pool = pool->next)
+            LOG("pool %s: %d allocs, %d peak, %d fallbacks\n", pool->name, pool->allocs, pool->peak, pool->fallbacks);
+
         delete shadow[0];
         delete shadow[1];
         delete scaleTex;
@@ -1071,6 +1115,7 @@ struct Level : IGame {
             delete atlasSprites;
             delete atlasGlyphs;
         #endif
+        delete atlasPalette;
         delete mesh;
 
         Sound::stopAll();
@@ -1237,12 +1282,12 @@ struct Level : IGame {
             case TR::Entity::MUTANT_BULLET         :
             case TR::Entity::CENTAUR_BULLET        : return new Bullet(this, index);
             case TR::Entity::TRAP_LAVA             : return new TrapLava(this, index);
-            case TR::Entity::BUBBLE                : return new Bubble(this, index);
-            case TR::Entity::EXPLOSION             : return new Explosion(this, index);
+            case TR::Entity::EXPLOSION             :
             case TR::Entity::WATER_SPLASH          :
             case TR::Entity::BLOOD                 :
             case TR::Entity::SMOKE                 :
             case TR::Entity::SPARKLES              : return new Sprite(this, index, true, Sprite::FRAME_ANIMATED);
+            case TR::Entity::BUBBLE                :
             case TR::Entity::RICOCHET              : return new Sprite(this, index, true, Sprite::FRAME_RANDOM);
             case TR::Entity::CENTAUR_STATUE        : return new CentaurStatue(this, index);
             case TR::Entity::CABIN                 : return new Cabin(this, index);
@@ -1309,14 +1354,20 @@ struct Level : IGame {
 
             case TR::Entity::FISH_EMITTER           : return new DummyController(this, index);
 
-            default                                 : return new Controller(this, index);
+            default                                 : {
+                Controller *controller = new Controller(this, index);
+                controller->parallel = true;
+                return controller;
+            }
         }
     }
 
     #define ATLAS_PAGE_BARS   4096
     #define ATLAS_PAGE_GLYPHS 8192
 
-    AtlasTile *tileData;
+    enum { ATLAS_ROOMS, ATLAS_OBJECTS, ATLAS_SPRITES, ATLAS_GLYPHS, ATLAS_MAX };
+
+    Atlas *atlases[ATLAS_MAX]; // valid during level loading only
     uint8 *glyphsRU;
     uint8 *glyphsJA;
     uint8 *glyphsGR;
@@ -1368,6 +1419,7 @@ struct Level : IGame {
 
         Level *owner = (Level*)userData;
         TR::Level *level = &owner->level;
+        AtlasTile *tileData = (AtlasTile*)atlas->tileData;
 
         AtlasColor *src, *dst = (AtlasColor*)data;
         short4 mm;
@@ -1377,11 +1429,11 @@ struct Level : IGame {
         if (id < level->objectTexturesCount) { // textures
             TR::TextureInfo &t = level->objectTextures[id];
             mm      = t.getMinMax();
-            src     = owner->tileData->color;
+            src     = tileData->color;
             uv      = t.texCoordAtlas;
             uvCount = 4;
             if (data) {
-                level->fillObjectTexture(owner->tileData, tile.uv, tile.tex);
+                level->fillObjectTexture(tileData, tile.uv, tile.tex);
             }
         } else {
             id -= level->objectTexturesCount;
@@ -1389,13 +1441,13 @@ struct Level : IGame {
             if (id < level->spriteTexturesCount) { // sprites
                 TR::TextureInfo &t = level->spriteTextures[id];
                 mm       = t.getMinMax();
-                src      = owner->tileData->color;
+                src      = tileData->color;
                 uv       = t.texCoordAtlas;
                 uvCount  = 2;
                 isSprite = true;
                 if (data) {
                     if (id < UI::advGlyphsStart) {
-                        level->fillObjectTexture(owner->tileData, tile.uv, tile.tex);
+                        level->fillObjectTexture(tileData, tile.uv, tile.tex);
                     } else {
                         int page = getAdvGlyphPage(id);
                         int offset = ATLAS_PAGE_GLYPHS + page * 256;
@@ -1416,7 +1468,7 @@ struct Level : IGame {
                             default : ASSERT(false);
                         }
 
-                        level->fillObjectTexture32(owner->tileData, glyphsData, uv, tile.tex);
+                        level->fillObjectTexture32(tileData, glyphsData, uv, tile.tex);
                     }
                 }
             } else { // common (generated) textures
@@ -1435,7 +1487,7 @@ struct Level : IGame {
                     case CTEX_WHITE_ROOM   :
                     case CTEX_WHITE_OBJECT :
                     case CTEX_WHITE_SPRITE :
-                        src = owner->tileData->color;
+                        src = tileData->color;
                         tex = &CommonTex[id];
                         if (id != CTEX_WHITE_ROOM && id != CTEX_WHITE_OBJECT && id != CTEX_WHITE_SPRITE) {
                             mm.w = 4; // height - 1
@@ -1587,20 +1639,53 @@ struct Level : IGame {
     }
 #endif
 
-    void initTextures() {
+    static void taskGlyphs(void *userData) {
     #ifndef SPLIT_BY_TILE
+        ((Level*)userData)->initGlyphs();
+    #endif
+    }
 
-        #if defined(_GAPI_SW) || defined(_GAPI_GU)
-            #error atlas packing is not allowed for this platform
-        #endif
+    static void taskAtlas(void *userData) {
+        ((Atlas*)userData)->build();
+    }
 
-        #ifdef _DEBUG
-            //dumpGlyphs();
-            //dumpKanji();
-        #endif
+    static void taskTextures(void *userData) {
+        ((Level*)userData)->initTextures();
+    }
 
-        UI::patchGlyphs(level);
+    static void taskGeometry(void *userData) {
+        Level *owner = (Level*)userData;
+        owner->mesh = new MeshBuilder(&owner->level);
+    }
+
+    static void taskUpload(void *userData) {
+        Level *owner = (Level*)userData;
+        owner->mesh->upload(owner->atlasRooms);
+    }
+
+    void initResources() {
+        Core::TaskGraph graph;
+    #ifndef SPLIT_BY_TILE
+        initAtlases();
+        int glyphs   = graph.add("glyphs",        taskGlyphs, this);
+        int aRooms   = graph.add("atlas rooms",   taskAtlas,  atlases[ATLAS_ROOMS]);
+        int aObjects = graph.add("atlas objects", taskAtlas,  atlases[ATLAS_OBJECTS]);
+        int aSprites = graph.add("atlas sprites", taskAtlas,  atlases[ATLAS_SPRITES]);
+        int aGlyphs  = graph.add("atlas glyphs",  taskAtlas,  atlases[ATLAS_GLYPHS], TASK_DEP(glyphs));
+        uint32 tiles = TASK_DEP(aRooms) | TASK_DEP(aObjects) | TASK_DEP(aSprites);
+        int textures = graph.add("textures",      taskTextures, this, tiles | TASK_DEP(aGlyphs), true);
+        int geometry = graph.add("geometry",      taskGeometry, this, tiles); // uses atlas texture coords
+    #else
+        int textures = graph.add("textures",      taskTextures, this, 0, true);
+        int geometry = graph.add("geometry",      taskGeometry, this, TASK_DEP(textures));
+    #endif
+        graph.add("upload", taskUpload, this, TASK_DEP(textures) | TASK_DEP(geometry), true);
+        graph.run();
+        graph.report("level resources");
+    }
 
+#ifndef SPLIT_BY_TILE
+    void initGlyphs() {
         {
             uint32 glyphsW, glyphsH;
             Stream stream(NULL, GLYPH_RU, size_GLYPH_RU);
@@ -1624,13 +1709,25 @@ struct Level : IGame {
             Stream stream(NULL, GLYPH_CN, size_GLYPH_CN);
             glyphsCN = Texture::LoadBMP(stream, glyphsW, glyphsH);
         }
+    }
+
+    void initAtlases() {
+        #ifdef _DEBUG
+            //dumpGlyphs();
+            //dumpKanji();
+        #endif
+
+        UI::patchGlyphs(level);
 
     // repack texture tiles
         int maxTiles = level.objectTexturesCount + level.spriteTexturesCount + CTEX_MAX;
-        Atlas *rAtlas = new Atlas(maxTiles, short4(4, 4, 4, 4), this, fillCallback);
-        Atlas *oAtlas = new Atlas(maxTiles, short4(4, 4, 4, 4), this, fillCallback);
-        Atlas *sAtlas = new Atlas(maxTiles, short4(4, 4, 4, 4), this, fillCallback);
-        Atlas *gAtlas = new Atlas(maxTiles, short4(0, 0, 1, 1), this, fillCallback);
+        Atlas *rAtlas = atlases[ATLAS_ROOMS]   = new Atlas(maxTiles, short4(4, 4, 4, 4), this, fillCallback);
+        Atlas *oAtlas = atlases[ATLAS_OBJECTS] = new Atlas(maxTiles, short4(4, 4, 4, 4), this, fillCallback);
+        Atlas *sAtlas = atlases[ATLAS_SPRITES] = new Atlas(maxTiles, short4(4, 4, 4, 4), this, fillCallback);
+        Atlas *gAtlas = atlases[ATLAS_GLYPHS]  = new Atlas(maxTiles, short4(0, 0, 1, 1), this, fillCallback);
+
+        for (int i = 0; i < ATLAS_MAX; i++)
+            atlases[i]->tileData = new AtlasTile();
         // add textures
         for (int i = 0; i < level.objectTexturesCount; i++) {
             TR::TextureInfo &t = level.objectTextures[i];
@@ -1683,14 +1780,50 @@ struct Level : IGame {
             Atlas *dst = (i == CTEX_FLASH || i == CTEX_WHITE_OBJECT) ? oAtlas : ((i == CTEX_WHITE_ROOM) ? rAtlas : gAtlas);
             dst->add(level.objectTexturesCount + level.spriteTexturesCount + i, short4(i * 32, ATLAS_PAGE_BARS, i * 32 + CommonTexOffset[i].x, ATLAS_PAGE_BARS + CommonTexOffset[i].y), &CommonTex[i]);
         }
+    }
+#endif
+
+#ifdef USE_ATLAS_INDEXED
+    // all three atlases or none of them, the same shaders draw everything from rooms to sprites
+    void initIndexedAtlases() {
+        AtlasPalette palette;
+        if (!atlases[ATLAS_ROOMS]->toIndexed(palette)   ||
+            !atlases[ATLAS_OBJECTS]->toIndexed(palette) ||
+            !atlases[ATLAS_SPRITES]->toIndexed(palette)) {
+            LOG("! atlas: more than %d colors, use RGBA\n", COUNT(palette.colors));
+            return;
+        }
 
-        // get result texture
-        tileData = new AtlasTile();
-        
-        atlasRooms   = rAtlas->pack(OPT_MIPMAPS | OPT_VRAM_3DS);
-        atlasObjects = oAtlas->pack(OPT_MIPMAPS);
-        atlasSprites = sAtlas->pack(OPT_MIPMAPS);
-        atlasGlyphs  = gAtlas->pack(0);
+        atlasRooms   = atlases[ATLAS_ROOMS]->packIndexed();
+        atlasObjects = atlases[ATLAS_OBJECTS]->packIndexed();
+        atlasSprites = atlases[ATLAS_SPRITES]->packIndexed();
+        atlasPalette = new Texture(COUNT(palette.colors), 1, 1, FMT_RGBA, OPT_NEAREST, palette.colors);
+
+        shaderCache->preparePalette();
+
+        LOG("palette : %d colors\n", palette.count);
+    }
+#endif
+
+    void initTextures() {
+        atlasPalette = NULL;
+
+    #ifndef SPLIT_BY_TILE
+
+        #if defined(_GAPI_SW) || defined(_GAPI_GU)
+            #error atlas packing is not allowed for this platform
+        #endif
+
+        // get result texture (atlases are built by the load pipeline)
+    #ifdef USE_ATLAS_INDEXED
+        initIndexedAtlases();
+    #endif
+        if (!atlasPalette) {
+            atlasRooms   = atlases[ATLAS_ROOMS]->pack(OPT_MIPMAPS | OPT_VRAM_3DS);
+            atlasObjects = atlases[ATLAS_OBJECTS]->pack(OPT_MIPMAPS);
+            atlasSprites = atlases[ATLAS_SPRITES]->pack(OPT_MIPMAPS);
+        }
+        atlasGlyphs  = atlases[ATLAS_GLYPHS]->pack(0);
 
     #ifdef _OS_3DS
         ASSERT(atlasRooms->width   <= 1024 && atlasRooms->height   <= 1024);
@@ -1698,8 +1831,11 @@ struct Level : IGame {
         ASSERT(atlasSprites->width <= 1024 && atlasSprites->height <= 1024);
     #endif
 
-        delete[] tileData;
-        tileData = NULL;
+        for (int i = 0; i < ATLAS_MAX; i++) {
+            delete (AtlasTile*)atlases[i]->tileData;
+            delete atlases[i];
+            atlases[i] = NULL;
+        }
 
         delete[] glyphsRU;
         delete[] glyphsJA;
@@ -1716,15 +1852,18 @@ struct Level : IGame {
         atlasSprites->setFilterQuality(Core::settings.detail.filter);
         atlasGlyphs->setFilterQuality(Core::Settings::MEDIUM);
 
-        delete rAtlas;
-        delete oAtlas;
-        delete sAtlas;
-        delete gAtlas;
-
         LOG("rooms   : %d x %d\n", atlasRooms->width, atlasRooms->height);
         LOG("objects : %d x %d\n", atlasObjects->width, atlasObjects->height);
         LOG("sprites : %d x %d\n", atlasSprites->width, atlasSprites->height);
         LOG("glyphs  : %d x %d\n", atlasGlyphs->width, atlasGlyphs->height);
+
+        int texels = atlasRooms->width * atlasRooms->height + atlasObjects->width * atlasObjects->height + atlasSprites->width * atlasSprites->height;
+        int sizeRGBA = texels * int(sizeof(AtlasColor)) * 4 / 3; // + mipmaps
+        if (atlasPalette) {
+            LOG("atlases : %d KB indexed (%d KB as RGBA)\n", (texels + atlasPalette->width * 4) / 1024, sizeRGBA / 1024);
+        } else {
+            LOG("atlases : %d KB\n", sizeRGBA / 1024);
+        }
         PROFILE_LABEL(TEXTURE, atlasRooms->ID, "atlas_rooms");
         PROFILE_LABEL(TEXTURE, atlasObjects->ID, "atlas_objects");
         PROFILE_LABEL(TEXTURE, atlasSprites->ID, "atlas_sprites");
@@ -1894,6 +2033,7 @@ struct Level : IGame {
         Core::setViewProj(Core::mView, Core::mProj);
 
         setShader(Core::passSky, type, false, false);
+        if (atlasPalette) atlasPalette->bind(sPalette);
 
         if (type != Shader::DEFAULT) {
             float time = Core::params.x;
@@ -1985,6 +2125,166 @@ struct Level : IGame {
         return s;
     }
 
+    int getRoomAmbient(int roomIndex) {
+        const TR::Room &room = level.rooms[roomIndex];
+        vec3 center = room.getCenter();
+        return room.getAmbient(int(center.x), int(center.y), int(center.z));
+    }
+
+    static void setRoomStateProc(void *userData, int32 roomIndex) {
+        Level *self = (Level*)userData;
+        self->setRoomParams(roomIndex, Shader::ROOM, 1.0f, intensityf(self->getRoomAmbient(roomIndex)), 0.0f, 1.0f, false);
+    }
+
+    static void setSpriteStateProc(void *userData, int32 roomIndex) {
+        Level *self = (Level*)userData;
+        self->setRoomParams(roomIndex, Shader::SPRITE, 1.0f, 1.0f, 0.0f, 1.0f, true);
+    }
+
+    // groups rooms with equal params (no water, no dynamic lights, same ambient)
+    // into one state, the first room of the group is used to setup the state
+    struct RoomStates {
+        int32 rooms[256];
+        int   ambients[256];
+        bool  unique[256];
+        int   count;
+
+        RoomStates() : count(0) {}
+
+        int get(const TR::Room &room, int roomIndex, int ambient, int32 &state) {
+            bool isUnique = room.flags.water || room.dynLightsCount;
+
+            int index = count;
+            if (!isUnique) {
+                for (int i = 0; i < count; i++) {
+                    if (!unique[i] && ambients[i] == ambient) {
+                        index = i;
+                        break;
+                    }
+                }
+            }
+
+            if (index == count) {
+                ASSERT(count < COUNT(rooms));
+                rooms[count]    = roomIndex;
+                ambients[count] = ambient;
+                unique[count]   = isUnique;
+                count++;
+            }
+
+            state = rooms[index];
+            return index;
+        }
+    };
+
+    // opaque room geometry goes through the render queue to skip redundant state changes
+    void renderRoomsQueued(RoomDesc *roomsList, int roomsCount, const short4 &vp) {
+        RoomStates states;
+
+        Basis basis;
+        basis.identity();
+
+        mesh->transparent = 0;
+
+        for (int i = 0; i < roomsCount; i++) {
+            int roomIndex = roomsList[i].index;
+            MeshBuilder::RoomRange &range = mesh->rooms[roomIndex];
+            const TR::Room &room = level.rooms[roomIndex];
+
+            if (!range.geometry[0].count)
+                continue;
+
+            int32 state;
+            int stateIndex = states.get(room, roomIndex, getRoomAmbient(roomIndex), state);
+
+            basis.pos = room.getOffset();
+            float depth = (room.getCenter() - Core::viewPos.xyz()).length() * (1.0f / 16.0f);
+
+            mesh->recordRoomGeometry(Core::renderQueue, roomIndex, state, stateIndex, getPortalRect(roomsList[i].portal, vp), basis, depth);
+        }
+
+        Core::renderQueue.submit(setRoomStateProc, this);
+
+    // dynamic faces are streamed through the dynamic mesh
+        for (int i = 0; i < roomsCount; i++) {
+            int roomIndex = roomsList[i].index;
+            if (!mesh->rooms[roomIndex].dynamic[0].count)
+                continue;
+
+            Core::setScissor(getPortalRect(roomsList[i].portal, vp));
+
+            setRoomStateProc(this, roomIndex);
+
+            basis.pos = level.rooms[roomIndex].getOffset();
+            Core::setBasis(&basis, 1);
+            Core::mModel.identity();
+            Core::mModel.setPos(basis.pos);
+
+            mesh->renderRoomDynamic(roomIndex);
+        }
+    }
+
+    // merged room sprites ranges are drawn through the render queue,
+    // rooms with equal params share the sprite shader state
+    void renderRoomSpritesQueued(RoomDesc *roomsList, int roomsCount, const short4 &vp, Basis &basis) {
+        RoomStates states;
+
+        for (int i = 0; i < roomsCount; i++) {
+            int roomIndex = roomsList[i].index;
+            MeshBuilder::RoomRange &range = mesh->rooms[roomIndex];
+
+            if (!range.sprites.iCount)
+                continue;
+
+            const TR::Room &room = level.rooms[roomIndex];
+
+            int32 state;
+            int stateIndex = states.get(room, roomIndex, 0, state);
+
+            basis.pos = room.getOffset();
+            float depth = (room.getCenter() - Core::viewPos.xyz()).length() * (1.0f / 16.0f);
+
+            Core::renderQueue.add(state, stateIndex, mesh->mesh, range.sprites, NULL, getPortalRect(roomsList[i].portal, vp), basis, depth);
+        }
+
+        Core::renderQueue.submit(setSpriteStateProc, this);
+    }
+
+    // sprites of all visible rooms are pre-transformed into one dynamic batch
+    // per palette (dry / underwater), clipped by the union of the rooms portal rects
+    void renderRoomSpritesBatched(RoomDesc *roomsList, int roomsCount, const short4 &vp) {
+        for (int water = 0; water < 2; water++) {
+            int   firstRoom = -1;
+            short minX = 0x7FFF, minY = 0x7FFF, maxX = -0x7FFF, maxY = -0x7FFF;
+
+            for (int i = 0; i < roomsCount; i++) {
+                int roomIndex = roomsList[i].index;
+                const TR::Room &room = level.rooms[roomIndex];
+
+                if (!room.data.sCount || room.flags.water != water)
+                    continue;
+
+                short4 rect = getPortalRect(roomsList[i].portal, vp);
+                minX = min(minX, rect.x);
+                minY = min(minY, rect.y);
+                maxX = max(maxX, short(rect.x + rect.z));
+                maxY = max(maxY, short(rect.y + rect.w));
+
+                if (firstRoom == -1)
+                    firstRoom = roomIndex;
+
+                mesh->addRoomSpritesBatch(roomIndex);
+            }
+
+            if (firstRoom == -1)
+                continue;
+
+            Core::setScissor(short4(minX, minY, maxX - minX, maxY - minY));
+            setSpriteStateProc(this, firstRoom);
+            mesh->renderSpritesBatch(Core::viewPos.xyz());
+        }
+    }
+
     void renderRooms(RoomDesc *roomsList, int roomsCount, int transp) {
         PROFILE_MARKER("ROOMS");
 
@@ -2016,6 +2316,11 @@ struct Level : IGame {
 
         short4 vp = Core::scissor;
 
+        if (!transp) {
+            renderRoomsQueued(roomsList, roomsCount, vp);
+            i = end; // static geometry is already submitted, only dynamic faces left
+        }
+
         while (i != end) {
             int roomIndex = roomsList[i].index;
             MeshBuilder::RoomRange &range = mesh->rooms[roomIndex];
@@ -2058,59 +2363,70 @@ struct Level : IGame {
                 basis.rot = quat(0, 0, 0, 1);
             #endif
 
-            for (int i = 0; i < roomsCount; i++) {
-                int roomIndex = roomsList[i].index;
-                level.rooms[roomIndex].flags.visible = true;
-
-                MeshBuilder::RoomRange &range = mesh->rooms[roomIndex];
-
-                if (!range.sprites.iCount)
-                    continue;
-
-                Core::setScissor(getPortalRect(roomsList[i].portal, vp));
-
-                setRoomParams(roomIndex, Shader::SPRITE, 1.0f, 1.0f, 0.0f, 1.0f, true);
-
-                basis.pos = level.rooms[roomIndex].getOffset();
-                Core::setBasis(&basis, 1);
+            for (int i = 0; i < roomsCount; i++)
+                level.rooms[roomsList[i].index].flags.visible = true;
 
-                mesh->renderRoomSprites(roomIndex);
-            }
+            #ifdef MERGE_SPRITES
+                renderRoomSpritesQueued(roomsList, roomsCount, vp, basis);
+            #else
+                renderRoomSpritesBatched(roomsList, roomsCount, vp);
+            #endif
         }
 
         Core::setScissor(vp);
         Core::setBlendMode(bmNone);
     }
 
-    void renderEntity(const TR::Entity &entity) {
-        //if (entity.room != lara->getRoomIndex()) return;
-        if (Core::pass == Core::passShadow && !entity.castShadow()) return;
+    // visible controllers of the current view, split by transparency (opaque, blend, additive)
+    // the model buckets hold controllers with geometry of that transparency
+    Array<Controller*> visibleEntities;
+    Array<Controller*> visibleModels[3];
+    Array<Controller*> visibleSprites[3];
 
-        Controller *controller = (Controller*)entity.controller;
-        int roomIndex = controller->getRoomIndex();
-        TR::Room &room = level.rooms[roomIndex];
+    void getVisibleEntities() {
+        PROFILE_MARKER("VISIBLE_ENTITIES");
 
-        if (controller->flags.invisible)
-            return;
+        visibleEntities.reset();
+        for (int i = 0; i < 3; i++) {
+            visibleModels[i].reset();
+            visibleSprites[i].reset();
+        }
 
-        if (!entity.isLara() && !entity.isActor() && !room.flags.visible)
-            return;
+        for (int i = 0; i < level.entitiesCount; i++) {
+            TR::Entity &e = level.entities[i];
+            Controller *controller = (Controller*)e.controller;
+            if (!controller || e.modelIndex == 0 || controller->flags.invisible)
+                continue;
 
-        bool isModel;
+            if (!e.isLara() && !e.isActor() && !level.rooms[controller->getRoomIndex()].flags.visible)
+                continue;
+
+            visibleEntities.push(controller);
+
+            if (Core::pass == Core::passShadow && !e.castShadow())
+                continue;
 
-        if (entity.type != TR::Entity::TRAP_LAVA_EMITTER) {
-            isModel = entity.modelIndex > 0;
-            if (isModel) {
-                if (!mesh->models[controller->getModel()->index].geometry[mesh->transparent].count) return;
+            if (e.type == TR::Entity::TRAP_LAVA_EMITTER) {
+                visibleSprites[2].push(controller);
+            } else if (e.modelIndex > 0) {
+                MeshBuilder::ModelRange &range = mesh->models[controller->getModel()->index];
+                for (int t = 0; t < 3; t++)
+                    if (range.geometry[t].count)
+                        visibleModels[t].push(controller);
             } else {
-                if (level.spriteSequences[-(entity.modelIndex + 1)].transp != mesh->transparent) return;
+                int transp = level.spriteSequences[-(e.modelIndex + 1)].transp;
+                if (transp < 3)
+                    visibleSprites[transp].push(controller);
             }
-        } else {
-            if (mesh->transparent != 2) {
-                return;
-            }
-            isModel = false;
         }
+    }
+
+    void renderEntity(const TR::Entity &entity) {
+        Controller *controller = (Controller*)entity.controller;
+        int roomIndex = controller->getRoomIndex();
+        TR::Room &room = level.rooms[roomIndex];
+
+        bool isModel = entity.modelIndex > 0 && entity.type != TR::Entity::TRAP_LAVA_EMITTER;
 
         Shader::Type type = isModel ? Shader::ENTITY : Shader::SPRITE;
         if (entity.type == TR::Entity::CRYSTAL)
@@ -2159,7 +2475,12 @@ struct Level : IGame {
         char buf[64];
         TR::getGameLevelFile(buf, level.version, nextLevel);
         nextLevel = TR::LVL_MAX;
-        new Stream(buf, loadLevelAsync);
+
+        Stream *stream = getPrefetchedLevel(buf);
+        if (stream)
+            loadLevelAsync(stream, NULL);
+        else
+            new Stream(buf, loadLevelAsync);
     }
 
     void update() {
@@ -2284,12 +2605,8 @@ struct Level : IGame {
 
                 updateEffect();
 
-                Controller *c = Controller::first;
-                while (c) {
-                    Controller *next = c->next;
-                    c->update();
-                    c = next;
-                }
+                updateControllers();
+                particles.update();
             } else {
                 if (camera->spectator) {
                     camera->update();
@@ -2350,6 +2667,52 @@ struct Level : IGame {
     #endif
     }
 
+    static void updateParallel(int thread, int index, void *userData) {
+        Level *level = (Level*)userData;
+        Controller   *controller = level->parallelControllers[index];
+        DeferredGame &deferred   = level->deferred[thread];
+
+        IGame *game = controller->game;
+        deferred.job = index;
+        controller->game = &deferred;
+        controller->update();
+        controller->game = game;
+    }
+
+    void updateControllers() {
+    // read phase: parallel-safe controllers update concurrently, their side effects are recorded
+        parallelControllers.reset();
+        for (Controller *c = Controller::first; c; c = c->next)
+            if (c->isParallel())
+                parallelControllers.push(c);
+
+        if (parallelControllers.length) {
+            for (int i = 0; i < JOB_THREADS; i++)
+                deferred[i].reset(this);
+
+            Core::jobs.run(parallelControllers.length, updateParallel, this);
+
+        // commit phase: replay the side effects in the controllers list order
+            deferredCommands.reset();
+            for (int i = 0; i < JOB_THREADS; i++)
+                for (int j = 0; j < deferred[i].commands.length; j++)
+                    deferredCommands.push(deferred[i].commands[j]);
+
+            deferredCommands.sort();
+            for (int i = 0; i < deferredCommands.length; i++)
+                deferredCommands[i].execute(this);
+        }
+
+    // serial phase: the rest in the list order
+        Controller *c = Controller::first;
+        while (c) {
+            Controller *next = c->next;
+            if (!c->isParallel())
+                c->update();
+            c = next;
+        }
+    }
+
     void updateEffect() {
         if (effect == TR::Effect::NONE)
             return;
@@ -2395,11 +2758,13 @@ struct Level : IGame {
         mesh->transparent = transp;
 
         atlasObjects->bind(sDiffuse);
-        for (int i = 0; i < level.entitiesCount; i++) {
-            TR::Entity &e = level.entities[i];
-            if (!e.controller || e.modelIndex == 0) continue;
-            renderEntity(e);
-        }
+        for (int i = 0; i < visibleModels[transp].length; i++)
+            renderEntity(visibleModels[transp][i]->getEntity());
+
+        for (int i = 0; i < visibleSprites[transp].length; i++)
+            renderEntity(visibleSprites[transp][i]->getEntity());
+
+        particles.render(mesh, transp);
 
         {
             PROFILE_MARKER("ENTITY_SPRITES");
@@ -2425,12 +2790,86 @@ struct Level : IGame {
         }
     }
 
+    #define POSE_TASK_SIZE 16
+
+    struct PoseJob {
+        Controller *controller;
+        Basis      root;
+    };
+
+    struct PoseTask {
+        PoseJob *jobs;
+        int     count;
+    };
+
+    Array<PoseJob> poseJobs;
+
+    static void taskPoses(void *userData) {
+        PoseTask *task = (PoseTask*)userData;
+        for (int i = 0; i < task->count; i++) {
+            PoseJob &job = task->jobs[i];
+            job.controller->animation.getPose(job.root, job.controller->joints);
+        }
+    }
+
+    // evaluate skeletons of all controllers visible in the current view in one pass
+    // joint queries, shadows and rendering read the per-frame cached Controller::joints
+    void updatePoses() {
+        if (Core::pass == Core::passAmbient)
+            return;
+
+        PROFILE_MARKER("POSES");
+
+        poseJobs.reset();
+
+        for (int i = 0; i < visibleEntities.length; i++) {
+            Controller *controller = visibleEntities[i];
+            if (!controller->joints || !controller->animation.model)
+                continue;
+
+            if (controller->jointsFrame == Core::stats.frame)
+                continue;
+
+            PoseJob job;
+            job.controller = controller;
+            job.root       = Basis(controller->getMatrix()); // getMatrix is not thread-safe
+            poseJobs.push(job);
+
+            controller->jointsFrame = Core::stats.frame;
+        }
+
+        PoseTask tasks[Core::TaskGraph::MAX_TASKS];
+
+    #ifdef OS_PTHREAD_MT
+        int tasksCount = min(int(Core::TaskGraph::MAX_TASKS), (poseJobs.length + POSE_TASK_SIZE - 1) / POSE_TASK_SIZE);
+
+        if (tasksCount > 1) {
+            Core::TaskGraph graph;
+            int start = 0;
+            for (int i = 0; i < tasksCount; i++) {
+                int end = poseJobs.length * (i + 1) / tasksCount;
+                tasks[i].jobs  = poseJobs.items + start;
+                tasks[i].count = end - start;
+                graph.add("poses", taskPoses, tasks + i);
+                start = end;
+            }
+            graph.run();
+            return;
+        }
+    #endif
+
+        tasks[0].jobs  = poseJobs.items;
+        tasks[0].count = poseJobs.length;
+        taskPoses(tasks);
+    }
+
     void renderEntities(int transp) {
         if (Core::pass == Core::passAmbient) // TODO allow static entities
             return;
 
         PROFILE_MARKER("ENTITIES");
 
+        // not queued, the per-entity lights and joints are unique state (see Core::RenderQueue)
         if (transp == 0) {
             Core::setBlendMode(bmNone);
             renderEntitiesTransp(transp);
@@ -2444,10 +2883,9 @@ struct Level : IGame {
             Core::setFog(FOG_NONE);
             Core::whiteTex->bind(sDiffuse);
             Core::setBlendMode(bmMult);
-            for (int i = 0; i < level.entitiesCount; i++) {
-                TR::Entity &entity = level.entities[i];
-                Controller *controller = (Controller*)entity.controller;
-                if (controller && controller->flags.rendered && controller->getEntity().castShadow())
+            for (int i = 0; i < visibleEntities.length; i++) {
+                Controller *controller = visibleEntities[i];
+                if (controller->flags.rendered && controller->getEntity().castShadow())
                     controller->renderShadow(mesh);
             }
             Core::setBlendMode(bmNone);
@@ -2641,6 +3079,8 @@ struct Level : IGame {
                 getVisibleRooms(roomsList, roomsCount, TR::NO_ROOM, roomIndex, vec4(-1.0f, -1.0f, 1.0f, 1.0f), water);
         }
 
+        Core::stats.rooms += roomsCount;
+
         if (water && waterCache) {
             for (int i = 0; i < roomsCount; i++)
                 waterCache->setVisible(roomsList[i].index);
@@ -2680,6 +3120,9 @@ struct Level : IGame {
         }
 
         prepareRooms(roomsList, roomsCount);
+        if (Core::pass != Core::passAmbient)
+            getVisibleEntities();
+        updatePoses();
 
         renderOpaque(roomsList, roomsCount);
         renderTransparent(roomsList, roomsCount);
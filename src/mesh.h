@@ -15,10 +15,10 @@ enum CommonTexType {
     CTEX_MAX,
 };
 
-TR::TextureInfo CommonTex[CTEX_MAX];
-TR::TextureInfo &whiteRoom   = CommonTex[CTEX_WHITE_ROOM];
-TR::TextureInfo &whiteObject = CommonTex[CTEX_WHITE_OBJECT];
-TR::TextureInfo &whiteSprite = CommonTex[CTEX_WHITE_SPRITE];
+ENGINE_TLS TR::TextureInfo CommonTex[CTEX_MAX];
+ENGINE_TLS TR::TextureInfo &whiteRoom   = CommonTex[CTEX_WHITE_ROOM];
+ENGINE_TLS TR::TextureInfo &whiteObject = CommonTex[CTEX_WHITE_OBJECT];
+ENGINE_TLS TR::TextureInfo &whiteSprite = CommonTex[CTEX_WHITE_SPRITE];
 
 #define PLANE_DETAIL 48
 #define CIRCLE_SEGS  16
@@ -26,6 +26,13 @@ TR::TextureInfo &whiteSprite = CommonTex[CTEX_WHITE_SPRITE];
 #define DYN_MESH_FACES     2048
 #define DOUBLE_SIDED       2
 
+// c3d, gxm and gu already stream dynamic geometry into per-frame memory
+#if defined(_GAPI_GL) || defined(_GAPI_D3D8) || defined(_GAPI_D3D9) || defined(_GAPI_D3D11) || defined(_GAPI_SW)
+    #define DYN_MESH_STREAM
+    #define DYN_STREAM_BUFFERS 3                      // frames in flight
+    #define DYN_STREAM_FACES   (DYN_MESH_FACES * 4)   // per buffer, must fit 16-bit indices
+#endif
+
 #define WATER_VOLUME_HEIGHT (768 * 2)
 #define WATER_VOLUME_OFFSET 4
 
@@ -51,6 +58,86 @@ struct Mesh : GAPI::Mesh {
     }
 };
 
+#ifdef DYN_MESH_STREAM
+// appends all dynamic geometry of the frame into one buffer instead of re-uploading
+// a single small mesh per batch, every frame takes the next buffer of the ring
+// a buffer used less than DYN_STREAM_BUFFERS frames ago may still be in flight, reusing it counts as a wait
+struct MeshStream {
+    Mesh      *buffers[DYN_STREAM_BUFFERS];
+    MeshRange ranges[DYN_STREAM_BUFFERS];
+    uint32    usedFrame[DYN_STREAM_BUFFERS];
+    Index     *indices;
+    int       index;
+    int       iOffset;
+    int       vOffset;
+    uint32    frameIndex;
+
+    MeshStream() : index(0), iOffset(0), vOffset(0), frameIndex(0) {
+        for (int i = 0; i < DYN_STREAM_BUFFERS; i++) {
+            buffers[i] = new Mesh(NULL, DYN_STREAM_FACES * 3, NULL, DYN_STREAM_FACES * 3, 1, true);
+            ranges[i].vStart = 0;
+            ranges[i].iStart = 0;
+            buffers[i]->initRange(ranges[i]);
+            usedFrame[i] = 0xFFFFFFFF;
+        }
+        indices = new Index[DYN_STREAM_FACES * 3];
+        frameIndex = Core::stats.frameIndex;
+    }
+
+    ~MeshStream() {
+        for (int i = 0; i < DYN_STREAM_BUFFERS; i++) {
+            delete buffers[i];
+        }
+        delete[] indices;
+    }
+
+    void next() {
+        index = (index + 1) % DYN_STREAM_BUFFERS;
+        iOffset = vOffset = 0;
+
+        if (usedFrame[index] != 0xFFFFFFFF && frameIndex - usedFrame[index] < DYN_STREAM_BUFFERS) {
+            Core::stats.streamWaits++;
+        }
+    }
+
+    void render(Index *srcIndices, int iCount, Vertex *srcVertices, int vCount) {
+        ASSERT(iCount <= DYN_STREAM_FACES * 3 && vCount <= DYN_STREAM_FACES * 3);
+
+        if (frameIndex != Core::stats.frameIndex) {
+            frameIndex = Core::stats.frameIndex;
+            next();
+        }
+
+        if (iOffset + iCount > DYN_STREAM_FACES * 3 || vOffset + vCount > DYN_STREAM_FACES * 3) {
+            next();
+        }
+
+    // indices of the batch are relative to its first vertex
+        Index *dst = srcIndices;
+        if (vOffset) {
+            dst = indices;
+            for (int i = 0; i < iCount; i++) {
+                dst[i] = srcIndices[i] + vOffset;
+            }
+        }
+
+        Mesh *mesh = buffers[index];
+        mesh->update(dst, iCount, srcVertices, vCount, iOffset, vOffset);
+        usedFrame[index] = frameIndex;
+
+        MeshRange range = ranges[index];
+        range.iStart = iOffset;
+        range.iCount = iCount;
+        mesh->render(range);
+
+        iOffset += iCount;
+        vOffset += vCount;
+
+        Core::stats.streamBytes += iCount * sizeof(Index) + vCount * sizeof(Vertex);
+    }
+};
+#endif
+
 #define CHECK_ROOM_NORMAL(f) \
             vec3 o = d.vertices[f.vertices[0]].pos;\
             vec3 a = o - d.vertices[f.vertices[1]].pos;\
@@ -89,10 +176,14 @@ uint8 intensity(int lighting) {
 struct MeshBuilder {
     Index     dynIndices[DYN_MESH_FACES * 3];
     Vertex    dynVertices[DYN_MESH_FACES * 3];
-    MeshRange dynRange;
     int       dynICount;
     int       dynVCount;
+#ifdef DYN_MESH_STREAM
+    MeshStream *dynStream;
+#else
+    MeshRange dynRange;
     Mesh      *dynMesh;
+#endif
 
     Mesh      *mesh;
     Texture   *atlas;
@@ -170,6 +261,22 @@ struct MeshBuilder {
         int      vCount;
     } *models;
 
+// room sprites batch (pre-transformed on CPU, sorted by tile)
+    struct SpriteInstance {
+        int32   x, y, z;
+        int16   texture;
+        uint16  tile;
+        Color32 color;
+
+        static int cmp(const SpriteInstance &a, const SpriteInstance &b) {
+            if (a.tile    != b.tile)    return a.tile    < b.tile    ? -1 : 1;
+            if (a.texture != b.texture) return a.texture < b.texture ? -1 : 1;
+            return 0;
+        }
+    };
+
+    Array<SpriteInstance> spriteBatch;
+
 // procedured
     MeshRange shadowBlob;
     MeshRange quad, circle, box;
@@ -187,12 +294,19 @@ struct MeshBuilder {
         BLEND_ADD   = 4,
     };
 
-    MeshBuilder(TR::Level *level, Texture *atlas) : atlas(atlas), level(level) {
-        dynMesh = new Mesh(NULL, COUNT(dynIndices), NULL, COUNT(dynVertices), 1, true);
-        dynRange.vStart = 0;
-        dynRange.iStart = 0;
-        dynMesh->initRange(dynRange);
-
+    // CPU side geometry between the constructor and upload()
+    Index  *buildIndices;
+    Vertex *buildVertices;
+    int    buildICount, buildVCount, buildACount;
+    int    vStartModel, vStartCommon;
+
+    // builds the level geometry, doesn't touch the graphics API
+    // so it can run on the loader thread, upload() must be called after
+#ifdef DYN_MESH_STREAM
+    MeshBuilder(TR::Level *level) : dynStream(NULL), mesh(NULL), atlas(NULL), level(level) {
+#else
+    MeshBuilder(TR::Level *level) : dynMesh(NULL), mesh(NULL), atlas(NULL), level(level) {
+#endif
     // allocate room geometry ranges
         rooms = new RoomRange[level->roomsCount];
 
@@ -262,7 +376,7 @@ struct MeshBuilder {
         }
 
     // get models info
-        int vStartModel = vCount;
+        vStartModel = vCount;
         models = new ModelRange[level->modelsCount];
         for (int i = 0; i < level->modelsCount; i++) {
             models[i].vStart = vCount;
@@ -454,7 +568,7 @@ struct MeshBuilder {
         //ASSERT(vCount - vStartModel <= 0xFFFF);
 
     // build common primitives
-        int vStartCommon = vCount;
+        vStartCommon = vCount;
         aCount++;
 
         shadowBlob.vStart = vStartCommon;
@@ -598,10 +712,31 @@ struct MeshBuilder {
 
         LOG("MegaMesh (i:%d v:%d a:%d, size:%d)\n", iCount, vCount, aCount, int(iCount * sizeof(Index) + vCount * sizeof(GAPI::Vertex)));
 
+        buildIndices  = indices;
+        buildVertices = vertices;
+        buildICount   = iCount;
+        buildVCount   = vCount;
+        buildACount   = aCount;
+    }
+
+    void upload(Texture *atlas) {
+        this->atlas = atlas;
+
+    #ifdef DYN_MESH_STREAM
+        dynStream = new MeshStream();
+    #else
+        dynMesh = new Mesh(NULL, COUNT(dynIndices), NULL, COUNT(dynVertices), 1, true);
+        dynRange.vStart = 0;
+        dynRange.iStart = 0;
+        dynMesh->initRange(dynRange);
+    #endif
+
     // compile buffer and ranges
-        mesh = new Mesh(indices, iCount, vertices, vCount, aCount, false);
-        delete[] indices;
-        delete[] vertices;
+        mesh = new Mesh(buildIndices, buildICount, buildVertices, buildVCount, buildACount, false);
+        delete[] buildIndices;
+        delete[] buildVertices;
+        buildIndices  = NULL;
+        buildVertices = NULL;
 
         PROFILE_LABEL(BUFFER, mesh->ID[0], "Geometry indices");
         PROFILE_LABEL(BUFFER, mesh->ID[1], "Geometry vertices");
@@ -654,8 +789,14 @@ struct MeshBuilder {
 
         delete[] rooms;
         delete[] models;
+        delete[] buildIndices;
+        delete[] buildVertices;
         delete mesh;
+    #ifdef DYN_MESH_STREAM
+        delete dynStream;
+    #else
         delete dynMesh;
+    #endif
     }
 
     void flipMap() {
@@ -1409,11 +1550,15 @@ struct MeshBuilder {
     void renderBuffer(Index *indices, int iCount, Vertex *vertices, int vCount) {
         if (iCount <= 0) return;
 
+    #ifdef DYN_MESH_STREAM
+        dynStream->render(indices, iCount, vertices, vCount);
+    #else
         dynRange.iStart = 0;
         dynRange.iCount = iCount;
 
         dynMesh->update(indices, iCount, vertices, vCount);
         dynMesh->render(dynRange);
+    #endif
     }
 
     void renderRoomGeometry(int roomIndex) {
@@ -1429,6 +1574,24 @@ struct MeshBuilder {
             mesh->render(range);
         }
 
+        renderRoomDynamic(roomIndex);
+    }
+
+    void recordRoomGeometry(Core::RenderQueue &queue, int roomIndex, int32 state, int stateIndex, const short4 &scissor, const Basis &basis, float depth) {
+        Geometry &geom = rooms[roomIndex].geometry[transparent];
+        for (int i = 0; i < geom.count; i++) {
+            MeshRange range = geom.ranges[i];
+
+        #ifdef SPLIT_BY_TILE
+            range.clut += level->rooms[roomIndex].flags.water ? 512 : 0;
+            queue.add(state, stateIndex, mesh, range, atlas, scissor, basis, depth);
+        #else
+            queue.add(state, stateIndex, mesh, range, NULL, scissor, basis, depth);
+        #endif
+        }
+    }
+
+    void renderRoomDynamic(int roomIndex) {
         Dynamic &dyn = rooms[roomIndex].dynamic[transparent];
         if (dyn.count) {
         #ifdef SPLIT_BY_TILE
@@ -1538,6 +1701,70 @@ struct MeshBuilder {
     #endif
     }
 
+    void addRoomSpritesBatch(int roomIndex) {
+        const TR::Room &room = level->rooms[roomIndex];
+        const TR::Room::Data &d = room.data;
+
+        for (int j = 0; j < d.sCount; j++) {
+            TR::Room::Data::Sprite &f = d.sprites[j];
+            TR::Room::Data::Vertex &v = d.vertices[f.vertexIndex];
+
+            SpriteInstance s;
+            s.x       = room.info.x + v.pos.x;
+            s.y       = v.pos.y;
+            s.z       = room.info.z + v.pos.z;
+            s.texture = f.texture;
+            s.tile    = level->spriteTextures[f.texture].tile;
+            s.color   = v.color;
+            spriteBatch.push(s);
+        }
+    }
+
+    void setBatchOrigin(Basis &basis, int32 x, int32 y, int32 z) {
+        basis.pos = vec3(float(x), float(y), float(z));
+        Core::setBasis(&basis, 1);
+        Core::mModel.identity();
+        Core::mModel.setPos(basis.pos);
+    }
+
+    // emit all collected sprites through the dynamic mesh with one basis per origin,
+    // the origin moves only when a sprite is out of 16-bit range of the current one
+    void renderSpritesBatch(const vec3 &origin) {
+        if (!spriteBatch.length)
+            return;
+
+        spriteBatch.sort();
+
+        Basis basis;
+        basis.identity();
+
+        int32 ox = int32(origin.x);
+        int32 oy = int32(origin.y);
+        int32 oz = int32(origin.z);
+
+        dynBegin();
+        setBatchOrigin(basis, ox, oy, oz);
+
+        for (int i = 0; i < spriteBatch.length; i++) {
+            const SpriteInstance &s = spriteBatch[i];
+
+            if (abs(s.x - ox) > 0x7FFF || abs(s.y - oy) > 0x7FFF || abs(s.z - oz) > 0x7FFF) {
+                dynEnd();
+                dynBegin();
+                ox = s.x;
+                oy = s.y;
+                oz = s.z;
+                setBatchOrigin(basis, ox, oy, oz);
+            }
+
+            addDynSprite(s.texture, short3(s.x - ox, s.y - oy, s.z - oz), false, false, s.color, s.color);
+        }
+
+        dynEnd();
+
+        spriteBatch.reset();
+    }
+
     void renderMesh(const MeshRange &range) {
         mesh->render(range);
     }
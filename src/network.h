@@ -7,19 +7,32 @@
 #include "controller.h"
 #include "ui.h"
 
-#define NET_PROTOCOL            1
+#include <time.h>
+
+#define NET_PROTOCOL            2       // 2: delta snapshots, peer ids
 #define NET_PORT                21468
 
 #define NET_PING_TIMEOUT        ( 1000 * 10   )
 #define NET_PING_PERIOD         ( 1000 * 3    )
 #define NET_SYMC_INPUT_PERIOD   ( 1000 / 25   )
-#define NET_SYMC_STATE_PERIOD   ( 1000 / 1000 )
+#define NET_SYMC_STATE_PERIOD   ( 1000 / 20   )
+#define NET_STATS_PERIOD        ( 1000 * 5    )
+
+#define NET_MAX_SNAPSHOTS       16      // history of sent / received snapshots per peer (baselines)
+#define NET_MAX_STATES          128     // max replicated controllers per snapshot
+#define NET_STATE_DATA_SIZE     1024    // max delta payload per STATE packet
+#define NET_INTEREST_DEPTH      2       // portal hops from the peer room
+#define NET_MAX_PEERS           16      // peer ids of the clients, 0 is unassigned
+#define NET_NO_BASELINE         0xFFFF  // never used as a snapshot seq
+#define NET_ID_PLAYER           0x7FFF  // sender's own player controller
+#define NET_ID_PEER             0x7F00  // + peer id, player of another client (sent by the host)
+#define NET_ID_REMOVE           0x8000
 
 namespace Network {
 
     struct Packet {
         enum Type {
-            HELLO, INFO, PING, PONG, JOIN, ACCEPT, REJECT, INPUT, STATE,
+            HELLO, INFO, PING, PONG, JOIN, ACCEPT, REJECT, INPUT, STATE, ACK,
         };
 
         uint16 type;
@@ -64,14 +77,15 @@ namespace Network {
             } input;
 
             struct {
-                uint8  roomIndex;
-                uint8  reserved;
-                int16  pos[3];
-                int16  angle[2];
-                uint8  frame;
-                uint8  stand;
-                uint16 animIndex;
+                uint16 seq;
+                uint16 base;    // acknowledged snapshot the delta is based on
+                uint16 size;
+                uint8  data[NET_STATE_DATA_SIZE];
             } state;
+
+            struct {
+                uint16 seq;
+            } ack;
         };
 
         int getSize() const {
@@ -84,9 +98,13 @@ namespace Network {
                 sizeof(accept),
                 sizeof(reject),
                 sizeof(input),
-                sizeof(state),
+                int(sizeof(state) - sizeof(state.data)),
+                sizeof(ack),
             };
 
+            if (type == STATE)
+                return 2 + 2 + sizes[type] + min(int(state.size), NET_STATE_DATA_SIZE);
+
             if (type >= 0 && type < COUNT(sizes))
                 return 2 + 2 + sizes[type];
             ASSERT(false);
@@ -94,27 +112,93 @@ namespace Network {
         }
     };
 
-    IGame *game;
+    ENGINE_TLS IGame *game;
+
+// quantized controller state
+    struct State {
+        enum {
+            F_ROOM      = 1 << 0,
+            F_POS_DELTA = 1 << 1, // int8 offset from the baseline position
+            F_POS       = 1 << 2,
+            F_ANGLE     = 1 << 3,
+            F_ANIM      = 1 << 4,
+            F_FRAME     = 1 << 5,
+            F_STAND     = 1 << 6,
+            F_HEALTH    = 1 << 7,
+        };
+
+        uint16 id;
+        uint16 roomIndex;
+        int16  pos[3];   // room space
+        int16  angle[2]; // x, y in 1/65536 of full turn
+        uint16 animIndex;
+        uint16 frame;
+        uint16 health;
+        uint8  stand;
+
+        static int cmp(const State &a, const State &b) {
+            return int(a.id) - int(b.id);
+        }
+    };
+
+    struct Snapshot {
+        uint16 seq;
+        uint16 count;
+        State  items[NET_MAX_STATES];
+
+        Snapshot() : seq(NET_NO_BASELINE), count(0) {}
+    };
+
+    struct PeerSync {
+        Snapshot sent[NET_MAX_SNAPSHOTS];
+        Snapshot recv[NET_MAX_SNAPSHOTS];
+        uint16   seq;       // last sent
+        uint16   acked;     // last acknowledged by peer
+        uint16   applied;   // last received and applied
+
+        struct {
+            int bytesSent, bytesRecv;
+            int statesSent, statesFull;
+            int encodeTime, decodeTime; // in clock() ticks
+        } stats;
+
+        PeerSync() : seq(0), acked(NET_NO_BASELINE), applied(NET_NO_BASELINE) {
+            memset(&stats, 0, sizeof(stats));
+        }
+    };
 
     struct Player {
         NAPI::Peer peer;
         int        pingTime;
         int        pingIndex;
+        uint16     id;                  // host: peer id of the client
         Controller *controller;
+        Controller *peers[NET_MAX_PEERS]; // client: players of the other clients, spawned from the host snapshots
+        PeerSync   *sync;
     };
 
-    Array<Player> players;
+    ENGINE_TLS Array<Player> players;
 
-    int syncInputTime;
-    int syncStateTime;
+    ENGINE_TLS int syncInputTime;
+    ENGINE_TLS int syncStateTime;
+    ENGINE_TLS int statsTime;
+    ENGINE_TLS bool isHost;
 
     void start(IGame *game) {
         Network::game = game;
         NAPI::listen(NET_PORT);
-        syncInputTime = syncStateTime = Core::getTime();
+        syncInputTime = syncStateTime = statsTime = Core::getTime();
+        isHost = false;
+    }
+
+    void removePlayer(int index) {
+        delete players[index].sync;
+        players.removeFast(index);
     }
 
     void stop() {
+        while (players.length)
+            removePlayer(players.length - 1);
         players.clear();
     }
 
@@ -122,9 +206,42 @@ namespace Network {
         return NAPI::send(to, &packet, packet.getSize()) > 0;
     }
 
+    uint16 getFreePeerId() {
+        for (uint16 id = 1; id < NET_MAX_PEERS; id++) {
+            int i = 0;
+            while (i < players.length && players[i].id != id)
+                i++;
+            if (i == players.length)
+                return id;
+        }
+        return 0;
+    }
+
+    Player* addPlayer(const NAPI::Peer &peer, int time, Controller *controller) {
+        Player newPlayer;
+        newPlayer.peer       = peer;
+        newPlayer.pingIndex  = 0;
+        newPlayer.pingTime   = time;
+        newPlayer.id         = getFreePeerId();
+        newPlayer.controller = controller;
+        newPlayer.sync       = new PeerSync();
+        memset(newPlayer.peers, 0, sizeof(newPlayer.peers));
+        players.push(newPlayer);
+
+        ((Lara*)controller)->networkInput = 0;
+
+        return &players[players.length - 1];
+    }
+
     bool recvPacket(NAPI::Peer &from, Packet &packet) {
         int count = NAPI::recv(from, &packet, sizeof(packet));
         if (count > 0) {
+            if (count < 2 + 2 || packet.type > Packet::ACK)
+                return false;
+            if (packet.type == Packet::STATE) { // the size is validated before the payload is decoded
+                if (count < 2 + 2 + int(sizeof(packet.state) - sizeof(packet.state.data)) || packet.state.size > NET_STATE_DATA_SIZE)
+                    return false;
+            }
             if (count != packet.getSize()) {
                 ASSERT(false);
                 return false;
@@ -158,7 +275,7 @@ namespace Network {
             int delta = time - players[i].pingTime;
 
             if (delta > NET_PING_TIMEOUT) {
-                players.removeFast(i);
+                removePlayer(i);
                 continue;
             }
 
@@ -189,12 +306,419 @@ namespace Network {
         syncInputTime = time;
     }
 
+// state replication
+// every snapshot is delta encoded against the last snapshot acknowledged by the peer,
+// only controllers inside the peer interest area (rooms near the peer player) are sent
+    inline bool seqGreater(uint16 a, uint16 b) {
+        return int16(a - b) > 0;
+    }
+
+    Snapshot* findSnapshot(Snapshot *ring, uint16 seq) {
+        if (seq == NET_NO_BASELINE)
+            return NULL;
+        Snapshot *s = &ring[seq % NET_MAX_SNAPSHOTS];
+        return s->seq == seq ? s : NULL;
+    }
+
+    State* findState(Snapshot *snapshot, uint16 id) {
+        if (!snapshot) return NULL;
+        for (int i = 0; i < snapshot->count; i++)
+            if (snapshot->items[i].id == id)
+                return &snapshot->items[i];
+        return NULL;
+    }
+
+    void getInterestRooms(int roomIndex, uint8 *rooms, int depth) {
+        TR::Level *level = game->getLevel();
+        if (roomIndex < 0 || roomIndex >= level->roomsCount || rooms[roomIndex] > depth)
+            return;
+
+        rooms[roomIndex] = depth + 1;
+        if (!depth)
+            return;
+
+        const TR::Room &room = level->rooms[roomIndex];
+        for (int i = 0; i < room.portalsCount; i++)
+            getInterestRooms(room.portals[i].roomIndex, rooms, depth - 1);
+    }
+
+    void getState(Controller *controller, uint16 id, State &state) {
+        const TR::Entity &e = controller->getEntity();
+        vec3 offset = controller->pos - controller->getRoom().getOffset();
+
+        state.id        = id;
+        state.roomIndex = controller->getRoomIndex();
+        state.pos[0]    = int16(offset.x);
+        state.pos[1]    = int16(offset.y);
+        state.pos[2]    = int16(offset.z);
+        state.angle[0]  = int16(int32(controller->angle.x * (32768.0f / PI)));
+        state.angle[1]  = int16(int32(controller->angle.y * (32768.0f / PI)));
+        state.animIndex = controller->animation.index;
+        state.frame     = controller->animation.frameIndex;
+        state.health    = 0;
+        state.stand     = 0;
+
+        if (e.isLara() || e.isEnemy()) {
+            Character *character = (Character*)controller;
+            state.health = uint16(max(0.0f, character->health));
+            state.stand  = uint8(character->stand);
+        }
+    }
+
+    void setState(Controller *controller, const State &state, int mask) {
+        TR::Level *level = game->getLevel();
+        if (state.roomIndex >= level->roomsCount)
+            return;
+
+        controller->roomIndex = state.roomIndex;
+        controller->pos       = level->rooms[state.roomIndex].getOffset() + vec3(state.pos[0], state.pos[1], state.pos[2]);
+        controller->angle.x   = state.angle[0] * (PI / 32768.0f);
+        controller->angle.y   = state.angle[1] * (PI / 32768.0f);
+
+        Animation &anim = controller->animation;
+        if (anim.model && (mask & (State::F_ANIM | State::F_FRAME))) {
+            if (anim.index != state.animIndex || abs(anim.frameIndex - state.frame) > 2)
+                anim.setAnim(state.animIndex, -int(state.frame));
+        }
+
+        const TR::Entity &e = controller->getEntity();
+        if (e.isLara() || e.isEnemy()) {
+            Character *character = (Character*)controller;
+            character->health = float(state.health);
+            character->stand  = Character::Stand(state.stand);
+        }
+    }
+
+    int getStateMask(const State *base, const State &state) {
+        if (!base)
+            return State::F_ROOM | State::F_POS | State::F_ANGLE | State::F_ANIM | State::F_FRAME | State::F_STAND | State::F_HEALTH;
+
+        int mask = 0;
+        if (base->roomIndex != state.roomIndex) mask |= State::F_ROOM;
+        if (base->pos[0] != state.pos[0] || base->pos[1] != state.pos[1] || base->pos[2] != state.pos[2]) {
+            bool small = !(mask & State::F_ROOM);
+            for (int i = 0; i < 3; i++)
+                small &= abs(state.pos[i] - base->pos[i]) < 128;
+            mask |= small ? State::F_POS_DELTA : State::F_POS;
+        }
+        if (base->angle[0]  != state.angle[0] || base->angle[1] != state.angle[1]) mask |= State::F_ANGLE;
+        if (base->animIndex != state.animIndex) mask |= State::F_ANIM;
+        if (base->frame     != state.frame)     mask |= State::F_FRAME;
+        if (base->stand     != state.stand)     mask |= State::F_STAND;
+        if (base->health    != state.health)    mask |= State::F_HEALTH;
+        return mask;
+    }
+
+    int getStateSize(int mask) {
+        int size = 2 + 1; // id + mask
+        if (mask & State::F_ROOM)      size += 2;
+        if (mask & State::F_POS_DELTA) size += 3;
+        if (mask & State::F_POS)       size += 6;
+        if (mask & State::F_ANGLE)     size += 4;
+        if (mask & State::F_ANIM)      size += 2;
+        if (mask & State::F_FRAME)     size += 2;
+        if (mask & State::F_STAND)     size += 1;
+        if (mask & State::F_HEALTH)    size += 2;
+        return size;
+    }
+
+    template <typename T>
+    inline void writeValue(uint8 *&ptr, T value) {
+        memcpy(ptr, &value, sizeof(value));
+        ptr += sizeof(value);
+    }
+
+    template <typename T>
+    inline T readValue(const uint8 *&ptr) {
+        T value;
+        memcpy(&value, ptr, sizeof(value));
+        ptr += sizeof(value);
+        return value;
+    }
+
+    void writeState(uint8 *&ptr, const State *base, const State &state, int mask) {
+        writeValue<uint16>(ptr, state.id);
+        writeValue<uint8>(ptr, mask);
+        if (mask & State::F_ROOM) writeValue<uint16>(ptr, state.roomIndex);
+        if (mask & State::F_POS_DELTA) {
+            for (int i = 0; i < 3; i++)
+                writeValue<int8>(ptr, int8(state.pos[i] - base->pos[i]));
+        }
+        if (mask & State::F_POS) {
+            for (int i = 0; i < 3; i++)
+                writeValue<int16>(ptr, state.pos[i]);
+        }
+        if (mask & State::F_ANGLE) {
+            writeValue<int16>(ptr, state.angle[0]);
+            writeValue<int16>(ptr, state.angle[1]);
+        }
+        if (mask & State::F_ANIM)   writeValue<uint16>(ptr, state.animIndex);
+        if (mask & State::F_FRAME)  writeValue<uint16>(ptr, state.frame);
+        if (mask & State::F_STAND)  writeValue<uint8>(ptr, state.stand);
+        if (mask & State::F_HEALTH) writeValue<uint16>(ptr, state.health);
+    }
+
+    void readState(const uint8 *&ptr, State &state, int mask) {
+        if (mask & State::F_ROOM) state.roomIndex = readValue<uint16>(ptr);
+        if (mask & State::F_POS_DELTA) {
+            for (int i = 0; i < 3; i++)
+                state.pos[i] += readValue<int8>(ptr);
+        }
+        if (mask & State::F_POS) {
+            for (int i = 0; i < 3; i++)
+                state.pos[i] = readValue<int16>(ptr);
+        }
+        if (mask & State::F_ANGLE) {
+            state.angle[0] = readValue<int16>(ptr);
+            state.angle[1] = readValue<int16>(ptr);
+        }
+        if (mask & State::F_ANIM)   state.animIndex = readValue<uint16>(ptr);
+        if (mask & State::F_FRAME)  state.frame     = readValue<uint16>(ptr);
+        if (mask & State::F_STAND)  state.stand     = readValue<uint8>(ptr);
+        if (mask & State::F_HEALTH) state.health    = readValue<uint16>(ptr);
+    }
+
+    // collect controllers to replicate for the peer, sorted by id
+    void getSnapshot(const Player &player, Snapshot &snapshot) {
+        TR::Level *level = game->getLevel();
+        Controller *lara = game->getLara();
+
+        snapshot.count = 0;
+
+        if (lara)
+            getState(lara, NET_ID_PLAYER, snapshot.items[snapshot.count++]);
+
+        if (!isHost)
+            return; // clients replicate their own player only
+
+    // players of the other clients
+        for (int i = 0; i < players.length && snapshot.count < NET_MAX_STATES; i++) {
+            const Player &p = players[i];
+            if (&p == &player || !p.id || !p.controller)
+                continue;
+            getState(p.controller, NET_ID_PEER + p.id, snapshot.items[snapshot.count++]);
+        }
+
+        uint8 rooms[1024];
+        memset(rooms, 0, sizeof(rooms));
+        if (player.controller)
+            getInterestRooms(player.controller->getRoomIndex(), rooms, NET_INTEREST_DEPTH);
+
+        for (Controller *c = Controller::first; c && snapshot.count < NET_MAX_STATES; c = c->next) {
+            if (c == lara || c == player.controller || c->entity >= level->entitiesBaseCount)
+                continue;
+            if (!c->getEntity().modelIndex || c->roomIndex >= COUNT(rooms) || !rooms[c->roomIndex])
+                continue;
+            getState(c, c->entity, snapshot.items[snapshot.count++]);
+        }
+
+        ::sort(snapshot.items, snapshot.count);
+    }
+
+    int encodeSnapshot(PeerSync *sync, const Snapshot &current, Packet &packet) {
+        Snapshot *base = NULL;
+        if (sync->acked != NET_NO_BASELINE && uint16(sync->seq + 1 - sync->acked) < NET_MAX_SNAPSHOTS)
+            base = findSnapshot(sync->sent, sync->acked);
+
+        uint16 seq = sync->seq + 1;
+        if (seq == NET_NO_BASELINE)
+            seq++; // wrap around
+        Snapshot &result = sync->sent[seq % NET_MAX_SNAPSHOTS];
+        if (base) {
+            result = *base;
+        } else {
+            result.count = 0;
+        }
+        result.seq = seq;
+
+        packet.type       = Packet::STATE;
+        packet.state.seq  = seq;
+        packet.state.base = base ? base->seq : NET_NO_BASELINE;
+
+        uint8 *ptr = packet.state.data;
+        uint8 *end = packet.state.data + NET_STATE_DATA_SIZE;
+
+    // changed and new states
+        for (int i = 0; i < current.count; i++) {
+            const State &state = current.items[i];
+            State *prev = findState(base, state.id);
+            int mask = getStateMask(prev, state);
+            if (!mask || ptr + getStateSize(mask) > end)
+                continue;
+            if (!prev && result.count >= NET_MAX_STATES)
+                continue;
+
+            writeState(ptr, prev, state, mask);
+
+            State *dst = findState(&result, state.id);
+            if (!dst)
+                dst = &result.items[result.count++];
+            *dst = state;
+        }
+
+    // states out of interest or removed
+        if (base) {
+            for (int i = 0; i < base->count; i++) {
+                uint16 id = base->items[i].id;
+                if (findState((Snapshot*)&current, id) || ptr + 2 > end)
+                    continue;
+
+                writeValue<uint16>(ptr, id | NET_ID_REMOVE);
+
+                State *dst = findState(&result, id);
+                if (dst)
+                    *dst = result.items[--result.count];
+            }
+        }
+
+        ::sort(result.items, result.count);
+
+        packet.state.size = uint16(ptr - packet.state.data);
+        sync->seq = seq;
+
+        return base ? 0 : 1;
+    }
+
+    Controller* getPeerController(Player *player, uint16 peerId, const State &state) {
+        if (isHost || !peerId || peerId >= NET_MAX_PEERS)
+            return NULL;
+
+        Controller *&controller = player->peers[peerId];
+        if (!controller) {
+            TR::Level *level = game->getLevel();
+            if (state.roomIndex >= level->roomsCount)
+                return NULL;
+
+            vec3 pos = level->rooms[state.roomIndex].getOffset() + vec3(state.pos[0], state.pos[1], state.pos[2]);
+            controller = game->addEntity(TR::Entity::LARA, state.roomIndex, pos, state.angle[1] * (PI / 32768.0f));
+            if (!controller)
+                return NULL;
+            ((Lara*)controller)->networkInput = 0; // driven by the snapshots only
+        }
+        return controller;
+    }
+
+    Controller* getStateController(Player *player, const State &state) {
+        uint16 id = state.id;
+
+        if (id == NET_ID_PLAYER)
+            return player->controller;
+
+        if (id >= NET_ID_PEER)
+            return getPeerController(player, id - NET_ID_PEER, state);
+
+        TR::Level *level = game->getLevel();
+        if (id >= level->entitiesBaseCount)
+            return NULL;
+
+        Controller *controller = (Controller*)level->entities[id].controller;
+        if (controller == game->getLara())
+            return NULL; // never override local player
+        return controller;
+    }
+
+    void decodeSnapshot(Player *player, const Packet &packet) {
+        PeerSync *sync = player->sync;
+
+        Snapshot *base = NULL;
+        if (packet.state.base != NET_NO_BASELINE) {
+            base = findSnapshot(sync->recv, packet.state.base);
+            if (!base) return; // baseline is lost, wait for the next one
+        }
+
+        Snapshot result;
+        if (base)
+            result = *base;
+        result.seq = packet.state.seq;
+
+        bool isNewer = sync->applied == NET_NO_BASELINE || seqGreater(packet.state.seq, sync->applied);
+
+        const uint8 *ptr = packet.state.data;
+        const uint8 *end = packet.state.data + packet.state.size;
+
+        while (ptr + 2 <= end) {
+            uint16 id = readValue<uint16>(ptr);
+
+            if (id & NET_ID_REMOVE) {
+                State *dst = findState(&result, id & ~NET_ID_REMOVE);
+                if (dst)
+                    *dst = result.items[--result.count];
+                continue;
+            }
+
+            if (ptr + 1 > end) break;
+            int mask = readValue<uint8>(ptr);
+            if (ptr + getStateSize(mask) - 3 > end) break;
+
+            State *dst = findState(&result, id);
+            if (!dst) {
+                if (result.count >= NET_MAX_STATES) break;
+                dst = &result.items[result.count++];
+                memset(dst, 0, sizeof(*dst));
+                dst->id = id;
+            }
+            readState(ptr, *dst, mask);
+
+            if (isNewer) {
+                Controller *controller = getStateController(player, *dst);
+                if (controller)
+                    setState(controller, *dst, mask);
+            }
+        }
+
+        ::sort(result.items, result.count);
+        sync->recv[result.seq % NET_MAX_SNAPSHOTS] = result;
+
+        if (isNewer)
+            sync->applied = result.seq;
+
+        Packet response;
+        response.type    = Packet::ACK;
+        response.ack.seq = result.seq;
+        sendPacket(player->peer, response);
+    }
+
     void syncState(int time) {
         if ((time - syncStateTime) < NET_SYMC_STATE_PERIOD)
             return;
-        // TODO    
+
+        Snapshot current;
+        Packet   packet;
+
+        for (int i = 0; i < players.length; i++) {
+            Player &player = players[i];
+
+            int t = int(clock());
+            getSnapshot(player, current);
+            player.sync->stats.statesFull += encodeSnapshot(player.sync, current, packet);
+            player.sync->stats.encodeTime += int(clock()) - t;
+
+            if (sendPacket(player.peer, packet))
+                player.sync->stats.bytesSent += packet.getSize();
+            player.sync->stats.statesSent++;
+        }
+
         syncStateTime = time;
-    } 
+    }
+
+    void logStats(int time) {
+        if (time - statsTime < NET_STATS_PERIOD)
+            return;
+
+        float secs = (time - statsTime) * 0.001f;
+        float mcs  = 1000000.0f / CLOCKS_PER_SEC;
+
+        for (int i = 0; i < players.length; i++) {
+            PeerSync *sync = players[i].sync;
+            LOG("network: peer %d out %d B/s in %d B/s states %d (full %d) enc %d mcs dec %d mcs\n", i,
+                int(sync->stats.bytesSent / secs), int(sync->stats.bytesRecv / secs),
+                sync->stats.statesSent, sync->stats.statesFull,
+                int(sync->stats.encodeTime * mcs), int(sync->stats.decodeTime * mcs));
+            memset(&sync->stats, 0, sizeof(sync->stats));
+        }
+
+        statsTime = time;
+    }
 
     Player* getPlayerByPeer(const NAPI::Peer &peer) {
         for (int i = 0; i < players.length; i++)
@@ -271,26 +795,27 @@ namespace Network {
 
                         getSpawnPoint(roomIndex, pos, angle);
 
-                        Player newPlayer;
-                        newPlayer.peer       = from;
-                        newPlayer.pingIndex  = 0;
-                        newPlayer.pingTime   = time;
-                        newPlayer.controller = game->addEntity(TR::Entity::LARA, roomIndex, pos, angle);
-                        players.push(newPlayer);
+                        if (!getFreePeerId()) {
+                            response.type          = Packet::REJECT;
+                            response.reject.reason = 0;
+                            sendPacket(from, response);
+                            break;
+                        }
 
-                        ((Lara*)newPlayer.controller)->networkInput = 0;
+                        Controller *controller = game->addEntity(TR::Entity::LARA, roomIndex, pos, angle);
+                        ASSERT(controller);
+                        player = addPlayer(from, time, controller);
+                        isHost = true;
 
                         char buf[32];
                         packet.join.nick.get(buf);
                         LOG("Player %s joined\n", buf);
 
-                        ASSERT(newPlayer.controller);
-
                         TR::Room &room = game->getLevel()->rooms[roomIndex];
                         vec3 offset = pos - room.getOffset();
 
                         response.type = Packet::ACCEPT;
-                        response.accept.id        = 0;
+                        response.accept.id        = player->id;
                         response.accept.level     = game->getLevel()->id;
                         response.accept.roomIndex = roomIndex;
                         response.accept.posX      = int16(offset.x);
@@ -304,6 +829,7 @@ namespace Network {
 
                 case Packet::ACCEPT : {
                     LOG("accept!\n");
+                    isHost = false;
                     game->loadLevel(TR::LevelID(packet.accept.level));
                     inventory->toggle();
                     break;
@@ -323,16 +849,7 @@ namespace Network {
 
                         getSpawnPoint(roomIndex, pos, angle);
 
-                        Player newPlayer;
-                        newPlayer.peer       = from;
-                        newPlayer.pingIndex  = 0;
-                        newPlayer.pingTime   = time;
-                        newPlayer.controller = game->addEntity(TR::Entity::LARA, roomIndex, pos, angle);
-                        players.push(newPlayer);
-
-                        ((Lara*)newPlayer.controller)->networkInput = 0;
-
-                        player = getPlayerByPeer(from);
+                        player = addPlayer(from, time, game->addEntity(TR::Entity::LARA, roomIndex, pos, angle));
                     }
 
                     if (player) {
@@ -341,13 +858,30 @@ namespace Network {
                     break;
 
                 case Packet::STATE :
+                    if (player) {
+                        int t = int(clock());
+                        decodeSnapshot(player, packet);
+                        player->sync->stats.decodeTime += int(clock()) - t;
+                    }
+                    break;
+
+                case Packet::ACK :
+                    if (player) {
+                        PeerSync *sync = player->sync;
+                        if (sync->acked == NET_NO_BASELINE || seqGreater(packet.ack.seq, sync->acked))
+                            sync->acked = packet.ack.seq;
+                    }
                     break;
             }
+
+            if (player)
+                player->sync->stats.bytesRecv += packet.getSize();
         }
 
         pingPlayers(time);
         syncInput(time);
         syncState(time);
+        logStats(time);
     }
 }
 
@@ -55,7 +55,9 @@ struct Gear : Controller {
         STATE_ROTATE,
     };
 
-    Gear(IGame *game, int entity) : Controller(game, entity) {}
+    Gear(IGame *game, int entity) : Controller(game, entity) {
+        parallel = true;
+    }
 
     virtual void update() {
         updateAnimation(true);
@@ -72,6 +74,8 @@ struct KeyItemInv : Controller {
 #define DART_DAMAGE 50
 
 struct Dart : Controller {
+    DECL_POOLED(Dart, 32)
+
     vec3 velocity;
     vec3 dir;
     bool armed;
@@ -94,7 +98,7 @@ struct Dart : Controller {
         TR::Level::FloorInfo info;
         getFloorInfo(getRoomIndex(), pos, info);
         if (pos.y > info.floor || pos.y < info.ceiling || !insideRoom(pos, getRoomIndex())) {
-            game->addEntity(TR::Entity::RICOCHET, getRoomIndex(), pos - dir * 64.0f); // with wall offset
+            game->addParticle(TR::Entity::RICOCHET, getRoomIndex(), pos - dir * 64.0f); // with wall offset
             game->removeEntity(this);
         }
     }
@@ -119,7 +123,7 @@ struct TrapDartEmitter : Controller {
 
             game->addEntity(TR::Entity::DART, getRoomIndex(), p, angle.y);
             if (level->extra.smoke != -1)
-                game->addEntity(TR::Entity::SMOKE, getRoomIndex(), p);
+                game->addParticle(TR::Entity::SMOKE, getRoomIndex(), p);
             game->playSound(TR::SND_DART, p, Sound::PAN);
         }
 
@@ -131,6 +135,7 @@ struct TrapDartEmitter : Controller {
 #define FLAME_BURN_DAMAGE 150
 
 struct Flame : Sprite {
+    DECL_POOLED(Flame, 32)
 
     static Flame* add(IGame *game, Controller *owner, int jointIndex) {
         ASSERT(owner);
@@ -227,6 +232,8 @@ struct TrapFlameEmitter : Controller {
 #define FLASH_LIGHT_COLOR   vec4(0.6f, 0.5f, 0.1f, 1.0f / 3072.0f)
 
 struct MuzzleFlash : Controller {
+    DECL_POOLED(MuzzleFlash, 8)
+
     Controller *owner;
     int        joint;
     int        lightIndex;
@@ -772,7 +779,9 @@ struct TrapDoor : Controller {
         STATE_OPEN,
     };
 
-    TrapDoor(IGame *game, int entity) : Controller(game, entity) {}
+    TrapDoor(IGame *game, int entity) : Controller(game, entity) {
+        parallel = true;
+    }
     
     virtual bool isCollider() {
         int targetState = isActive(false) ? STATE_OPEN : STATE_CLOSE;
@@ -1151,9 +1160,12 @@ struct ThorHammer : Controller {
     }
 
     void updateBlock() {
-        block->animation.frameA = animation.frameA;
-        block->animation.frameB = animation.frameB;
-        block->animation.delta  = animation.delta;
+        block->animation.frameA   = animation.frameA;
+        block->animation.frameB   = animation.frameB;
+        block->animation.rotA     = animation.rotA;
+        block->animation.rotB     = animation.rotB;
+        block->animation.rotCount = min(animation.rotCount, (int)block->animation.model->mCount);
+        block->animation.delta    = animation.delta;
     }
 
     virtual void setSaveData(const SaveEntity &data) {
@@ -1629,65 +1641,12 @@ struct Waterfall : Controller {
         vec3 dropPos = pos + vec3(p.x, 0.0f, p.y);
         game->waterDrop(dropPos, dropRadius, dropStrength);
         if (level->extra.waterSplash > -1)
-            game->addEntity(TR::Entity::WATER_SPLASH, getRoomIndex(), dropPos);
+            game->addParticle(TR::Entity::WATER_SPLASH, getRoomIndex(), dropPos);
     } 
 
     #undef SPLASH_TIMESTEP
 };
 
-struct Bubble : Sprite {
-    float speed;
-
-    Bubble(IGame *game, int entity) : Sprite(game, entity, true, Sprite::FRAME_RANDOM) {
-        speed = (10.0f + randf() * 6.0f) * 30.0f;
-    // get water height => bubble life time
-        int dx, dz;
-        int room = getRoomIndex();
-        int h = int(pos.y);
-        while (room != TR::NO_ROOM && level->rooms[room].flags.water) {
-            TR::Room::Sector &s = level->getSector(room, int(pos.x), int(pos.z), dx, dz);
-            h = s.ceiling * 256;
-            room = s.roomAbove;
-        }
-        if (pos.y < h)
-            time = 1.0f / SPRITE_FPS;
-        else
-            time -= (pos.y - h) / speed - (1.0f / SPRITE_FPS);
-        activate();
-    }
-
-    virtual ~Bubble() {
-        game->waterDrop(pos, 64.0f, 0.01f);
-    }
-
-    virtual bool getSaveData(SaveEntity &data) {
-        return false;
-    }
-
-    virtual void update() {
-        pos.y -= speed * Core::deltaTime;
-        angle.x += 30.0f * 13.0f * DEG2RAD * Core::deltaTime;
-        angle.y += 30.0f *  9.0f * DEG2RAD * Core::deltaTime;
-        pos.x += sinf(angle.y) * (11.0f * 30.0f * Core::deltaTime);
-        pos.z += cosf(angle.x) * (8.0f  * 30.0f * Core::deltaTime);
-        Sprite::update();
-    }
-};
-
-
-struct Explosion : Sprite {
-
-    Explosion(IGame *game, int entity) : Sprite(game, entity, true, Sprite::FRAME_ANIMATED) {
-        game->playSound(TR::SND_EXPLOSION, pos, Sound::PAN);
-        level->spriteSequences[-(getEntity().modelIndex + 1)].transp = 2; // fix blending mode to additive
-    }
-
-    virtual bool getSaveData(SaveEntity &data) {
-        return false;
-    }
-};
-
-
 struct BreakableWindow : Controller {
 
     BreakableWindow(IGame *game, int entity) : Controller(game, entity) {
@@ -1760,6 +1719,8 @@ struct StoneItem : Controller {
 #define MUTANT_BULLET_DAMAGE  30.0f
 
 struct Bullet : Controller {
+    DECL_POOLED(Bullet, 32)
+
     vec3 velocity;
 
     Bullet(IGame *game, int entity) : Controller(game, entity) {
@@ -1820,7 +1781,7 @@ struct Bullet : Controller {
                     }
                 }
 
-                game->addEntity(TR::Entity::EXPLOSION, getRoomIndex(), pos);
+                game->addParticle(TR::Entity::EXPLOSION, getRoomIndex(), pos);
                 break;
             case TR::Entity::MUTANT_BULLET  :
                 if (directHit)
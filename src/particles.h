@@ -0,0 +1,192 @@
+#ifndef H_PARTICLES
+#define H_PARTICLES
+
+#include "core.h"
+#include "format.h"
+#include "controller.h"
+
+// short-lived sprite effects (blood, ricochets, sparkles, smoke, splashes, bubbles and explosions)
+// live in a fixed structure of arrays instead of entity slots and controllers
+// they are updated by linear passes and emitted into the dynamic sprite batch of the entities pass
+
+#define MAX_PARTICLES 2048
+
+struct ParticleSystem {
+    enum {
+        FRAME_ANIMATED = -1,
+    };
+
+    enum Kind {
+        KIND_SPRITE,
+        KIND_BUBBLE,
+    };
+
+    IGame     *game;
+    TR::Level *level;
+    int       count;
+
+    float   px[MAX_PARTICLES], py[MAX_PARTICLES], pz[MAX_PARTICLES];
+    float   vx[MAX_PARTICLES], vy[MAX_PARTICLES], vz[MAX_PARTICLES]; // units per 1/30 sec
+    float   ax[MAX_PARTICLES], ay[MAX_PARTICLES];                   // bubble wobble phase
+    float   time[MAX_PARTICLES];
+    float   life[MAX_PARTICLES];
+    Color32 color[MAX_PARTICLES];
+    int16   sequence[MAX_PARTICLES];
+    int16   frame[MAX_PARTICLES];
+    int16   room[MAX_PARTICLES];
+    uint8   kind[MAX_PARTICLES];
+
+    void init(IGame *game, TR::Level *level) {
+        this->game  = game;
+        this->level = level;
+        count = 0;
+    }
+
+    static bool isParticle(TR::Entity::Type type) {
+        switch (type) {
+            case TR::Entity::BUBBLE       :
+            case TR::Entity::EXPLOSION    :
+            case TR::Entity::WATER_SPLASH :
+            case TR::Entity::BLOOD        :
+            case TR::Entity::SMOKE        :
+            case TR::Entity::SPARKLES     :
+            case TR::Entity::RICOCHET     : return true;
+            default                       : return false;
+        }
+    }
+
+    void emit(TR::Entity::Type type, int roomIndex, const vec3 &pos, const vec3 &velocity) {
+        int16 modelIndex = level->getModelIndex(type);
+        if (modelIndex >= 0 || count >= MAX_PARTICLES)
+            return;
+
+        int i = count++;
+
+        TR::SpriteSequence &seq = level->spriteSequences[-(modelIndex + 1)];
+
+        px[i]       = pos.x;
+        py[i]       = pos.y;
+        pz[i]       = pos.z;
+        vx[i]       = velocity.x;
+        vy[i]       = velocity.y;
+        vz[i]       = velocity.z;
+        ax[i]       = 0.0f;
+        ay[i]       = 0.0f;
+        time[i]     = 0.0f;
+        sequence[i] = -(modelIndex + 1);
+        room[i]     = roomIndex;
+        kind[i]     = KIND_SPRITE;
+
+        if (type == TR::Entity::RICOCHET || type == TR::Entity::BUBBLE) {
+            frame[i] = rand() % max(seq.sCount, int16(1));
+            life[i]  = 1.0f / SPRITE_FPS;
+        } else {
+            frame[i] = FRAME_ANIMATED;
+            life[i]  = seq.sCount / SPRITE_FPS;
+        }
+
+        if (type == TR::Entity::BUBBLE) {
+            float speed = 10.0f + randf() * 6.0f;
+            vy[i]   = -speed;
+            kind[i] = KIND_BUBBLE;
+        // get water height => bubble life time
+            int dx, dz;
+            int r = roomIndex;
+            int h = int(pos.y);
+            while (r != TR::NO_ROOM && level->rooms[r].flags.water) {
+                TR::Room::Sector &s = level->getSector(r, int(pos.x), int(pos.z), dx, dz);
+                h = s.ceiling * 256;
+                r = s.roomAbove;
+            }
+            life[i] = max(0.0f, (pos.y - h) / (speed * 30.0f));
+        }
+
+        if (type == TR::Entity::EXPLOSION) {
+            game->playSound(TR::SND_EXPLOSION, pos, Sound::PAN);
+            seq.transp = 2; // fix blending mode to additive
+        }
+
+        float fAmbient = intensityf(level->rooms[roomIndex].ambient) * 0.5f;
+        float fAlpha   = (type == TR::Entity::SMOKE || type == TR::Entity::WATER_SPLASH || type == TR::Entity::SPARKLES) ? 0.75f : 1.0f;
+
+        uint8 ambient = clamp(int(fAmbient * 255.0f), 0, 255);
+        uint8 alpha   = clamp(int(fAlpha   * 255.0f), 0, 255);
+        color[i] = Color32(ambient, ambient, ambient, alpha);
+    }
+
+    void move(int dst, int src) {
+        px[dst]       = px[src];
+        py[dst]       = py[src];
+        pz[dst]       = pz[src];
+        vx[dst]       = vx[src];
+        vy[dst]       = vy[src];
+        vz[dst]       = vz[src];
+        ax[dst]       = ax[src];
+        ay[dst]       = ay[src];
+        time[dst]     = time[src];
+        life[dst]     = life[src];
+        color[dst]    = color[src];
+        sequence[dst] = sequence[src];
+        frame[dst]    = frame[src];
+        room[dst]     = room[src];
+        kind[dst]     = kind[src];
+    }
+
+    void update() {
+        if (!count) return;
+
+        PROFILE_MARKER("PARTICLES");
+
+        float dt   = Core::deltaTime;
+        float step = 30.0f * dt;
+
+        for (int i = 0; i < count; i++) {
+            px[i]   += vx[i] * step;
+            py[i]   += vy[i] * step;
+            pz[i]   += vz[i] * step;
+            time[i] += dt;
+        }
+
+        float wx = 30.0f * 13.0f * DEG2RAD * dt;
+        float wy = 30.0f *  9.0f * DEG2RAD * dt;
+
+        for (int i = 0; i < count; i++) {
+            if (kind[i] != KIND_BUBBLE) continue;
+            ax[i] += wx;
+            ay[i] += wy;
+            px[i] += sinf(ay[i]) * (11.0f * step);
+            pz[i] += cosf(ax[i]) * (8.0f  * step);
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (time[i] < life[i]) continue;
+
+            if (kind[i] == KIND_BUBBLE)
+                game->waterDrop(vec3(px[i], py[i], pz[i]), 64.0f, 0.01f);
+
+            move(i--, --count);
+        }
+    }
+
+    void render(MeshBuilder *mesh, int transp) {
+        if (Core::pass == Core::passShadow) return;
+
+        vec3 viewPos = Core::viewPos.xyz();
+
+        for (int i = 0; i < count; i++) {
+            if (!level->rooms[room[i]].flags.visible) continue;
+
+            TR::SpriteSequence &seq = level->spriteSequences[sequence[i]];
+            if (seq.transp != transp) continue;
+
+            int f = frame[i];
+            if (f == FRAME_ANIMATED)
+                f = min(int(time[i] * SPRITE_FPS), seq.sCount - 1);
+
+            short3 p(int16(px[i] - viewPos.x), int16(py[i] - viewPos.y), int16(pz[i] - viewPos.z));
+            mesh->addDynSprite(seq.sStart + f, p, false, false, color[i], color[i]);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,9 @@
+set -e
+# 32-bit host build of the GBA renderer (level data offsets are 32-bit pointers), renders into an in-memory fb
+# run from this directory: ./OpenLaraGBA [frames] or ./OpenLaraGBA_bench bench > bench.csv
+if ! echo "int main() { return 0; }" | g++ -m32 -x c++ - -o /dev/null 2> /dev/null; then
+    echo "error: g++ can't build 32-bit binaries, install the multilib (e.g. g++-multilib)" >&2
+    exit 1
+fi
+g++ -m32 -msse2 -std=c++11 -O2 -fno-exceptions -fno-rtti -D__GBA_LINUX__ -pthread main.cpp render.iwram.cpp sound.cpp ../../fixed/common.cpp -I../../fixed -o OpenLaraGBA
+g++ -m32 -msse2 -std=c++11 -O2 -fno-exceptions -fno-rtti -D__GBA_LINUX__ -DPROFILING -DPROFILE_STAGETIME -pthread main.cpp render.iwram.cpp sound.cpp ../../fixed/common.cpp -I../../fixed -o OpenLaraGBA_bench
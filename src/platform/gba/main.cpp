@@ -1,36 +1,29 @@
 #include "game.h"
 
+#ifdef USE_TILED_FLUSH
+    #include <thread>
+    #include <mutex>
+    #include <condition_variable>
+    #include <atomic>
+#endif
+
 EWRAM_DATA int32 fps;
 EWRAM_DATA int32 frameIndex = 0;
 EWRAM_DATA int32 fpsCounter = 0;
 EWRAM_DATA uint32 curSoundBuffer = 0;
 
-#ifdef __GBA_WIN__
+#if defined(__GBA_WIN__) || defined(__GBA_LINUX__)
 const void* TRACKS_AD4;
 const void* TITLE_SCR;
 const void* levelData;
 
-HWND hWnd;
-
-LARGE_INTEGER g_timer;
-LARGE_INTEGER g_current;
-
-#define WND_WIDTH   240*4
-#define WND_HEIGHT  160*4
-
 uint16 MEM_PAL_BG[256];
-uint32 SCREEN[FRAME_WIDTH * FRAME_HEIGHT];
 
 void osSetPalette(const uint16* palette)
 {
     memcpy(MEM_PAL_BG, palette, 256 * 2);
 }
 
-int32 osGetSystemTimeMS()
-{
-    return GetTickCount();
-}
-
 bool osSaveSettings()
 {
     FILE* f = fopen("settings.dat", "wb");
@@ -95,6 +88,179 @@ bool osLoadGame()
 
 void osJoyVibrate(int32 index, int32 L, int32 R) {}
 
+const void* osLoadScreen(LevelID id)
+{
+    return TITLE_SCR;
+}
+
+const void* osLoadLevel(LevelID id)
+{
+    // level1
+    char buf[32];
+
+    delete[] levelData;
+
+    sprintf(buf, "data/%s.PKD", (const char*)gLevelInfo[id].data);
+
+    FILE *f = fopen(buf, "rb");
+
+    if (!f)
+        return NULL;
+
+    {
+        fseek(f, 0, SEEK_END);
+        int32 size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        uint8* data = new uint8[size];
+        fread(data, 1, size, f);
+        fclose(f);
+
+        levelData = data;
+    }
+
+// tracks
+    if (!TRACKS_AD4)
+    {
+        FILE *f = fopen("data/TRACKS.AD4", "rb");
+        if (!f)
+            return NULL;
+
+        fseek(f, 0, SEEK_END);
+        int32 size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        uint8* data = new uint8[size];
+        fread(data, 1, size, f);
+        fclose(f);
+
+        TRACKS_AD4 = data;
+    }
+
+    if (!TITLE_SCR)
+    {
+        FILE *f = fopen("data/TITLE.SCR", "rb");
+        if (!f)
+            return NULL;
+
+        fseek(f, 0, SEEK_END);
+        int32 size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        uint8* data = new uint8[size];
+        fread(data, 1, size, f);
+        fclose(f);
+
+        TITLE_SCR = data;
+    }
+    
+    return (void*)levelData;
+}
+
+#ifdef USE_TILED_FLUSH
+#define MAX_WORKERS 7
+
+// persistent worker threads, the calling thread runs its share of the tasks too
+struct TaskPool
+{
+    std::mutex              lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::atomic<int32>      next;
+    std::atomic<int32>      pending;
+    TaskProc                proc;
+    int32                   count;
+    int32                   running;
+    uint32                  batch;
+    bool                    started;
+} gTaskPool;
+
+void taskRun()
+{
+    int32 index;
+    while ((index = gTaskPool.next++) < gTaskPool.count)
+    {
+        gTaskPool.proc(index);
+
+        if (--gTaskPool.pending == 0)
+        {
+            std::lock_guard<std::mutex> guard(gTaskPool.lock);
+            gTaskPool.done.notify_one();
+        }
+    }
+}
+
+void taskWorker()
+{
+    uint32 batch = 0;
+
+    while (1)
+    {
+        {
+            std::unique_lock<std::mutex> guard(gTaskPool.lock);
+            while (gTaskPool.batch == batch) {
+                gTaskPool.wake.wait(guard);
+            }
+            batch = gTaskPool.batch;
+            gTaskPool.running++;
+        }
+
+        taskRun();
+
+        std::lock_guard<std::mutex> guard(gTaskPool.lock);
+        if (--gTaskPool.running == 0) {
+            gTaskPool.done.notify_one();
+        }
+    }
+}
+
+void osParallelFor(int32 count, TaskProc proc)
+{
+    if (!gTaskPool.started)
+    {
+        gTaskPool.started = true;
+
+        int32 workers = X_MIN(int32(std::thread::hardware_concurrency()) - 1, MAX_WORKERS);
+        for (int32 i = 0; i < workers; i++) {
+            std::thread(taskWorker).detach();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(gTaskPool.lock);
+        gTaskPool.proc = proc;
+        gTaskPool.count = count;
+        gTaskPool.pending = count;
+        gTaskPool.next = 0;
+        gTaskPool.batch++;
+    }
+    gTaskPool.wake.notify_all();
+
+    taskRun();
+
+    // workers may still be leaving taskRun, the next batch can't start before that
+    std::unique_lock<std::mutex> guard(gTaskPool.lock);
+    while (gTaskPool.pending > 0 || gTaskPool.running > 0) {
+        gTaskPool.done.wait(guard);
+    }
+}
+#endif
+
+#endif
+
+#if defined(__GBA_WIN__)
+HWND hWnd;
+
+LARGE_INTEGER g_timer;
+LARGE_INTEGER g_current;
+
+#define WND_WIDTH   240*4
+#define WND_HEIGHT  160*4
+
+uint32 SCREEN[FRAME_WIDTH * FRAME_HEIGHT];
+
+int32 osGetSystemTimeMS()
+{
+    return GetTickCount();
+}
+
 extern int8 soundBuffer[2 * SND_SAMPLES + 32]; // 32 bytes of silence for DMA overrun while interrupt
 
 HWAVEOUT waveOut;
@@ -202,72 +368,6 @@ LRESULT CALLBACK wndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
     return 0;
 }
 
-const void* osLoadScreen(LevelID id)
-{
-    return TITLE_SCR;
-}
-
-const void* osLoadLevel(LevelID id)
-{
-    // level1
-    char buf[32];
-
-    delete[] levelData;
-
-    sprintf(buf, "data/%s.PKD", (const char*)gLevelInfo[id].data);
-
-    FILE *f = fopen(buf, "rb");
-
-    if (!f)
-        return NULL;
-
-    {
-        fseek(f, 0, SEEK_END);
-        int32 size = ftell(f);
-        fseek(f, 0, SEEK_SET);
-        uint8* data = new uint8[size];
-        fread(data, 1, size, f);
-        fclose(f);
-
-        levelData = data;
-    }
-
-// tracks
-    if (!TRACKS_AD4)
-    {
-        FILE *f = fopen("data/TRACKS.AD4", "rb");
-        if (!f)
-            return NULL;
-
-        fseek(f, 0, SEEK_END);
-        int32 size = ftell(f);
-        fseek(f, 0, SEEK_SET);
-        uint8* data = new uint8[size];
-        fread(data, 1, size, f);
-        fclose(f);
-
-        TRACKS_AD4 = data;
-    }
-
-    if (!TITLE_SCR)
-    {
-        FILE *f = fopen("data/TITLE.SCR", "rb");
-        if (!f)
-            return NULL;
-
-        fseek(f, 0, SEEK_END);
-        int32 size = ftell(f);
-        fseek(f, 0, SEEK_SET);
-        uint8* data = new uint8[size];
-        fread(data, 1, size, f);
-        fclose(f);
-
-        TITLE_SCR = data;
-    }
-    
-    return (void*)levelData;
-}
-
 int main(void)
 {
     RECT r = { 0, 0, WND_WIDTH, WND_HEIGHT };
@@ -315,6 +415,141 @@ int main(void)
 
     return 0;
 }
+#elif defined(__GBA_LINUX__)
+uint32 g_timer;
+
+int32 osGetSystemTimeMS()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return int32(t.tv_sec * 1000 + t.tv_nsec / 1000000);
+}
+
+uint32 osGetSystemTimeUS()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return uint32(t.tv_sec * 1000000 + t.tv_nsec / 1000);
+}
+
+// headless host: renders into fb, no window, sound or input
+void saveFrame(const char* fileName)
+{
+    FILE* f = fopen(fileName, "wb");
+    if (!f) return;
+
+    fprintf(f, "P6\n%d %d\n255\n", FRAME_WIDTH, FRAME_HEIGHT);
+    for (int32 i = 0; i < FRAME_WIDTH * FRAME_HEIGHT; i++)
+    {
+        uint16 c = MEM_PAL_BG[((uint8*)fb)[i]];
+        uint8 rgb[3] = { uint8((c & 31) << 3), uint8(((c >> 5) & 31) << 3), uint8(((c >> 10) & 31) << 3) };
+        fwrite(rgb, 1, 3, f);
+    }
+    fclose(f);
+}
+
+#ifdef PROFILE_STAGETIME // -DPROFILING -DPROFILE_STAGETIME
+#define BENCH_ANGLES    8
+
+// replays a camera path through every room of the level: the camera is placed
+// at the room center and turned around in BENCH_ANGLES steps, one frame per step
+void benchLevel(LevelID id)
+{
+    gLevelID = id;
+    startLevel(id);
+
+    Camera camera;
+    memset(&camera, 0, sizeof(camera));
+
+    uint32 total[CNT_MAX];
+    uint32 peak[CNT_MAX];
+    memset(total, 0, sizeof(total));
+    memset(peak, 0, sizeof(peak));
+
+    int32 frames = 0;
+
+    for (int32 i = 0; i < level.roomsCount; i++)
+    {
+        Room* room = rooms + i;
+        const RoomInfo* info = room->info;
+
+        camera.view.room = room;
+        camera.view.pos.x = (info->x << 8) + (info->xSectors << 9);
+        camera.view.pos.y = (info->yTop + info->yBottom) >> 1;
+        camera.view.pos.z = (info->z << 8) + (info->zSectors << 9);
+
+        for (int32 j = 0; j < BENCH_ANGLES; j++)
+        {
+            PROFILE_CLEAR();
+
+            setViewport(RectMinMax(0, 0, FRAME_WIDTH, FRAME_HEIGHT));
+            clear();
+            matrixSetView(camera.view.pos, 0, j * (ANGLE_360 / BENCH_ANGLES));
+            drawRooms(&camera);
+            flush();
+
+            printf("%s,%d,%d", (const char*)gLevelInfo[id].data, i, j);
+            for (int32 k = 0; k < CNT_MAX; k++)
+            {
+                printf(",%u", gCounters[k]);
+                total[k] += gCounters[k];
+                if (gCounters[k] > peak[k]) {
+                    peak[k] = gCounters[k];
+                }
+            }
+            printf("\n");
+
+            frames++;
+        }
+    }
+
+    if (!frames)
+        return;
+
+    static const char* names[] = { "transform", "add", "flush", "vert", "poly" };
+
+    printf("# %s: %d frames\n", (const char*)gLevelInfo[id].data, frames);
+    for (int32 k = 0; k < CNT_MAX; k++)
+    {
+        printf("#   %-10s avg %8u max %8u\n", names[k], total[k] / frames, peak[k]);
+    }
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    sndInit();
+
+    gameInit();
+
+#ifdef PROFILE_STAGETIME
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        printf("level,room,angle,transform_us,add_us,flush_us,vertices,polygons\n");
+        for (int32 i = 0; i < LVL_MAX; i++)
+        {
+            benchLevel(LevelID(i));
+        }
+        gameFree();
+        return 0;
+    }
+#endif
+
+    // run the game loop for the given number of frames and save the last one
+    int32 frames = (argc > 1) ? atoi(argv[1]) : 300;
+
+    for (int32 i = 0; i < frames; i++)
+    {
+        gameUpdate(1);
+        gameRender();
+    }
+
+    saveFrame("frame.ppm");
+
+    gameFree();
+
+    return 0;
+}
 #else
 void osSetPalette(const uint16* palette)
 {
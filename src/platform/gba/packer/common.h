@@ -4,8 +4,19 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <ctype.h>
 #include <algorithm>
-#include <windows.h>
+#include <atomic>
+#include <thread>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <dirent.h>
+    #include <sys/stat.h>
+    #include <signal.h>
+    #define DebugBreak() raise(SIGTRAP)
+#endif
 
 #include "libimagequant.h"
 
@@ -43,6 +54,7 @@ inline void swap(T &a, T &b) {
 #define MAX(a,b) ((a) > (b) ? (a) : (b))
 #define CLAMP(x, a, b) ((x) < (a) ? (a) : ((x) > (b) ? (b) : (x)))
 #define ALIGN(x, a) (((x) + ((a) - 1)) & ~((a) - 1))
+#define FOURCC(str) uint32( ((uint8*)(str))[0] | (((uint8*)(str))[1] << 8) | (((uint8*)(str))[2] << 16) | (((uint8*)(str))[3] << 24) )
 
 struct FileStream
 {
@@ -566,34 +578,252 @@ struct vec3i
     int32 x, y, z;
 };
 
-void launchApp(const char* cmdline)
+bool hasExt(const char* fileName, const char* ext)
+{
+    int32 len = (int32)strlen(fileName);
+    int32 extLen = (int32)strlen(ext);
+
+    if (len < extLen)
+        return false;
+
+    const char* str = fileName + len - extLen;
+
+    for (int32 i = 0; i < extLen; i++)
+    {
+        if (tolower(str[i]) != tolower(ext[i]))
+            return false;
+    }
+
+    return true;
+}
+
+// track index from the digits of the file name, e.g. "track_26_EN.ogg" -> 26
+int32 getTrackIndex(const char* fileName)
+{
+    const char* ext = strrchr(fileName, '.');
+    const char* end = ext ? ext : fileName + strlen(fileName);
+
+    int32 index = 0;
+    for (const char* c = fileName; c < end; c++)
+    {
+        if (*c >= '0' && *c <= '9')
+        {
+            index = index * 10 + (*c - '0');
+        }
+    }
+
+    return index;
+}
+
+typedef void (*FileProc)(const char* dir, const char* name, void* userData);
+
+// calls proc for every regular file in dir with the given extension ("" for any)
+void findFiles(const char* dir, const char* ext, FileProc proc, void* userData)
+{
+#ifdef _WIN32
+    char buf[256];
+    sprintf(buf, "%s/*%s", dir, ext);
+
+    WIN32_FIND_DATA fd;
+    HANDLE h = FindFirstFile(buf, &fd);
+
+    if (h == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        {
+            proc(dir, fd.cFileName, userData);
+        }
+    }
+    while (FindNextFile(h, &fd));
+    FindClose(h);
+#else
+    DIR* d = opendir(dir);
+
+    if (!d)
+        return;
+
+    dirent* e;
+    while ((e = readdir(d)) != NULL)
+    {
+        char buf[256];
+        sprintf(buf, "%s/%s", dir, e->d_name);
+
+        struct stat st;
+        if (stat(buf, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+
+        if (hasExt(e->d_name, ext))
+        {
+            proc(dir, e->d_name, userData);
+        }
+    }
+    closedir(d);
+#endif
+}
+
+typedef void (*TaskProc)(int32 index, void* userData);
+
+// runs proc for every index in [0..count) on all hardware threads
+void parallelFor(int32 count, TaskProc proc, void* userData)
+{
+    int32 threadsCount = MIN(count, MAX(1, int32(std::thread::hardware_concurrency())));
+
+    std::atomic<int32> next(0);
+
+    std::thread* threads = new std::thread[threadsCount];
+
+    for (int32 i = 0; i < threadsCount; i++)
+    {
+        threads[i] = std::thread([&]() {
+            int32 index;
+            while ((index = next++) < count)
+            {
+                proc(index, userData);
+            }
+        });
+    }
+
+    for (int32 i = 0; i < threadsCount; i++)
+    {
+        threads[i].join();
+    }
+
+    delete[] threads;
+}
+
+#define PACKER_VERSION  1   // bump to invalidate the manifests on output format changes
+#define MAX_MANIFEST    64
+
+// FNV-1a
+uint64 hashData(const void* data, int32 size, uint64 hash = 0xCBF29CE484222325ULL)
+{
+    const uint8* ptr = (const uint8*)data;
+
+    for (int32 i = 0; i < size; i++)
+    {
+        hash ^= ptr[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+uint64 hashFile(const char* fileName, uint64 hash = 0xCBF29CE484222325ULL)
 {
-    STARTUPINFOA si;
-    PROCESS_INFORMATION pi;
-
-    memset(&si, 0, sizeof(si));
-    memset(&pi, 0, sizeof(pi));
-    si.cb = sizeof(si);
-
-    CreateProcess(
-        NULL,
-        (char*)cmdline,
-        NULL,
-        NULL,
-        FALSE,
-        0,
-        NULL,
-        NULL,
-        &si,
-        &pi
-    );
-
-    WaitForSingleObject(pi.hProcess, INFINITE);
-
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
+    FILE* f = fopen(fileName, "rb");
+
+    if (!f)
+        return hash;
+
+    uint8 data[64 * 1024];
+    size_t size;
+    while ((size = fread(data, 1, sizeof(data), f)) > 0)
+    {
+        hash = hashData(data, int32(size), hash);
+    }
+
+    fclose(f);
+
+    return hash;
 }
 
+// content hashes of the packed outputs, unchanged sources are skipped on rebuild
+struct Manifest
+{
+    struct Entry
+    {
+        char   name[64];
+        uint64 hash;
+    };
+
+    char   fileName[256];
+    Entry  entries[MAX_MANIFEST];
+    int32  count;
+
+    Manifest(const char* dir) : count(0)
+    {
+        sprintf(fileName, "%s/MANIFEST.TXT", dir);
+
+        FILE* f = fopen(fileName, "rb");
+
+        if (!f)
+            return;
+
+        unsigned long long hash;
+        while (count < MAX_MANIFEST && fscanf(f, "%63s %llx", entries[count].name, &hash) == 2)
+        {
+            entries[count++].hash = hash;
+        }
+
+        fclose(f);
+    }
+
+    Entry* find(const char* name)
+    {
+        for (int32 i = 0; i < count; i++)
+        {
+            if (strcmp(entries[i].name, name) == 0)
+                return entries + i;
+        }
+        return NULL;
+    }
+
+    // name is the output file, it must exist in the manifest directory
+    bool isValid(const char* dir, const char* name, uint64 hash)
+    {
+        Entry* e = find(name);
+
+        if (!e || e->hash != hash)
+            return false;
+
+        char buf[256];
+        sprintf(buf, "%s/%s", dir, name);
+
+        FILE* f = fopen(buf, "rb");
+
+        if (!f)
+            return false;
+
+        fclose(f);
+        return true;
+    }
+
+    void set(const char* name, uint64 hash)
+    {
+        Entry* e = find(name);
+
+        if (!e)
+        {
+            ASSERT(count < MAX_MANIFEST);
+            e = entries + count++;
+            strcpy(e->name, name);
+        }
+
+        e->hash = hash;
+    }
+
+    void save()
+    {
+        FILE* f = fopen(fileName, "wb");
+
+        if (!f)
+        {
+            printf("can't save \"%s\"\n", fileName);
+            return;
+        }
+
+        for (int32 i = 0; i < count; i++)
+        {
+            fprintf(f, "%s %016llx\n", entries[i].name, (unsigned long long)entries[i].hash);
+        }
+
+        fclose(f);
+    }
+};
+
 struct _BITMAPFILEHEADER {
     uint32  bfSize;
     uint16  bfReserved1;
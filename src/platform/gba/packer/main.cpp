@@ -47,33 +47,100 @@ void dumpLightmap(const char* fileName, TR1_PC* level)
     saveBitmap(fileName, (uint8*)data, 256, 32 + 2, 32);
 }
 
+uint64 getLevelHash(const char* target, int32 index)
+{
+    int32 version = PACKER_VERSION;
+    uint64 hash = hashData(&version, sizeof(version));
+    hash = hashData(target, (int32)strlen(target), hash);
+
+    char fileName[64];
+    sprintf(fileName, "TR1_PC/DATA/%s.PHD", levelNames[index]);
+    hash = hashFile(fileName, hash);
+
+    if (index == LVL_TR1_TITLE) {
+        hash = hashFile("screens/TITLE.bmp", hash);
+    }
+
+    return hash;
+}
+
+void loadLevel(int32 index, void* userData)
+{
+    bool* dirty = (bool*)userData;
+
+    if (!dirty[index])
+        return;
+
+    char fileName[64];
+    sprintf(fileName, "TR1_PC/DATA/%s.PHD", levelNames[index]);
+
+    FileStream f(fileName, false);
+
+    if (f.isValid()) {
+        pc[index] = new TR1_PC(f, LevelID(index));
+        pc[index]->generateLODs();
+        pc[index]->cutData();
+    } else {
+        printf("can't open \"%s\"", fileName);
+    }
+}
+
 int main(int argc, char** argv)
 {
     if (argc < 3) {
-        printf("usage: packer.exe [gba|3do] directory\n");
+        printf("usage: packer.exe [gba|3do|32x] directory\n");
+        printf("       packer.exe tracks [gba|3do] [source directory]\n");
         return 0;
     }
 
+    if (strcmp(argv[1], "tracks") == 0)
+    {
+        const char* from = (argc > 3) ? argv[3] : "tracks/orig";
+
+        if (strcmp(argv[2], "gba") == 0)
+        {
+            out_GBA* out = new out_GBA();
+            out->encodeTracks(from);
+            delete out;
+        }
+
+        if (strcmp(argv[2], "3do") == 0)
+        {
+            convertTracks3DO(from, "../../3do/tracks");
+        }
+
+        return 0;
+    }
+
+    // levels with unchanged sources and packer version are not loaded and skipped by the converters
+    Manifest manifest(argv[2]);
+
+    uint64 hashes[LVL_MAX];
+    bool dirty[LVL_MAX];
+    int32 dirtyCount = 0;
+
     for (int32 i = 0; i < LVL_MAX; i++)
     {
         char fileName[64];
-
-        { // load PC level
-            sprintf(fileName, "TR1_PC/DATA/%s.PHD", levelNames[i]);
-
-            FileStream f(fileName, false);
-        
-            if (f.isValid()) {
-                pc[i] = new TR1_PC(f, LevelID(i));
-                pc[i]->generateLODs();
-                pc[i]->cutData();
-            } else {
-                printf("can't open \"%s\"", fileName);
-            }
+        sprintf(fileName, "%s.PKD", levelNames[i]);
+
+        hashes[i] = getLevelHash(argv[1], i);
+        dirty[i] = !manifest.isValid(argv[2], fileName, hashes[i]);
+    #ifdef GBA_WAD
+        dirty[i] = true; // all levels share the textures
+    #endif
+        if (dirty[i]) {
+            dirtyCount++;
         }
     }
 
-    dumpLightmap("lightmap.bmp", pc[LVL_TR1_1]);
+    printf("levels: %d of %d changed\n", dirtyCount, LVL_MAX);
+
+    parallelFor(LVL_MAX, loadLevel, dirty);
+
+    if (pc[LVL_TR1_1]) {
+        dumpLightmap("lightmap.bmp", pc[LVL_TR1_1]);
+    }
 
     if (strcmp(argv[1], "gba") == 0)
     {
@@ -98,8 +165,16 @@ int main(int argc, char** argv)
 
     for (int32 i = 0; i < LVL_MAX; i++)
     {
+        if (pc[i])
+        {
+            char fileName[64];
+            sprintf(fileName, "%s.PKD", levelNames[i]);
+            manifest.set(fileName, hashes[i]);
+        }
         delete pc[i];
     }
 
+    manifest.save();
+
     return 0;
 }
@@ -2144,69 +2144,57 @@ struct out_32X
         header.write(f);
     }
 
-    void convertTracks(FileStream &f, const char* from)
+    struct Track {
+        int32 size;
+        char* data;
+    };
+
+    static void loadTrack(const char* dir, const char* name, void* userData)
     {
-        char buf[256];
-        sprintf(buf, "%s/*.ima", from);
+        Track* tracks = (Track*)userData;
 
-        WIN32_FIND_DATA fd;
-        HANDLE h = FindFirstFile(buf, &fd);
+        int32 index = getTrackIndex(name);
 
-        if (h == INVALID_HANDLE_VALUE)
+        if (index <= 0 || index >= MAX_TRACKS)
             return;
 
-        struct Track {
-            int32 size;
-            char* data;
-        };
-        Track tracks[MAX_TRACKS];
-        memset(tracks, 0, sizeof(tracks));
+        char buf[256];
+        sprintf(buf, "%s/%s", dir, name);
 
-        do
-        {
-            if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
-            {
-                const char* src = fd.cFileName;
-                char* dst = buf;
+        FILE* f = fopen(buf, "rb");
 
-                while (*src)
-                {
-                    if (*src >= '0' && *src <= '9')
-                    {
-                        *dst++ = *src;
-                    }
-                    src++;
-                }
-                *dst++ = 0;
-
-                int32 index = atoi(buf);
+        if (!f)
+            return;
 
-                if (index != 0)
-                {
-                    strcpy(buf, from);
-                    strcat(buf, "/");
-                    strcat(buf, fd.cFileName);
+        fseek(f, 0, SEEK_END);
+        int32 size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        tracks[index].data = new char[size + 4];
+        fread(tracks[index].data, 1, size, f);
+        fclose(f);
 
-                    FILE* f = fopen(buf, "rb");
+        tracks[index].size = ALIGN(*((int32*)tracks[index].data + 2), 4) - 4;
 
-                    if (!f)
-                        continue;
+        ASSERT(tracks[index].size % 4 == 0);
+    }
 
-                    fseek(f, 0, SEEK_END);
-                    int32 size = ftell(f);
-                    fseek(f, 0, SEEK_SET);
-                    tracks[index].data = new char[size + 4];
-                    fread(tracks[index].data, 1, size, f);
-                    fclose(f);
+    void convertTracks(FileStream &f, const char* from)
+    {
+        Track tracks[MAX_TRACKS];
+        memset(tracks, 0, sizeof(tracks));
 
-                    tracks[index].size = ALIGN(*((int32*)tracks[index].data + 2), 4) - 4;
+        findFiles(from, ".ima", loadTrack, tracks);
 
-                    ASSERT(tracks[index].size % 4 == 0);
-                }
+        int32 count = 0;
+        for (int32 i = 0; i < MAX_TRACKS; i++)
+        {
+            if (tracks[i].size) {
+                count++;
             }
         }
-        while (FindNextFile(h, &fd));
-        FindClose(h);
+
+        if (!count)
+            return;
 
         int32 offset = MAX_TRACKS * (4 + 4);
 
@@ -2329,28 +2317,44 @@ struct out_32X
         }    
     }
 
-    void process(const char* dir, TR1_PC** pc, TR1_PSX** psx)
+    struct LevelJobs
     {
-        roomVerticesCount = 0;
-        roomVertices = new RoomVertex[MAX_ROOM_VERTICES];
+        const char* dir;
+        TR1_PC** pc;
+    };
 
-        char buf[256];
+    // every level gets its own converter state, skipped (unchanged) levels are NULL
+    static void convertLevel(int32 index, void* userData)
+    {
+        LevelJobs* jobs = (LevelJobs*)userData;
 
-        for (int32 i = 0; i < LVL_MAX; i++)
-        {
-            sprintf(buf, "%s/%s.PKD", dir, levelNames[i]);
-            FileStream f(buf, true);
-            f.bigEndian = true;
-            
-            if (!f.isValid()) {
-                printf("can't save \"%s\"\n", buf);
-                continue;
-            }
+        if (!jobs->pc[index])
+            return;
+
+        char buf[256];
+        sprintf(buf, "%s/%s.PKD", jobs->dir, levelNames[index]);
+        FileStream f(buf, true);
+        f.bigEndian = true;
 
-            convert32X(f, pc[i]);
+        if (!f.isValid()) {
+            printf("can't save \"%s\"\n", buf);
+            return;
         }
 
-        delete[] roomVertices;
+        out_32X* out = new out_32X();
+        out->roomVerticesCount = 0;
+        out->roomVertices = new RoomVertex[MAX_ROOM_VERTICES];
+        out->convert32X(f, jobs->pc[index]);
+        delete[] out->roomVertices;
+        delete out;
+    }
+
+    void process(const char* dir, TR1_PC** pc, TR1_PSX** psx)
+    {
+        LevelJobs jobs;
+        jobs.dir = dir;
+        jobs.pc  = pc;
+        parallelFor(LVL_MAX, convertLevel, &jobs);
     }
 };
 
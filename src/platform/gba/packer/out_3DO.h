@@ -4,6 +4,7 @@
 #include "common.h"
 #include "TR1_PC.h"
 #include "TR1_PSX.h"
+#include "tracks.h"
 
 // TODO use PSX format as source
 struct out_3DO
@@ -2545,6 +2546,12 @@ struct LevelPC
 #define COLOR_THRESHOLD_SQ (8 * 8)
 #endif
 
+// source tracks (ogg/mp3/wav) -> outDir/<index>.aiff (mono 22050 Hz PCM s16be)
+void convertTracks3DO(const char* inDir, const char* outDir)
+{
+    encodeTracks(inDir, outDir, TRACK_AIFF, 22050, 0.0f); // TODO SDX2 encoder
+}
+
 
 #if 0
 struct WAD
@@ -3004,81 +3011,6 @@ struct WAD
 };
 
 
-void convertTracks3DO(const char* inDir, const char* outDir)
-{
-    WIN32_FIND_DATA fd;
-    HANDLE h = FindFirstFile(inDir, &fd);
-
-    if (h == INVALID_HANDLE_VALUE)
-        return;
-
-    char buf[256];
-
-    do
-    {
-        if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
-        {
-            const char* src = fd.cFileName;
-            char* dst = buf;
-
-            while (*src)
-            {
-                if (*src >= '0' && *src <= '9')
-                {
-                    *dst++ = *src;
-                }
-                src++;
-            }
-            *dst++ = 0;
-
-            int32 index = atoi(buf);
-
-            if (index != 0)
-            {
-                strcpy(buf, inDir);
-                buf[strlen(buf) - 1] = 0;
-                strcat(buf, fd.cFileName);
-
-                char cmdline[256];
-                sprintf(cmdline, "C:\\Program Files\\ffmpeg\\ffmpeg.exe -y -i \"%s\" -ac 1 -ar 22050 -acodec pcm_s16be %s\\%d.aiff", buf, outDir, index);
-
-                launchApp(cmdline);
-                /* TODO SDXC encoder
-                FILE* f = fopen("tmp.wav", "rb");
-                ASSERT(f);
-
-                fseek(f, 0, SEEK_END);
-                int32 size = ftell(f);
-                fseek(f, 0, SEEK_SET);
-                uint8* samples = new uint8[size];
-                fread(samples, 1, size, f);
-                fclose(f);
-
-                int32 numSamples = size / sizeof(short);
-
-                int32 outputSize = (size + 3) / 4;
-                uint8* output = new uint8[outputSize];
-                memset(output, 0, outputSize);
-
-                BlockADDVIEncode(output, (short*)samples, numSamples, 1); // mono block
-
-                sprintf(buf, "%s\\%d.S", outDir, index);
-                f = fopen(buf, "wb");
-                ASSERT(f);
-                fwrite(&numSamples, sizeof(numSamples), 1, f);
-                fwrite(output, 1, outputSize, f);
-                fclose(f);
-
-                delete[] output;
-                delete[] samples;
-                */
-            }
-        }
-    }
-    while (FindNextFile(h, &fd));
-    FindClose(h);
-}
-
 
 
 // 3DO face flags
@@ -3129,7 +3061,7 @@ void process3DO(const char* dir, TR1_PC* pc, TR1_PSX* psx)
 
 //    saveBitmap("pal.bmp", (uint8*)palDump, 256, 32, 32);
 
-//    convertTracks3DO("C:\\Projects\\OpenLara\\src\\platform\\gba\\packer\\tracks\\orig\\*", "C:\\Projects\\OpenLara\\src\\platform\\3do\\tracks");
+//    convertTracks3DO("tracks/orig", "../../3do/tracks");
 
 
 /*
@@ -4,6 +4,7 @@
 #include "common.h"
 #include "TR1_PC.h"
 #include "TR1_PSX.h"
+#include "tracks.h"
 
 struct out_GBA
 {
@@ -2186,69 +2187,56 @@ struct out_GBA
         header.write(f);
     }
 
-    void convertTracks(FileStream &f, const char* from)
+    struct Track {
+        int32 size;
+        uint8* data;
+    };
+
+    static void loadTrack(const char* dir, const char* name, void* userData)
     {
-        char buf[256];
-        sprintf(buf, "%s/*.ad4", from);
+        Track* tracks = (Track*)userData;
 
-        WIN32_FIND_DATA fd;
-        HANDLE h = FindFirstFile(buf, &fd);
+        int32 index = getTrackIndex(name);
 
-        if (h == INVALID_HANDLE_VALUE)
+        if (index <= 0 || index >= MAX_TRACKS)
             return;
 
-        struct Track {
-            int32 size;
-            uint8* data;
-        };
-        Track tracks[MAX_TRACKS];
-        memset(tracks, 0, sizeof(tracks));
-
-        do
-        {
-            if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
-            {
-                const char* src = fd.cFileName;
-                const char* srcEnd = strrchr(src, '.');
-                char* dst = buf;
+        char buf[256];
+        sprintf(buf, "%s/%s", dir, name);
 
-                while (src < srcEnd)
-                {
-                    if (*src >= '0' && *src <= '9')
-                    {
-                        *dst++ = *src;
-                    }
-                    src++;
-                }
-                *dst++ = 0;
+        FILE* f = fopen(buf, "rb");
 
-                int32 index = atoi(buf);
+        if (!f)
+            return;
 
-                if (index != 0)
-                {
-                    strcpy(buf, from);
-                    strcat(buf, "/");
-                    strcat(buf, fd.cFileName);
+        fseek(f, 0, SEEK_END);
+        int32 size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        tracks[index].data = new uint8[size];
+        fread(tracks[index].data, 1, size, f);
+        fclose(f);
 
-                    FILE* f = fopen(buf, "rb");
+        tracks[index].size = size; // ad4 tool encodes 32-bit chunks, so no need to align
+        ASSERT(tracks[index].size % 4 == 0);
+    }
 
-                    if (!f)
-                        continue;
+    void convertTracks(FileStream &f, const char* from)
+    {
+        Track tracks[MAX_TRACKS];
+        memset(tracks, 0, sizeof(tracks));
 
-                    fseek(f, 0, SEEK_END);
-                    int32 size = ftell(f);
-                    fseek(f, 0, SEEK_SET);
-                    tracks[index].data = new uint8[size];
-                    fread(tracks[index].data, 1, size, f);
-                    fclose(f);
+        findFiles(from, ".ad4", loadTrack, tracks);
 
-                    tracks[index].size = size; // ad4 tool encodes 32-bit chunks, so no need to align
-                    ASSERT(tracks[index].size % 4 == 0);
-                }
+        int32 count = 0;
+        for (int32 i = 0; i < MAX_TRACKS; i++)
+        {
+            if (tracks[i].size) {
+                count++;
             }
         }
-        while (FindNextFile(h, &fd));
-        FindClose(h);
+
+        if (!count)
+            return;
 
         int32 offset = MAX_TRACKS * (4 + 4);
 
@@ -2273,6 +2261,50 @@ struct out_GBA
         }
     }
 
+    static void copyDemoTrack(const char* dir, const char* name, void* userData)
+    {
+        static const int32 demoTracks[] = {
+            3, 4, 8, 9, 11, 12, 13, 16,
+            26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40, 41, 42, 43,
+            45, 47, 48, 49, 50
+        };
+
+        int32 index = getTrackIndex(name);
+
+        for (int32 i = 0; i < int32(sizeof(demoTracks) / sizeof(demoTracks[0])); i++)
+        {
+            if (demoTracks[i] != index)
+                continue;
+
+            char buf[256];
+            sprintf(buf, "%s/%s", dir, name);
+            FILE* src = fopen(buf, "rb");
+            sprintf(buf, "%s/%s", (const char*)userData, name);
+            FILE* dst = fopen(buf, "wb");
+
+            if (src && dst)
+            {
+                uint8 data[64 * 1024];
+                size_t size;
+                while ((size = fread(data, 1, sizeof(data), src)) > 0)
+                {
+                    fwrite(data, 1, size, dst);
+                }
+            }
+
+            if (src) fclose(src);
+            if (dst) fclose(dst);
+            break;
+        }
+    }
+
+    // source tracks (ogg/mp3/wav) -> tracks/conv/*.ad4 (mono 10512 Hz, -0.8 dB) + demo subset in tracks/conv_demo
+    void encodeTracks(const char* from)
+    {
+        ::encodeTracks(from, "tracks/conv", TRACK_AD4, 10512, -0.8f);
+        findFiles("tracks/conv", ".ad4", copyDemoTrack, (void*)"tracks/conv_demo");
+    }
+
     void convertScreen(const char* dir, const char* name, const TR1_PC::Palette &pal)
     {
         char path[256];
@@ -2717,6 +2749,37 @@ struct out_GBA
 
     //#define GBA_WAD
 
+    struct LevelJobs
+    {
+        const char* dir;
+        TR1_PC** pc;
+    };
+
+    // every level gets its own converter state, skipped (unchanged) levels are NULL
+    static void convertLevel(int32 index, void* userData)
+    {
+        LevelJobs* jobs = (LevelJobs*)userData;
+
+        if (!jobs->pc[index])
+            return;
+
+        char buf[256];
+        sprintf(buf, "%s/%s.PKD", jobs->dir, levelNames[index]);
+        FileStream f(buf, true);
+
+        if (!f.isValid()) {
+            printf("can't save \"%s\"\n", buf);
+            return;
+        }
+
+        out_GBA* out = new out_GBA();
+        out->roomVerticesCount = 0;
+        out->roomVertices = new RoomVertex[MAX_ROOM_VERTICES];
+        out->convertGBA(f, jobs->pc[index]);
+        delete[] out->roomVertices;
+        delete out;
+    }
+
     void process(const char* dir, TR1_PC** pc, TR1_PSX** psx)
     {
         roomVerticesCount = 0;
@@ -2734,21 +2797,15 @@ struct out_GBA
 
         convertWAD(f, pc, psx);
     #else
-        for (int32 i = 0; i < LVL_MAX; i++)
-        {
-            sprintf(buf, "%s/%s.PKD", dir, levelNames[i]);
-            FileStream f(buf, true);
-            
-            if (!f.isValid()) {
-                printf("can't save \"%s\"\n", buf);
-                continue;
-            }
-
-            convertGBA(f, pc[i]);
-        }
+        LevelJobs jobs;
+        jobs.dir = dir;
+        jobs.pc  = pc;
+        parallelFor(LVL_MAX, convertLevel, &jobs);
 
         // title screen
-        convertScreen(dir, "TITLE", pc[LVL_TR1_TITLE]->palette);
+        if (pc[LVL_TR1_TITLE]) {
+            convertScreen(dir, "TITLE", pc[LVL_TR1_TITLE]->palette);
+        }
 
         // audio tracks
         {
@@ -0,0 +1,383 @@
+#ifndef H_TRACKS
+#define H_TRACKS
+
+#include "common.h"
+
+#include "ad4/AD4.h"
+#include "../../../libs/minimp3/minimp3.cpp"
+#include "../../../libs/stb_vorbis/stb_vorbis.c"
+
+// in-process soundtrack conversion (replaces the ffmpeg/poly2mono/ad4 tool chain)
+// source tracks: ogg, mp3 or 16-bit PCM wav, one job per track
+
+enum TrackFormat
+{
+    TRACK_AD4,      // GBA, raw AD4 frames
+    TRACK_AIFF      // 3DO, mono PCM s16be
+};
+
+struct TrackJob
+{
+    char        src[256];
+    char        dst[256];
+    TrackFormat format;
+    int32       rate;
+    float       gain;
+    bool        done;
+};
+
+struct TrackJobList
+{
+    TrackJob*   jobs;
+    int32       count;
+    const char* outDir;
+    TrackFormat format;
+    int32       rate;
+    float       gain;
+};
+
+int16* decodeWAV(const char* fileName, int32 &channels, int32 &rate, int32 &count)
+{
+    FILE* f = fopen(fileName, "rb");
+    if (!f)
+        return NULL;
+
+    int16* data = NULL;
+    count = 0;
+
+    struct Chunk {
+        uint32 id;
+        uint32 size;
+    } chunk;
+
+    uint32 type;
+    fread(&chunk, sizeof(chunk), 1, f);
+    fread(&type, sizeof(type), 1, f);
+
+    if (chunk.id != FOURCC("RIFF") || type != FOURCC("WAVE")) {
+        fclose(f);
+        return NULL;
+    }
+
+    int32 bits = 0;
+
+    while (fread(&chunk, sizeof(chunk), 1, f) == 1)
+    {
+        if (chunk.id == FOURCC("fmt "))
+        {
+            uint8 fmt[16];
+            fread(fmt, 1, 16, f);
+            fseek(f, chunk.size - 16, SEEK_CUR);
+            channels = *(uint16*)(fmt + 2);
+            rate     = *(uint32*)(fmt + 4);
+            bits     = *(uint16*)(fmt + 14);
+        }
+        else if (chunk.id == FOURCC("data"))
+        {
+            if (bits != 16 || !channels)
+                break;
+            count = chunk.size / (2 * channels);
+            data = new int16[count * channels];
+            count = int32(fread(data, 2 * channels, count, f));
+            break;
+        }
+        else
+        {
+            fseek(f, (chunk.size + 1) & ~1, SEEK_CUR);
+        }
+    }
+
+    fclose(f);
+    return data;
+}
+
+int16* decodeMP3(const char* fileName, int32 &channels, int32 &rate, int32 &count)
+{
+    FILE* f = fopen(fileName, "rb");
+    if (!f)
+        return NULL;
+
+    fseek(f, 0, SEEK_END);
+    int32 size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8* src = new uint8[size];
+    fread(src, 1, size, f);
+    fclose(f);
+
+    int32 capacity = 1024 * 1024;
+    int16* data = (int16*)malloc(capacity * sizeof(int16));
+    int32 length = 0;
+
+    mp3_decoder_t dec = mp3_create();
+    mp3_info_t info;
+    int16 frame[1152 * 2];
+
+    channels = 0;
+    int32 pos = 0;
+    while (pos < size)
+    {
+        int32 bytes = mp3_decode(dec, src + pos, size - pos, frame, &info);
+        if (!bytes)
+            break;
+        pos += bytes;
+
+        int32 frameCount = info.audio_bytes / sizeof(int16);
+        if (!frameCount)
+            continue;
+
+        if (!channels) {
+            channels = info.channels;
+            rate     = info.sample_rate;
+        }
+
+        if (length + frameCount > capacity) {
+            capacity *= 2;
+            data = (int16*)realloc(data, capacity * sizeof(int16));
+        }
+        memcpy(data + length, frame, frameCount * sizeof(int16));
+        length += frameCount;
+    }
+
+    mp3_done(dec);
+    delete[] src;
+
+    if (!channels) {
+        free(data);
+        return NULL;
+    }
+
+    int16* result = new int16[length];
+    memcpy(result, data, length * sizeof(int16));
+    free(data);
+
+    count = length / channels;
+    return result;
+}
+
+int16* decodeOGG(const char* fileName, int32 &channels, int32 &rate, int32 &count)
+{
+    int16* output;
+    count = stb_vorbis_decode_filename(fileName, &channels, &rate, &output);
+    if (count <= 0)
+        return NULL;
+
+    int16* result = new int16[count * channels];
+    memcpy(result, output, count * channels * sizeof(int16));
+    free(output);
+    return result;
+}
+
+// mono downmix and box-filtered resampling to the target rate
+int16* decodeTrack(const char* fileName, int32 rate, float gain, int32 &count)
+{
+    int32 channels = 0, srcRate = 0, srcCount = 0;
+    int16* src = NULL;
+
+    if (hasExt(fileName, ".ogg")) {
+        src = decodeOGG(fileName, channels, srcRate, srcCount);
+    } else if (hasExt(fileName, ".mp3")) {
+        src = decodeMP3(fileName, channels, srcRate, srcCount);
+    } else if (hasExt(fileName, ".wav")) {
+        src = decodeWAV(fileName, channels, srcRate, srcCount);
+    }
+
+    if (!src || !channels || !srcRate) {
+        delete[] src;
+        return NULL;
+    }
+
+    count = int32(int64(srcCount) * rate / srcRate);
+    int16* dst = new int16[count];
+
+    float volume = powf(10.0f, gain / 20.0f);
+
+    for (int32 i = 0; i < count; i++)
+    {
+        int32 a = int32(int64(i) * srcRate / rate);
+        int32 b = int32(int64(i + 1) * srcRate / rate);
+        b = MIN(MAX(b, a + 1), srcCount);
+
+        int32 sum = 0;
+        for (int32 j = a; j < b; j++)
+        {
+            for (int32 c = 0; c < channels; c++)
+            {
+                sum += src[j * channels + c];
+            }
+        }
+
+        float value = float(sum) / float((b - a) * channels) * volume;
+        dst[i] = int16(CLAMP(value, -32768.0f, 32767.0f));
+    }
+
+    delete[] src;
+
+    return dst;
+}
+
+bool encodeAD4(const char* fileName, const int16* samples, int32 count)
+{
+    FILE* f = fopen(fileName, "wb");
+    if (!f)
+        return false;
+
+    AD4State_t state;
+    AD4_Init(&state);
+
+    int32 framesCount = (count + 7) / 8;
+    uint32* frames = new uint32[framesCount];
+
+    for (int32 i = 0; i < framesCount; i++)
+    {
+        int16 buffer[8]; // 1 frame = 8 samples
+        for (int32 j = 0; j < 8; j++)
+        {
+            int32 index = i * 8 + j;
+            buffer[j] = (index < count) ? samples[index] : 0;
+        }
+        frames[i] = AD4_EncodeFrame(&state, buffer);
+    }
+
+    fwrite(frames, sizeof(uint32), framesCount, f);
+    fclose(f);
+
+    delete[] frames;
+
+    if (state.MaxOutputLevel >= 32768) {
+        printf("%s: overflow by %u\n", fileName, state.MaxOutputLevel - 32767);
+    }
+
+    return true;
+}
+
+bool encodeAIFF(const char* fileName, const int16* samples, int32 count, int32 rate)
+{
+    FileStream f(fileName, true);
+    if (!f.isValid())
+        return false;
+
+    f.bigEndian = true;
+
+    // 80-bit IEEE 754 extended sample rate
+    uint8 ext[10];
+    memset(ext, 0, sizeof(ext));
+    int32 exp = 0;
+    while ((rate >> exp) > 1) exp++;
+    uint16 bias = uint16(16383 + exp);
+    uint32 mantissa = uint32(rate) << (31 - exp);
+    ext[0] = uint8(bias >> 8);
+    ext[1] = uint8(bias);
+    ext[2] = uint8(mantissa >> 24);
+    ext[3] = uint8(mantissa >> 16);
+    ext[4] = uint8(mantissa >> 8);
+    ext[5] = uint8(mantissa);
+
+    int32 dataSize = count * 2;
+
+    f.writeRaw(FOURCC("FORM"));
+    f.write(int32(4 + (8 + 18) + (8 + 8 + dataSize)));
+    f.writeRaw(FOURCC("AIFF"));
+
+    f.writeRaw(FOURCC("COMM"));
+    f.write(int32(18));
+    f.write(int16(1));      // channels
+    f.write(int32(count));  // frames
+    f.write(int16(16));     // bits
+    f.write(ext, 10);
+
+    f.writeRaw(FOURCC("SSND"));
+    f.write(int32(8 + dataSize));
+    f.write(int32(0));      // offset
+    f.write(int32(0));      // block size
+    f.write(samples, count);
+
+    return true;
+}
+
+void convertTrack(int32 index, void* userData)
+{
+    TrackJobList* list = (TrackJobList*)userData;
+    TrackJob &job = list->jobs[index];
+
+    int32 count;
+    int16* samples = decodeTrack(job.src, job.rate, job.gain, count);
+
+    if (!samples) {
+        printf("can't decode \"%s\"\n", job.src);
+        return;
+    }
+
+    switch (job.format)
+    {
+        case TRACK_AD4  : job.done = encodeAD4(job.dst, samples, count); break;
+        case TRACK_AIFF : job.done = encodeAIFF(job.dst, samples, count, job.rate); break;
+    }
+
+    delete[] samples;
+
+    if (!job.done) {
+        printf("can't save \"%s\"\n", job.dst);
+    }
+}
+
+void addTrackJob(const char* dir, const char* name, void* userData)
+{
+    TrackJobList* list = (TrackJobList*)userData;
+
+    if (!hasExt(name, ".ogg") && !hasExt(name, ".mp3") && !hasExt(name, ".wav"))
+        return;
+
+    if (list->count >= MAX_TRACKS)
+        return;
+
+    TrackJob &job = list->jobs[list->count++];
+    memset(&job, 0, sizeof(job));
+    job.format = list->format;
+    job.rate   = list->rate;
+    job.gain   = list->gain;
+
+    sprintf(job.src, "%s/%s", dir, name);
+
+    char base[256];
+    strcpy(base, name);
+    *strrchr(base, '.') = 0;
+
+    switch (list->format)
+    {
+        case TRACK_AD4  : sprintf(job.dst, "%s/%s.ad4", list->outDir, base); break;
+        case TRACK_AIFF : sprintf(job.dst, "%s/%d.aiff", list->outDir, getTrackIndex(name)); break;
+    }
+}
+
+int32 encodeTracks(const char* inDir, const char* outDir, TrackFormat format, int32 rate, float gain)
+{
+    TrackJobList list;
+    list.jobs   = new TrackJob[MAX_TRACKS];
+    list.count  = 0;
+    list.outDir = outDir;
+    list.format = format;
+    list.rate   = rate;
+    list.gain   = gain;
+
+    findFiles(inDir, "", addTrackJob, &list);
+
+    mp3_decode_init(); // shared decoder tables, must be ready before the workers start
+
+    parallelFor(list.count, convertTrack, &list);
+
+    int32 done = 0;
+    for (int32 i = 0; i < list.count; i++)
+    {
+        if (list.jobs[i].done) {
+            done++;
+        }
+    }
+
+    printf("tracks: %d of %d converted to \"%s\"\n", done, list.count, outDir);
+
+    delete[] list.jobs;
+
+    return done;
+}
+
+#endif
@@ -4,7 +4,19 @@
 #include "common.h"
 
 extern uint8 gLightmap[256 * 32];
-extern const uint8* gTile;
+
+#ifdef USE_TILED_FLUSH
+    // current screen band of the flushing thread, no band means the whole screen
+    extern X_TLS const uint8* gTile;
+    extern X_TLS const uint8* gBandMin;
+    extern X_TLS const uint8* gBandMax;
+
+    #define BAND_ROW(ptr)   (!gBandMax || ((const uint8*)(ptr) >= gBandMin && (const uint8*)(ptr) < gBandMax))
+#else
+    extern const uint8* gTile;
+
+    #define BAND_ROW(ptr)   true
+#endif
 
 #ifdef USE_ASM
     extern "C" {
@@ -45,6 +57,222 @@ extern const uint8* gTile;
     #define rasterizeLineV rasterizeLineV_c
     #define rasterizeFillS rasterizeFillS_c
 
+// host-only span kernels, the GBA and 32X keep the per-pair loops (or asm)
+#if !defined(__GBA__) && !defined(__32X__) && !defined(NO_SPAN_SIMD)
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define USE_SPAN_SIMD
+        #include <emmintrin.h>
+    #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        #define USE_SPAN_SIMD
+        #define USE_SPAN_NEON
+        #include <arm_neon.h>
+    #endif
+#endif
+
+#ifdef USE_SPAN_SIMD
+// 8 pixels (4 pairs) per step, every pixel gets exactly the same texel, lightmap row and
+// transparency test as in the per-pair loops, so the output stays bit-exact with the C path
+#define SPAN_STEP   8
+
+// tile offsets (t & 0xFF00) | (t >> 24) of 8 consecutive pixels
+X_INLINE void spanTexels(uint32 t, uint32 dtdx, uint32* offset)
+{
+#ifdef USE_SPAN_NEON
+    const uint32 init[4] = { t, t + dtdx, t + dtdx * 2, t + dtdx * 3 };
+    uint32x4_t t0 = vld1q_u32(init);
+    uint32x4_t t1 = vaddq_u32(t0, vdupq_n_u32(dtdx * 4));
+    uint32x4_t mask = vdupq_n_u32(0xFF00);
+    vst1q_u32(offset + 0, vorrq_u32(vandq_u32(t0, mask), vshrq_n_u32(t0, 24)));
+    vst1q_u32(offset + 4, vorrq_u32(vandq_u32(t1, mask), vshrq_n_u32(t1, 24)));
+#else
+    __m128i t0 = _mm_setr_epi32(t, t + dtdx, t + dtdx * 2, t + dtdx * 3);
+    __m128i t1 = _mm_add_epi32(t0, _mm_set1_epi32(dtdx * 4));
+    __m128i mask = _mm_set1_epi32(0xFF00);
+    _mm_storeu_si128((__m128i*)(offset + 0), _mm_or_si128(_mm_and_si128(t0, mask), _mm_srli_epi32(t0, 24)));
+    _mm_storeu_si128((__m128i*)(offset + 4), _mm_or_si128(_mm_and_si128(t1, mask), _mm_srli_epi32(t1, 24)));
+#endif
+}
+
+// lightmap rows g >> 8 << 8 of 4 consecutive pairs
+X_INLINE void spanRows(int32 g, int32 dgdx, int32* rows)
+{
+#ifdef USE_SPAN_NEON
+    const int32 init[4] = { g, g + dgdx, g + dgdx * 2, g + dgdx * 3 };
+    int32x4_t g0 = vld1q_s32(init);
+    vst1q_s32(rows, vshlq_n_s32(vshrq_n_s32(g0, 8), 8));
+#else
+    __m128i g0 = _mm_setr_epi32(g, g + dgdx, g + dgdx * 2, g + dgdx * 3);
+    _mm_storeu_si128((__m128i*)rows, _mm_slli_epi32(_mm_srai_epi32(g0, 8), 8));
+#endif
+}
+
+// writes 8 pixels, pairs with a transparent texel keep the old pixels
+X_INLINE void spanBlend(uint8* ptr, const uint8* index, const uint8* color)
+{
+#ifdef USE_SPAN_NEON
+    uint8x8_t hole = vceq_u8(vld1_u8(index), vdup_n_u8(0));
+    uint16x4_t keep = vceq_u16(vreinterpret_u16_u8(hole), vdup_n_u16(0));
+    vst1_u8(ptr, vbsl_u8(vreinterpret_u8_u16(keep), vld1_u8(color), vld1_u8(ptr)));
+#else
+    __m128i zero = _mm_setzero_si128();
+    __m128i hole = _mm_cmpeq_epi8(_mm_loadl_epi64((__m128i*)index), zero);
+    __m128i keep = _mm_cmpeq_epi16(hole, zero);
+    __m128i src = _mm_and_si128(keep, _mm_loadl_epi64((__m128i*)color));
+    __m128i dst = _mm_andnot_si128(keep, _mm_loadl_epi64((__m128i*)ptr));
+    _mm_storel_epi64((__m128i*)ptr, _mm_or_si128(src, dst));
+#endif
+}
+
+void spanF(uint8* ptr, int32 pairs, uint32 color)
+{
+#ifdef USE_SPAN_NEON
+    uint16x8_t c = vdupq_n_u16(uint16(color));
+    for (; pairs >= 8; pairs -= 8, ptr += 16) {
+        vst1q_u16((uint16*)ptr, c);
+    }
+#else
+    __m128i c = _mm_set1_epi16(int16(color));
+    for (; pairs >= 8; pairs -= 8, ptr += 16) {
+        _mm_storeu_si128((__m128i*)ptr, c);
+    }
+#endif
+
+    while (pairs--)
+    {
+        *(uint16*)ptr = color;
+        ptr += 2;
+    }
+}
+
+void spanFT(uint8* ptr, int32 pairs, uint32 t, uint32 dtdx, const uint8* ft_lightmap)
+{
+    uint32 offset[SPAN_STEP];
+
+    for (; pairs >= SPAN_STEP / 2; pairs -= SPAN_STEP / 2)
+    {
+        spanTexels(t, dtdx, offset);
+        for (int32 i = 0; i < SPAN_STEP; i++) {
+            ptr[i] = ft_lightmap[gTile[offset[i]]];
+        }
+        t += dtdx * SPAN_STEP;
+        ptr += SPAN_STEP;
+    }
+
+    while (pairs--)
+    {
+        uint16 p;
+
+        p = ft_lightmap[gTile[(t & 0xFF00) | (t >> 24)]];
+        t += dtdx;
+        p |= ft_lightmap[gTile[(t & 0xFF00) | (t >> 24)]] << 8;
+        t += dtdx;
+
+        *(uint16*)ptr = p;
+        ptr += 2;
+    }
+}
+
+void spanGT(uint8* ptr, int32 pairs, uint32 t, uint32 dtdx, int32 g, int32 dgdx)
+{
+    uint32 offset[SPAN_STEP];
+    int32 rows[SPAN_STEP / 2];
+
+    for (; pairs >= SPAN_STEP / 2; pairs -= SPAN_STEP / 2)
+    {
+        spanTexels(t, dtdx, offset);
+        spanRows(g, dgdx, rows);
+        for (int32 i = 0; i < SPAN_STEP; i++) {
+            ptr[i] = gLightmap[rows[i >> 1] | gTile[offset[i]]];
+        }
+        t += dtdx * SPAN_STEP;
+        g += dgdx * (SPAN_STEP / 2);
+        ptr += SPAN_STEP;
+    }
+
+    while (pairs--)
+    {
+        uint16 p = gLightmap[(g >> 8 << 8) | gTile[(t & 0xFF00) | (t >> 24)]];
+        t += dtdx;
+        p |= gLightmap[(g >> 8 << 8) | gTile[(t & 0xFF00) | (t >> 24)]] << 8;
+        t += dtdx;
+        g += dgdx;
+
+        *(uint16*)ptr = p;
+        ptr += 2;
+    }
+}
+
+void spanFTA(uint8* ptr, int32 pairs, uint32 t, uint32 dtdx, const uint8* ft_lightmap)
+{
+    uint32 offset[SPAN_STEP];
+    uint8 index[SPAN_STEP];
+    uint8 color[SPAN_STEP];
+
+    for (; pairs >= SPAN_STEP / 2; pairs -= SPAN_STEP / 2)
+    {
+        spanTexels(t, dtdx, offset);
+        for (int32 i = 0; i < SPAN_STEP; i++) {
+            index[i] = gTile[offset[i]];
+            color[i] = ft_lightmap[index[i]];
+        }
+        spanBlend(ptr, index, color);
+        t += dtdx * SPAN_STEP;
+        ptr += SPAN_STEP;
+    }
+
+    while (pairs--)
+    {
+        uint8 indexA = gTile[(t & 0xFF00) | (t >> 24)];
+        t += dtdx;
+        uint8 indexB = gTile[(t & 0xFF00) | (t >> 24)];
+        t += dtdx;
+
+        if (indexA && indexB) {
+            *(uint16*)ptr = ft_lightmap[indexA] | (ft_lightmap[indexB] << 8);
+        }
+
+        ptr += 2;
+    }
+}
+
+void spanGTA(uint8* ptr, int32 pairs, uint32 t, uint32 dtdx, int32 g, int32 dgdx)
+{
+    uint32 offset[SPAN_STEP];
+    int32 rows[SPAN_STEP / 2];
+    uint8 index[SPAN_STEP];
+    uint8 color[SPAN_STEP];
+
+    for (; pairs >= SPAN_STEP / 2; pairs -= SPAN_STEP / 2)
+    {
+        spanTexels(t, dtdx, offset);
+        spanRows(g + dgdx, dgdx, rows); // g steps before the lookup here
+        for (int32 i = 0; i < SPAN_STEP; i++) {
+            index[i] = gTile[offset[i]];
+            color[i] = gLightmap[rows[i >> 1] | index[i]];
+        }
+        spanBlend(ptr, index, color);
+        t += dtdx * SPAN_STEP;
+        g += dgdx * (SPAN_STEP / 2);
+        ptr += SPAN_STEP;
+    }
+
+    while (pairs--)
+    {
+        uint8 indexA = gTile[(t & 0xFF00) | (t >> 24)];
+        t += dtdx;
+        uint8 indexB = gTile[(t & 0xFF00) | (t >> 24)];
+        t += dtdx;
+        g += dgdx;
+
+        if (indexA && indexB) {
+            *(uint16*)ptr = gLightmap[(g >> 8 << 8) | indexA] | (gLightmap[(g >> 8 << 8) | indexB] << 8);
+        }
+
+        ptr += 2;
+    }
+}
+#endif
+
 void rasterizeS_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 {
     const uint8* ft_lightmap = &gLightmap[0x1A00];
@@ -106,7 +334,7 @@ void rasterizeS_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
             int32 width = x2 - x1;
 
-            if (width > 0)
+            if (width > 0 && BAND_ROW(pixel))
             {
                 volatile uint16* ptr = pixel + (x1 >> 1);
 
@@ -153,7 +381,7 @@ void rasterizeS_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
 void rasterizeF_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 {
-    uint32 color = (uint32)R;
+    uint32 color = uint32(intptr_t(R));
     color = gLightmap[(L->v.g << 8) | color];
     color |= (color << 8);
 
@@ -220,7 +448,7 @@ void rasterizeF_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
             int32 width = x2 - x1;
 
-            if (width > 0)
+            if (width > 0 && BAND_ROW(pixel))
             {
                 volatile uint8* ptr = (uint8*)pixel + x1;
 
@@ -237,6 +465,9 @@ void rasterizeF_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
                     *(uint16*)(ptr + width - 1) = (ptr[width] << 8) | (color >> 8);
                 }
 
+            #ifdef USE_SPAN_SIMD
+                spanF((uint8*)ptr, width >> 1, color);
+            #else
                 if (width & 2)
                 {
                     *(uint16*)ptr = color;
@@ -251,6 +482,7 @@ void rasterizeF_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
                     *(uint16*)ptr = color;
                     ptr += 2;
                 }
+            #endif
             }
 
             pixel += (FRAME_WIDTH >> 1);
@@ -334,7 +566,7 @@ void rasterizeFT_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
             int32 width = x2 - x1;
 
-            if (width > 0)
+            if (width > 0 && BAND_ROW(pixel))
             {
                 uint32 tmp = FixedInvU(width);
 
@@ -363,6 +595,9 @@ void rasterizeFT_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
                 }
 
                 width >>= 1;
+            #ifdef USE_SPAN_SIMD
+                spanFT((uint8*)ptr, width, t, dtdx, ft_lightmap);
+            #else
                 while (width--)
                 {
                     uint16 p;
@@ -375,6 +610,7 @@ void rasterizeFT_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
                     *(uint16*)ptr = p;
                     ptr += 2;
                 }
+            #endif
             }
 
             pixel += (FRAME_WIDTH >> 1);
@@ -472,7 +708,7 @@ void rasterizeGT_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
             int32 width = x2 - x1;
 
-            if (width > 0)
+            if (width > 0 && BAND_ROW(pixel))
             {
                 int32 tmp = FixedInvU(width);
 
@@ -510,6 +746,9 @@ void rasterizeGT_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
                 width >>= 1;
 
+            #ifdef USE_SPAN_SIMD
+                spanGT((uint8*)ptr, width, t, dtdx, g, dgdx);
+            #else
                 while (width--)
                 {
                 #ifdef ALIGNED_LIGHTMAP
@@ -531,6 +770,7 @@ void rasterizeGT_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
                     *(uint16*)ptr = p;
                     ptr += 2;
                 }
+            #endif
             }
 
             pixel += (FRAME_WIDTH >> 1);
@@ -618,7 +858,7 @@ void rasterizeFTA_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
             int32 width = x2 - x1;
 
-            if (width > 0)
+            if (width > 0 && BAND_ROW(pixel))
             {
                 uint32 tmp = FixedInvU(width);
 
@@ -653,6 +893,9 @@ void rasterizeFTA_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
                 }
 
                 width >>= 1;
+            #ifdef USE_SPAN_SIMD
+                spanFTA((uint8*)ptr, width, t, dtdx, ft_lightmap);
+            #else
                 while (width--)
                 {
                     uint8 indexA = gTile[(t & 0xFF00) | (t >> 24)];
@@ -670,6 +913,7 @@ void rasterizeFTA_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
                     ptr += 2;
                 }
+            #endif
             }
 
             pixel += (FRAME_WIDTH >> 1);
@@ -767,7 +1011,7 @@ void rasterizeGTA_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
             int32 width = x2 - x1;
 
-            if (width > 0)
+            if (width > 0 && BAND_ROW(pixel))
             {
                 int32 tmp = FixedInvU(width);
 
@@ -816,6 +1060,9 @@ void rasterizeGTA_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
                 width >>= 1;
 
+            #ifdef USE_SPAN_SIMD
+                spanGTA((uint8*)ptr, width, t, dtdx, g, dgdx);
+            #else
                 while (width--)
                 {
                 #ifdef ALIGNED_LIGHTMAP
@@ -844,6 +1091,7 @@ void rasterizeGTA_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
                     ptr += 2;
                 }
+            #endif
             }
 
             pixel += (FRAME_WIDTH >> 1);
@@ -860,6 +1108,9 @@ void rasterizeGTA_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 
 X_NOINLINE void rasterizeLineH_c(uint16* pixel, const VertexLink* L, const VertexLink* R)
 {
+    if (!BAND_ROW(pixel))
+        return;
+
     R++;
     int32 x = L->v.x;
     int32 index = L->v.g;
@@ -898,10 +1149,13 @@ X_NOINLINE void rasterizeLineV_c(uint16* pixel, const VertexLink* L, const Verte
 
     for (int32 i = 0; i < height; i++)
     {
-        if (intptr_t(ptr) & 1) {
-            *(uint16*)(ptr - 1) = *(ptr - 1) | (index << 8);
-        } else {
-            *(uint16*)ptr = index | (*ptr << 8);
+        if (BAND_ROW(ptr))
+        {
+            if (intptr_t(ptr) & 1) {
+                *(uint16*)(ptr - 1) = *(ptr - 1) | (index << 8);
+            } else {
+                *(uint16*)ptr = index | (*ptr << 8);
+            }
         }
         ptr += FRAME_WIDTH;
     }
@@ -919,6 +1173,12 @@ X_NOINLINE void rasterizeFillS_c(uint16* pixel, const VertexLink* L, const Verte
 
     for (int32 i = 0; i < height; i++)
     {
+        if (!BAND_ROW(pixel))
+        {
+            pixel += FRAME_WIDTH / 2;
+            continue;
+        }
+
         volatile uint8* ptr = (uint8*)pixel + x;
         int32 w = width;
 
@@ -1013,6 +1273,13 @@ extern "C" X_NOINLINE void rasterizeSprite_c(uint16* pixel, const VertexLink* L,
 
     for (int32 y = 0; y < h; y++)
     {
+        if (!BAND_ROW(ptr))
+        {
+            v += dv;
+            ptr += FRAME_WIDTH;
+            continue;
+        }
+
         const uint8* xtile = gTile + (v & 0xFF00);
 
         volatile uint8* xptr = ptr;
@@ -25,7 +25,7 @@ struct ViewportRel {
 
 ViewportRel viewportRel;
 
-#if defined(__GBA_WIN__)
+#if defined(__GBA_WIN__) || defined(__GBA_LINUX__)
     uint16 fb[FRAME_WIDTH * FRAME_HEIGHT];
 #elif defined(__GBA__)
     uint32 fb = MEM_VRAM;
@@ -60,7 +60,16 @@ enum FaceType {
 
 extern Level level;
 
+#ifdef USE_TILED_FLUSH
+X_TLS const uint8* gTile;
+X_TLS const uint8* gBandMin;
+X_TLS const uint8* gBandMax;
+
+Face* gTileFaces[TILE_COUNT][MAX_FACES];
+int32 gTileFacesCount[TILE_COUNT];
+#else
 const uint8* gTile;
+#endif
 
 EWRAM_DATA uint8 gBackgroundCopy[FRAME_WIDTH * FRAME_HEIGHT];   // EWRAM 37.5k
 EWRAM_DATA ALIGN8 Vertex gVertices[MAX_VERTICES];               // EWRAM 16k
@@ -590,23 +599,8 @@ X_NOINLINE void rasterize_c(uint32 flags, VertexLink* top)
     gRasterProc[type]((uint16*)pixel, top, R);
 }
 
-void flush_c()
+X_INLINE void flushInit(VertexLink* v)
 {
-#ifdef PROFILING
-    #if !defined(PROFILE_FRAMETIME) && !defined(PROFILE_SOUNDTIME)
-        gCounters[CNT_VERT] += gVerticesBase - gVertices;
-        gCounters[CNT_POLY] += gFacesBase - gFaces;
-    #endif
-#endif
-
-    gVerticesBase = gVertices;
-
-    if (gFacesBase == gFaces)
-        return;
-
-    gFacesBase = gFaces;
-
-    VertexLink v[8];
     VertexLink* q = v;
     VertexLink* t = v + 4;
     // quad
@@ -626,9 +620,153 @@ void flush_c()
     t[2].prev = -1;
     t[2].next = -2;
     // t[3] dummy
+}
+
+void flushFace(const Face* face, VertexLink* v)
+{
+    VertexLink* q = v;
+    VertexLink* t = v + 4;
+
+    uint32 flags = face->flags;
+
+    uint32 type = (flags >> FACE_TYPE_SHIFT) & FACE_TYPE_MASK;
+
+    if (type <= FACE_TYPE_GTA)
+    {
+        VertexLink* ptr = (flags & FACE_TRIANGLE) ? t : q;
+
+        if (type > FACE_TYPE_F)
+        {
+            const Texture &tex = level.textures[flags & FACE_TEXTURE];
+            gTile = (uint8*)tex.tile;
+
+            ptr[0].t.t = 0xFF00FF00 & (tex.uv01);
+            ptr[1].t.t = 0xFF00FF00 & (tex.uv01 << 8);
+            ptr[2].t.t = 0xFF00FF00 & (tex.uv23);
+            ptr[3].t.t = 0xFF00FF00 & (tex.uv23 << 8);
+        }
+
+        ptr[0].v = gVertices[face->indices[0]];
+        ptr[1].v = gVertices[face->indices[1]];
+        ptr[2].v = gVertices[face->indices[2]];
+        if (!(flags & FACE_TRIANGLE)) {
+            ptr[3].v = gVertices[face->indices[3]];
+        }
+
+        if (flags & FACE_CLIPPED) {
+            drawPoly(flags, ptr);
+        } else {
+            // get top vertex for tri or quad
+            VertexLink* top = ptr;
+            if (top->v.y > ptr[1].v.y) top = ptr + 1;
+            if (top->v.y > ptr[2].v.y) top = ptr + 2;
+            if (!(flags & FACE_TRIANGLE))
+            {
+                if (top->v.y > v[3].v.y) top = ptr + 3;
+            }
+            rasterize(flags, top);
+        }
+    }
+    else
+    {
+        const Vertex *vert = gVertices + face->indices[0];
+        v[0].v = vert[0];
+        v[1].v = vert[1];
+
+        if (type == FACE_TYPE_SPRITE)
+        {
+            const Sprite &sprite = level.sprites[flags & FACE_TEXTURE];
+            gTile = (uint8*)sprite.tile;
+            v[0].t.t = (sprite.uwvh) & (0xFF00FF00);
+            v[1].t.t = (sprite.uwvh) & (0xFF00FF00 >> 8);
+        }
+
+        rasterize(flags, v);
+    }
+}
+
+#ifdef USE_TILED_FLUSH
+// adds the face to every band its screen rows may touch, the bins keep the OT order
+void faceBin(Face* face)
+{
+    uint32 type = (face->flags >> FACE_TYPE_SHIFT) & FACE_TYPE_MASK;
+
+    const Vertex* vert = gVertices + face->indices[0];
+
+    int32 minY, maxY;
+
+    if (type <= FACE_TYPE_GTA)
+    {
+        int32 count = (face->flags & FACE_TRIANGLE) ? 3 : 4;
+
+        minY = maxY = vert->y;
+        for (int32 i = 1; i < count; i++)
+        {
+            int32 y = gVertices[face->indices[i]].y;
+            minY = X_MIN(minY, y);
+            maxY = X_MAX(maxY, y);
+        }
+    }
+    else
+    {
+        // sprites have the bottom in vert[1].y, fills and lines the height
+        minY = X_MIN(vert[0].y, vert[1].y);
+        maxY = X_MAX(vert[1].y, vert[0].y + vert[1].y);
+    }
+
+    minY = X_MAX(minY, 0);
+    maxY = X_MIN(maxY, FRAME_HEIGHT - 1);
+
+    for (int32 i = minY / TILE_HEIGHT; i <= maxY / TILE_HEIGHT; i++)
+    {
+        gTileFaces[i][gTileFacesCount[i]++] = face;
+    }
+}
+
+void flushTile(int32 index)
+{
+    VertexLink v[8];
+    flushInit(v);
+
+    gBandMin = (uint8*)fb + index * TILE_HEIGHT * FRAME_WIDTH;
+    gBandMax = gBandMin + TILE_HEIGHT * FRAME_WIDTH;
+
+    Face** faces = gTileFaces[index];
+    int32 count = gTileFacesCount[index];
+
+    for (int32 i = 0; i < count; i++)
+    {
+        flushFace(faces[i], v);
+    }
+
+    gBandMin = gBandMax = NULL;
+}
+#endif
+
+void flush_c()
+{
+#ifdef PROFILING
+    #if !defined(PROFILE_FRAMETIME) && !defined(PROFILE_SOUNDTIME)
+        gCounters[CNT_VERT] += gVerticesBase - gVertices;
+        gCounters[CNT_POLY] += gFacesBase - gFaces;
+    #endif
+#endif
+
+    gVerticesBase = gVertices;
+
+    if (gFacesBase == gFaces)
+        return;
+
+    gFacesBase = gFaces;
 
     PROFILE(CNT_FLUSH);
 
+#ifdef USE_TILED_FLUSH
+    for (int32 i = 0; i < TILE_COUNT; i++)
+    {
+        gTileFacesCount[i] = 0;
+    }
+
     for (int32 i = OT_SIZE - 1; i >= 0; i--)
     {
         if (!gOT[i]) continue;
@@ -637,67 +775,29 @@ void flush_c()
         gOT[i] = NULL;
 
         do {
-            uint32 flags = face->flags;
+            faceBin(face);
+            face = face->next;
+        } while (face);
+    }
+
+    osParallelFor(TILE_COUNT, flushTile);
+#else
+    VertexLink v[8];
+    flushInit(v);
 
-            uint32 type = (flags >> FACE_TYPE_SHIFT) & FACE_TYPE_MASK;
+    for (int32 i = OT_SIZE - 1; i >= 0; i--)
+    {
+        if (!gOT[i]) continue;
 
-            if (type <= FACE_TYPE_GTA)
-            {
-                VertexLink* ptr = (flags & FACE_TRIANGLE) ? t : q;
-
-                if (type > FACE_TYPE_F)
-                {
-                    const Texture &tex = level.textures[flags & FACE_TEXTURE];
-                    gTile = (uint8*)tex.tile;
-
-                    ptr[0].t.t = 0xFF00FF00 & (tex.uv01);
-                    ptr[1].t.t = 0xFF00FF00 & (tex.uv01 << 8);
-                    ptr[2].t.t = 0xFF00FF00 & (tex.uv23);
-                    ptr[3].t.t = 0xFF00FF00 & (tex.uv23 << 8);
-                }
-
-                ptr[0].v = gVertices[face->indices[0]];
-                ptr[1].v = gVertices[face->indices[1]];
-                ptr[2].v = gVertices[face->indices[2]];
-                if (!(flags & FACE_TRIANGLE)) {
-                    ptr[3].v = gVertices[face->indices[3]];
-                }
-
-                if (flags & FACE_CLIPPED) {
-                    drawPoly(flags, ptr);
-                } else {
-                    // get top vertex for tri or quad
-                    VertexLink* top = ptr;
-                    if (top->v.y > ptr[1].v.y) top = ptr + 1;
-                    if (top->v.y > ptr[2].v.y) top = ptr + 2;
-                    if (!(flags & FACE_TRIANGLE))
-                    {
-                        if (top->v.y > v[3].v.y) top = ptr + 3;
-                    }
-                    rasterize(flags, top);
-                }
-            }
-            else
-            {
-                const Vertex *vert = gVertices + face->indices[0];
-                v[0].v = vert[0];
-                v[1].v = vert[1];
-
-                if (type == FACE_TYPE_SPRITE)
-                {
-                    const Sprite &sprite = level.sprites[flags & FACE_TEXTURE];
-                    gTile = (uint8*)sprite.tile;
-                    v[0].t.t = (sprite.uwvh) & (0xFF00FF00);
-                    v[1].t.t = (sprite.uwvh) & (0xFF00FF00 >> 8);
-                }
-
-                rasterize(flags, v);
-            }
+        Face *face = gOT[i];
+        gOT[i] = NULL;
 
+        do {
+            flushFace(face, v);
             face = face->next;
-
         } while (face);
     }
+#endif
 }
 #endif
 
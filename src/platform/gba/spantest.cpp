@@ -0,0 +1,185 @@
+// golden-image test of the host span kernels, renders random triangles of every rasterizer type
+// and compares the framebuffer hash with the one of the per-pair loops (build with NO_SPAN_SIMD)
+// usage: ./spantest [image.pgm]
+
+#include "common.h"
+
+struct Vertex
+{
+    int16 x;
+    int16 y;
+    int16 z;
+    uint8 g;
+    uint8 clip;
+};
+
+struct VertexLink
+{
+    Vertex v;
+    TexCoord t;
+    int8 prev;
+    int8 next;
+    uint16 padding;
+};
+
+#include "rasterizer.h"
+
+#define SPAN_TEST_FACES 20000
+#define SPAN_TEST_HASH  0xDEAEE8E8 // NO_SPAN_SIMD result
+
+uint8 gLightmap[256 * 32];
+
+#ifdef USE_TILED_FLUSH
+X_TLS const uint8* gTile;
+X_TLS const uint8* gBandMin;
+X_TLS const uint8* gBandMax;
+#else
+const uint8* gTile;
+#endif
+
+divTableInt divTable[DIV_TABLE_SIZE];
+
+uint8 tiles[256 * 256];
+uint16 fb[FRAME_WIDTH * FRAME_HEIGHT];
+
+uint32 seed;
+
+uint32 rand32()
+{
+    seed = seed * 1664525 + 1013904223;
+    return seed >> 8;
+}
+
+void init()
+{
+    seed = 1;
+
+    for (int32 i = 0; i < int32(sizeof(gLightmap)); i++)
+    {
+        gLightmap[i] = rand32();
+    }
+
+    for (int32 i = 0; i < int32(sizeof(tiles)); i++)
+    {
+        tiles[i] = (rand32() % 5) ? rand32() : 0; // transparent texels for the alpha-tested types
+    }
+
+    gTile = tiles;
+
+    divTable[0] = 0;
+    divTable[1] = 0x7FFF;
+    for (int32 i = 2; i < DIV_TABLE_SIZE; i++)
+    {
+        divTable[i] = 0x8000 / i;
+    }
+
+    memset(fb, 0x55, sizeof(fb));
+}
+
+void render()
+{
+    typedef void (*Rasterizer)(uint16* pixel, const VertexLink* L, const VertexLink* R);
+
+    const Rasterizer rasterizers[] = {
+        rasterizeF_c, rasterizeFT_c, rasterizeGT_c, rasterizeFTA_c, rasterizeGTA_c
+    };
+
+    uint32 start = seed;
+
+    // the tiled flush draws every face once per band, each pass must only touch its own rows
+#ifdef USE_TILED_FLUSH
+    int32 bands = TILE_COUNT;
+#else
+    int32 bands = 1;
+#endif
+
+    for (int32 b = 0; b < bands; b++)
+    {
+        seed = start;
+
+    #ifdef USE_TILED_FLUSH
+        gBandMin = (uint8*)fb + b * TILE_HEIGHT * FRAME_WIDTH;
+        gBandMax = gBandMin + TILE_HEIGHT * FRAME_WIDTH;
+    #endif
+
+        for (int32 n = 0; n < SPAN_TEST_FACES; n++)
+        {
+            VertexLink v[3];
+            memset(v, 0, sizeof(v));
+
+            int32 top = 0;
+            for (int32 i = 0; i < 3; i++)
+            {
+                v[i].v.x = rand32() % FRAME_WIDTH;
+                v[i].v.y = rand32() % FRAME_HEIGHT;
+                v[i].v.g = 2 + rand32() % 28;
+                v[i].t.t = (rand32() << 8) | (rand32() & 0xFF);
+                v[i].next = ((i + 1) % 3) - i;
+                v[i].prev = ((i + 2) % 3) - i;
+
+                if (v[i].v.y < v[top].v.y) {
+                    top = i;
+                }
+            }
+
+            if (v[0].v.y == v[1].v.y && v[1].v.y == v[2].v.y)
+                continue;
+
+            int32 type = n % X_COUNT(rasterizers);
+            uint16* pixel = fb + v[top].v.y * (FRAME_WIDTH >> 1);
+
+            if (type == 0) {
+                rasterizers[type](pixel, v + top, (VertexLink*)intptr_t(rand32() & 0xFF)); // flat color index
+            } else {
+                rasterizers[type](pixel, v + top, v + top);
+            }
+        }
+    }
+
+#ifdef USE_TILED_FLUSH
+    gBandMin = gBandMax = NULL;
+#endif
+}
+
+uint32 getHash()
+{
+    uint32 hash = 2166136261u;
+    const uint8* data = (uint8*)fb;
+    for (int32 i = 0; i < int32(sizeof(fb)); i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void saveImage(const char* fileName)
+{
+    FILE* f = fopen(fileName, "wb");
+    if (!f)
+        return;
+    fprintf(f, "P5\n%d %d\n255\n", FRAME_WIDTH, FRAME_HEIGHT);
+    fwrite(fb, 1, FRAME_WIDTH * FRAME_HEIGHT, f);
+    fclose(f);
+}
+
+int main(int argc, char** argv)
+{
+    init();
+    render();
+
+    if (argc > 1) {
+        saveImage(argv[1]);
+    }
+
+    uint32 hash = getHash();
+
+#ifdef USE_SPAN_SIMD
+    const char* path = "span kernels";
+#else
+    const char* path = "per-pair loops";
+#endif
+
+    printf("%s: %08X %s\n", path, hash, hash == SPAN_TEST_HASH ? "OK" : "FAILED");
+
+    return hash == SPAN_TEST_HASH ? 0 : 1;
+}
@@ -0,0 +1,7 @@
+set -e
+# golden-image test of the host span kernels against the per-pair loops, run from this directory
+# native host build (no level data is loaded, so unlike build_linux.sh it doesn't need the 32-bit multilib)
+g++ -std=c++11 -O2 -fno-exceptions -fno-rtti -D__GBA_LINUX__ spantest.cpp -I../../fixed -o spantest
+g++ -std=c++11 -O2 -fno-exceptions -fno-rtti -D__GBA_LINUX__ -DNO_SPAN_SIMD spantest.cpp -I../../fixed -o spantest_ref
+./spantest_ref
+./spantest
@@ -0,0 +1,2 @@
+set -e
+g++ -std=c++11 -O3 -s -fno-exceptions -fno-rtti -ffunction-sections -fdata-sections -Wl,--gc-sections -D__HEADLESS__ -DNDEBUG main.cpp ../../libs/stb_vorbis/stb_vorbis.c ../../libs/tinf/tinflate.c -I../../ -o../../../bin/OpenLara_headless -lm -lpthread
@@ -0,0 +1,175 @@
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "game.h"
+
+// headless host for batch simulation
+// every instance is an independent engine (thread-local engine state, see ENGINE_INSTANCES)
+// that runs a level for a fixed number of ticks on its own thread, optionally with SW rendering
+//
+// usage: OpenLara_headless [-j instances] [-n ticks] [-r] level [level ...]
+
+#define TICK_TIME    (1.0f / 30.0f)
+#define FRAME_WIDTH  320
+#define FRAME_HEIGHT 240
+
+// timing
+int64 getClock(clockid_t id) {
+    timespec t;
+    clock_gettime(id, &t);
+    return int64(t.tv_sec) * 1000000 + t.tv_nsec / 1000;
+}
+
+int64 startTime;
+
+int osGetTimeMS() {
+    return int((getClock(CLOCK_MONOTONIC) - startTime) / 1000);
+}
+
+// multi-threading
+void* osMutexInit() {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+
+    pthread_mutex_t *mutex = new pthread_mutex_t();
+    pthread_mutex_init(mutex, &attr);
+    return mutex;
+}
+
+void osMutexFree(void *obj) {
+    pthread_mutex_destroy((pthread_mutex_t*)obj);
+    delete (pthread_mutex_t*)obj;
+}
+
+void osMutexLock(void *obj) {
+    pthread_mutex_lock((pthread_mutex_t*)obj);
+}
+
+void osMutexUnlock(void *obj) {
+    pthread_mutex_unlock((pthread_mutex_t*)obj);
+}
+
+// input
+bool osJoyReady(int index) {
+    return false;
+}
+
+void osJoyVibrate(int index, float L, float R) {}
+
+// instances
+struct Instance {
+    pthread_t   thread;
+    int         index;
+    const char  *level;
+    int         ticks;
+    bool        render;
+
+    int         done;
+    int64       wallTime;   // us
+    int64       cpuTime;    // us, time on the core of the instance thread
+};
+
+void* instanceProc(void *arg) {
+    Instance &inst = *(Instance*)arg;
+
+    Core::width  = FRAME_WIDTH;
+    Core::height = FRAME_HEIGHT;
+
+    Game::init(inst.level);
+
+    GAPI::ColorSW *frame = NULL;
+    if (inst.render) {
+        frame = new GAPI::ColorSW[FRAME_WIDTH * FRAME_HEIGHT];
+        GAPI::resize();
+        GAPI::swColor = frame;
+    }
+
+    int64 wallStart = getClock(CLOCK_MONOTONIC);
+    int64 cpuStart  = getClock(CLOCK_THREAD_CPUTIME_ID);
+
+    for (inst.done = 0; inst.done < inst.ticks; inst.done++) {
+        if (!Game::simulate(TICK_TIME))
+            break;
+        if (inst.render)
+            Game::render();
+    }
+
+    inst.wallTime = getClock(CLOCK_MONOTONIC) - wallStart;
+    inst.cpuTime  = getClock(CLOCK_THREAD_CPUTIME_ID) - cpuStart;
+
+    Game::deinit();
+    delete[] frame;
+
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    cacheDir[0] = saveDir[0] = contentDir[0] = 0;
+
+    int  count  = int(sysconf(_SC_NPROCESSORS_ONLN));
+    int  ticks  = 30 * 60;
+    bool render = false;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (!strcmp(argv[arg], "-j") && arg + 1 < argc)
+            count = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "-n") && arg + 1 < argc)
+            ticks = atoi(argv[++arg]);
+        else if (!strcmp(argv[arg], "-r"))
+            render = true;
+    }
+
+    if (arg >= argc || count < 1) {
+        printf("usage: %s [-j instances] [-n ticks] [-r] level [level ...]\n", argv[0]);
+        return 1;
+    }
+
+    startTime = getClock(CLOCK_MONOTONIC);
+
+    tinf_init();
+
+    Instance *instances = new Instance[count];
+
+    int64 wallStart = getClock(CLOCK_MONOTONIC);
+
+    for (int i = 0; i < count; i++) {
+        Instance &inst = instances[i];
+        inst.index  = i;
+        inst.level  = argv[arg + i % (argc - arg)];
+        inst.ticks  = ticks;
+        inst.render = render;
+        inst.done   = 0;
+        inst.wallTime = inst.cpuTime = 0;
+        if (pthread_create(&inst.thread, NULL, instanceProc, &inst) != 0) {
+            LOG("! instance %d: can't create thread\n", i);
+            count = i;
+            break;
+        }
+    }
+
+    int64 total   = 0;
+    int64 cpuTime = 0;
+    for (int i = 0; i < count; i++) {
+        Instance &inst = instances[i];
+        pthread_join(inst.thread, NULL);
+        printf("instance %d: %s, %d ticks, %.1f ticks/sec\n", i, inst.level, inst.done, inst.done * 1000000.0 / max(inst.wallTime, int64(1)));
+        total   += inst.done;
+        cpuTime += inst.cpuTime;
+    }
+
+    int64 wallTime = getClock(CLOCK_MONOTONIC) - wallStart;
+
+    printf("%d instances, %d ticks in %.2f sec\n", count, int(total), wallTime / 1000000.0);
+    printf("throughput: %.1f ticks/sec, %.1f ticks/sec per core\n",
+        total * 1000000.0 / max(wallTime, int64(1)),
+        total * 1000000.0 / max(cpuTime, int64(1)));
+
+    delete[] instances;
+
+    return 0;
+}
@@ -0,0 +1,224 @@
+#ifndef H_PROFILER
+#define H_PROFILER
+
+#include "utils.h"
+
+// hierarchical CPU zones with per-thread ring buffers
+// dump() writes the recorded zones in chrome://tracing (Perfetto) JSON format
+
+#if defined(_WIN32)
+    #ifndef _WINDOWS_
+        #include <windows.h>
+    #endif
+#elif defined(__unix__) || defined(__APPLE__)
+    #include <time.h>
+#endif
+
+extern int osGetTimeMS();
+
+namespace Profiler {
+
+    // microseconds, falls back to the millisecond OS timer
+    int64 getTime() {
+    #if defined(_WIN32)
+        static LARGE_INTEGER freq;
+        if (!freq.QuadPart)
+            QueryPerformanceFrequency(&freq);
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return int64(counter.QuadPart * 1000000 / freq.QuadPart);
+    #elif defined(__unix__) || defined(__APPLE__)
+        timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return int64(t.tv_sec) * 1000000 + t.tv_nsec / 1000;
+    #else
+        return int64(osGetTimeMS()) * 1000;
+    #endif
+    }
+}
+
+#ifdef PROFILE
+
+#ifdef _MSC_VER
+    #define PROFILE_TLS __declspec(thread)
+#else
+    #define PROFILE_TLS __thread
+#endif
+
+#define PROFILER_MAX_EVENTS  (32 * 1024)
+#define PROFILER_MAX_THREADS 16
+
+namespace Profiler {
+
+    struct Event {
+        const char *name;
+        int64      start;   // microseconds
+        int32      time;
+        int32      depth;
+    };
+
+    struct Buffer {
+        Event  events[PROFILER_MAX_EVENTS];
+        uint32 count;
+        int32  depth;
+        int32  id;
+        bool   released; // the thread has exited, the next new thread takes the slot
+    };
+
+    Buffer *buffers[PROFILER_MAX_THREADS];
+    int32  buffersCount;
+    int32  buffersLock;
+    bool   overflow;
+
+    PROFILE_TLS Buffer *current;
+    PROFILE_TLS bool   noBuffer;
+
+    bool compareAndSwap(int32 *value, int32 from, int32 to) {
+    #ifdef _MSC_VER
+        return InterlockedCompareExchange((volatile LONG*)value, to, from) == from;
+    #else
+        return __sync_bool_compare_and_swap(value, from, to);
+    #endif
+    }
+
+    // taken once per thread
+    void lock() {
+        while (!compareAndSwap(&buffersLock, 0, 1));
+    }
+
+    void unlock() {
+        compareAndSwap(&buffersLock, 1, 0);
+    }
+
+    Buffer* getBuffer() {
+        if (current || noBuffer)
+            return current;
+
+        lock();
+
+    // take the slot of an exited thread
+        for (int i = 0; i < buffersCount; i++) {
+            if (buffers[i]->released) {
+                buffers[i]->released = false;
+                current = buffers[i];
+                break;
+            }
+        }
+
+        if (!current) {
+            if (buffersCount < PROFILER_MAX_THREADS) {
+                Buffer *buffer = new Buffer();
+                buffer->count    = 0;
+                buffer->depth    = 0;
+                buffer->id       = buffersCount;
+                buffer->released = false;
+                buffers[buffersCount++] = buffer;
+                current = buffer;
+            } else {
+                if (!overflow) {
+                    LOG("! profiler: too many threads\n");
+                }
+                overflow = true;
+                noBuffer = true;
+            }
+        }
+
+        unlock();
+
+        return current;
+    }
+
+    // called by a thread before it exits, the recorded zones stay in the buffer
+    void releaseBuffer() {
+        if (!current) return;
+        lock();
+        current->released = true;
+        current = NULL;
+        unlock();
+    }
+
+    struct Zone {
+        const char *name;
+        int64      start;
+        Buffer     *buffer;
+
+        Zone(const char *name) : name(name) {
+            buffer = getBuffer();
+            if (!buffer) return;
+            buffer->depth++;
+            start = getTime();
+        }
+
+        ~Zone() {
+            if (!buffer) return;
+            int64 end = getTime();
+            buffer->depth--;
+
+            Event &e = buffer->events[buffer->count % PROFILER_MAX_EVENTS];
+            e.name  = name;
+            e.start = start;
+            e.time  = int32(end - start);
+            e.depth = buffer->depth;
+            buffer->count++;
+        }
+    };
+
+    bool dump(const char *fileName) {
+        FILE *f = fopen(fileName, "wb");
+        if (!f) {
+            LOG("! profiler: can't write %s\n", fileName);
+            return false;
+        }
+
+        lock();
+        int count = buffersCount;
+        unlock();
+
+        int64 start = 0x7FFFFFFFFFFFFFFFLL;
+        for (int i = 0; i < count; i++) {
+            Buffer *b = buffers[i];
+            if (!b) continue;
+            uint32 first = b->count > PROFILER_MAX_EVENTS ? b->count - PROFILER_MAX_EVENTS : 0;
+            for (uint32 j = first; j < b->count; j++)
+                start = min(start, b->events[j % PROFILER_MAX_EVENTS].start);
+        }
+
+        fprintf(f, "{\"traceEvents\":[\n");
+
+        bool comma = false;
+        for (int i = 0; i < count; i++) {
+            Buffer *b = buffers[i];
+            if (!b) continue;
+
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}", comma ? ",\n" : "", b->id, b->id ? "worker" : "main", b->id);
+            comma = true;
+
+            uint32 first = b->count > PROFILER_MAX_EVENTS ? b->count - PROFILER_MAX_EVENTS : 0;
+            for (uint32 j = first; j < b->count; j++) {
+                Event &e = b->events[j % PROFILER_MAX_EVENTS];
+                fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%lld,\"dur\":%d}", e.name, b->id, (long long)(e.start - start), e.time);
+            }
+        }
+
+        fprintf(f, "\n]}\n");
+        fclose(f);
+
+        LOG("profiler: trace saved to %s\n", fileName);
+        return true;
+    }
+}
+
+#define PROFILE_ZONE_NAME(line) _profileZone##line
+#define PROFILE_ZONE_LINE(name, line) Profiler::Zone PROFILE_ZONE_NAME(line)(name)
+#define PROFILE_ZONE_EXPAND(name, line) PROFILE_ZONE_LINE(name, line)
+#define PROFILE_ZONE(name) PROFILE_ZONE_EXPAND(name, __LINE__)
+#define PROFILE_THREAD_EXIT() Profiler::releaseBuffer()
+
+#else
+
+#define PROFILE_ZONE(name)
+#define PROFILE_THREAD_EXIT()
+
+#endif
+
+#endif
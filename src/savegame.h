@@ -110,10 +110,10 @@ struct SaveSlot {
     }
 };
 
-Array<SaveSlot> saveSlots;
-SaveResult      saveResult;
-int             loadSlot;
-SaveStats       saveStats;
+ENGINE_TLS Array<SaveSlot> saveSlots;
+ENGINE_TLS SaveResult      saveResult;
+ENGINE_TLS int             loadSlot;
+ENGINE_TLS SaveStats       saveStats;
 
 void freeSaveSlots() {
     for (int i = 0; i < saveSlots.length; i++)
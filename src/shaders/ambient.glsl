@@ -49,8 +49,16 @@ varying vec4 vDiffuse;
 
 	uniform sampler2D sDiffuse;
 
+	#ifdef OPT_PALETTE
+		uniform sampler2D sPalette;
+	#endif
+
 	void main() {
-		vec4 color = texture2D(sDiffuse, vTexCoord);
+		#ifdef OPT_PALETTE
+			vec4 color = texture2D(sPalette, vec2(texture2D(sDiffuse, vTexCoord).x * (255.0 / 256.0) + (0.5 / 256.0), 0.5));
+		#else
+			vec4 color = texture2D(sDiffuse, vTexCoord);
+		#endif
 
 		#ifdef ALPHA_TEST
 			if (color.w <= 0.5)
@@ -255,6 +255,10 @@ varying vec4 vTexCoord; // xy - atlas coords, zw - trapezoidal correction
 		uniform sampler2D sDiffuse;
 	#endif
 
+	#ifdef OPT_PALETTE
+		uniform sampler2D sPalette; // 256x1, sDiffuse holds the indices
+	#endif
+
 	float unpack(vec4 value) {
 		return dot(value, vec4(1.0, 1.0/255.0, 1.0/65025.0, 1.0/16581375.0));
 	}
@@ -361,7 +365,11 @@ varying vec4 vTexCoord; // xy - atlas coords, zw - trapezoidal correction
 					uv /= vTexCoord.zw;
 				#endif
 			#endif
-			color = texture2D(sDiffuse, uv);
+			#ifdef OPT_PALETTE
+				color = texture2D(sPalette, vec2(texture2D(sDiffuse, uv).x * (255.0 / 256.0) + (0.5 / 256.0), 0.5));
+			#else
+				color = texture2D(sDiffuse, uv);
+			#endif
 		#endif
 
 		#ifdef ALPHA_TEST
@@ -41,6 +41,9 @@ R"====(
 	
 	#ifdef ALPHA_TEST
 		uniform sampler2D sDiffuse;
+		#ifdef OPT_PALETTE
+			uniform sampler2D sPalette;
+		#endif
 	#endif
 
 	vec4 pack(float value) {
@@ -50,8 +53,13 @@ R"====(
 
 	void main() {
 		#ifdef ALPHA_TEST
-			if (texture2D(sDiffuse, vTexCoord).w <= 0.5)
-				discard;
+			#ifdef OPT_PALETTE
+				if (texture2D(sPalette, vec2(texture2D(sDiffuse, vTexCoord).x * (255.0 / 256.0) + (0.5 / 256.0), 0.5)).w <= 0.5)
+					discard;
+			#else
+				if (texture2D(sDiffuse, vTexCoord).w <= 0.5)
+					discard;
+			#endif
 		#endif
 
 		#ifdef SHADOW_COLOR
@@ -22,6 +22,10 @@ uniform vec4 uViewPos;
 #else
 	uniform sampler2D sDiffuse;
 
+	#ifdef OPT_PALETTE
+		uniform sampler2D sPalette;
+	#endif
+
 	#ifdef SKY_CLOUDS_AZURE
 		#define SKY_CLOUDS
 		#define SKY_AZURE
@@ -102,7 +106,11 @@ uniform vec4 uViewPos;
 		#ifdef SKY_AZURE
 			vec3 col = mix(skyDown, skyUp, dir.y);
 		#else
-			vec3 col = texture2D(sDiffuse, vTexCoord).xyz * vColor.xyz;
+			#ifdef OPT_PALETTE
+				vec3 col = texture2D(sPalette, vec2(texture2D(sDiffuse, vTexCoord).x * (255.0 / 256.0) + (0.5 / 256.0), 0.5)).xyz * vColor.xyz;
+			#else
+				vec3 col = texture2D(sDiffuse, vTexCoord).xyz * vColor.xyz;
+			#endif
 		#endif
 
 		#ifdef SKY_CLOUDS
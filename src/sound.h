@@ -12,7 +12,7 @@
     #define DECODE_XA
     #define DECODE_OGG
 
-    #if !defined(_OS_PSP) && !defined(_OS_WEB) && !defined(_OS_PSV) && !defined(_OS_3DS) && !defined(_OS_XBOX) && !defined(_OS_XB1)
+    #if !defined(_OS_PSP) && !defined(_OS_WEB) && !defined(_OS_PSV) && !defined(_OS_3DS) && !defined(_OS_XBOX) && !defined(_OS_XB1) && !defined(_OS_HEADLESS)
         #define DECODE_MP3
     #endif
 #endif
@@ -62,7 +62,7 @@ namespace Sound {
         int32 L, R;
     };
 
-    struct Stats {
+    ENGINE_TLS struct Stats {
         int mixer;
         int reverb;
         int render[2];
@@ -831,7 +831,7 @@ namespace Sound {
 
 #endif // DECODE_OGG
 
-    Core::Mutex lock;
+    ENGINE_TLS Core::Mutex lock;
 
     struct Listener
     {
@@ -839,8 +839,8 @@ namespace Sound {
         bool underwater;
     };
 
-    Listener listener[2];
-    int      listenersCount;
+    ENGINE_TLS Listener listener[2];
+    ENGINE_TLS int      listenersCount;
 
     Listener& getListener(const vec3 &pos)
     {
@@ -859,9 +859,9 @@ namespace Sound {
         UNFLIPPED       = 64,
     };
 
-    bool flipped;
+    ENGINE_TLS bool flipped;
 
-    struct Sample
+    ENGINE_TLS struct Sample
     {
         const vec3 *uniquePtr;
         Decoder *decoder;
@@ -1073,17 +1073,17 @@ namespace Sound {
             isPaused = false;
         }
     } *channels[SND_CHANNELS_MAX];
-    int channelsCount;
+    ENGINE_TLS int channelsCount;
 
     typedef void (Callback)(Sample *channel);
-    Callback *callback;
+    ENGINE_TLS Callback *callback;
 
-    FrameHI *result;
-    Frame   *buffer;
+    ENGINE_TLS FrameHI *result;
+    ENGINE_TLS Frame   *buffer;
 
     // TODO: per listener
-    Filter::Reverberation reverb;
-    Filter::LowPass       lowPass;
+    ENGINE_TLS Filter::Reverberation reverb;
+    ENGINE_TLS Filter::LowPass       lowPass;
 
     void init()
     {
@@ -4,6 +4,7 @@
 #include "controller.h"
 
 struct Sprite : Controller {
+    DECL_POOLED(Sprite, 128)
 
     enum {
         FRAME_ANIMATED = -1,
@@ -730,6 +730,39 @@ struct Texture : GAPI::Texture {
     }
 };
 
+#ifdef USE_ATLAS_INDEXED
+// colors of the indexed atlases, shared by all of them to keep a single palette texture bound
+struct AtlasPalette {
+    enum { HASH_SIZE = 1024 };
+
+    Color32 colors[256];
+    int     count;
+    int16   hash[HASH_SIZE];
+
+    AtlasPalette() : count(0) {
+        for (int i = 0; i < COUNT(colors); i++)
+            colors[i] = Color32(0U);
+        memset(hash, 0xFF, sizeof(hash));
+    }
+
+    // palette index of the color, -1 if the palette is full
+    int getIndex(const Color32 &c) {
+        uint32 h = (c.value * 2654435761U) >> 22; // HASH_SIZE bits
+        while (hash[h] != -1) {
+            if (colors[hash[h]].value == c.value)
+                return hash[h];
+            h = (h + 1) & (HASH_SIZE - 1);
+        }
+
+        if (count == COUNT(colors))
+            return -1;
+
+        colors[count] = c;
+        hash[h] = count;
+        return count++;
+    }
+};
+#endif
 
 struct Atlas {
 
@@ -801,14 +834,26 @@ struct Atlas {
     short4   border;
     void     *userData;
     Callback *callback;
+    void     *tileData; // callback scratch buffer, one per atlas to build them in parallel
+    AtlasColor *data;   // packed pixels between build() and pack()
+#ifdef USE_ATLAS_INDEXED
+    uint8      *indices; // palette indices of the packed pixels between toIndexed() and packIndexed()
+#endif
 
-    Atlas(int maxTiles, short4 border, void *userData, Callback *callback) : root(NULL), tilesCount(0), size(0), border(border), userData(userData), callback(callback) {
+    Atlas(int maxTiles, short4 border, void *userData, Callback *callback) : root(NULL), tilesCount(0), size(0), border(border), userData(userData), callback(callback), tileData(NULL), data(NULL) {
         tiles = new Tile[maxTiles];
+    #ifdef USE_ATLAS_INDEXED
+        indices = NULL;
+    #endif
     }
 
     ~Atlas() {
         delete root;
         delete[] tiles;
+        delete[] data;
+    #ifdef USE_ATLAS_INDEXED
+        delete[] indices;
+    #endif
     }
 
     void add(uint16 id, short4 uv, TR::TextureInfo *tex) {
@@ -838,7 +883,7 @@ struct Atlas {
         return true;
     }
 
-    Texture* pack(uint32 opt) {
+    void build() {
     // TODO TR2 fix CUT2 AV
 //        width  = 4096;//nextPow2(int(sqrtf(float(size))));
 //        height = 2048;//(width * width / 2 > size) ? (width / 2) : width;
@@ -880,19 +925,71 @@ struct Atlas {
 
         delete[] indices;
 
-        AtlasColor *data = new AtlasColor[width * height];
+        data = new AtlasColor[width * height];
         memset(data, 0, width * height * sizeof(data[0]));
         fill(root, data);
         fillInstances();
+    }
+
+    Texture* pack(uint32 opt) {
+        if (!data)
+            build();
 
         Texture *atlas = new Texture(width, height, 1, ATLAS_FORMAT, opt, data);
 
         //Texture::SaveBMP("atlas", (char*)data, width, height);
 
         delete[] data;
+        data = NULL;
+    #ifdef USE_ATLAS_INDEXED
+        delete[] indices;
+        indices = NULL;
+    #endif
         return atlas;
     };
 
+#ifdef USE_ATLAS_INDEXED
+    // adds the packed colors to the palette, false if they don't fit into it (the colors are kept for pack())
+    bool toIndexed(AtlasPalette &palette) {
+        if (!data)
+            build();
+
+        int count = width * height;
+        indices = new uint8[count];
+
+        Color32 last(0U);
+        int     lastIndex = palette.getIndex(last); // transparent
+
+        for (int i = 0; i < count; i++) {
+            if (data[i].value != last.value) {
+                last      = data[i];
+                lastIndex = palette.getIndex(last);
+                if (lastIndex == -1) {
+                    delete[] indices;
+                    indices = NULL;
+                    return false;
+                }
+            }
+            indices[i] = uint8(lastIndex);
+        }
+
+        return true;
+    }
+
+    // palette indices are not interpolated, so no filtering and mipmaps
+    Texture* packIndexed() {
+        ASSERT(indices);
+
+        Texture *atlas = new Texture(width, height, 1, FMT_LUMINANCE, OPT_NEAREST, indices);
+
+        delete[] data;
+        delete[] indices;
+        data    = NULL;
+        indices = NULL;
+        return atlas;
+    }
+#endif
+
     void fill(Node *node, void *data) {
         if (!node) return;
 
@@ -0,0 +1,2 @@
+set -e
+g++ -std=c++11 -O2 -fno-exceptions -fno-rtti -DNDEBUG main.cpp -I../../ -o watersim -lEGL -lGL
@@ -0,0 +1,247 @@
+// compares the CPU water simulation (WATER_SIM_CPU) with the water.glsl passes
+// runs on any EGL driver with surfaceless contexts (Mesa llvmpipe is enough)
+// usage: watersim [half]
+#define GL_GLEXT_PROTOTYPES
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#define ENGINE_TLS
+#include "utils.h"
+#define H_CORE // watersim.h needs only the engine types
+#define NOISE_TEX_SIZE 32
+enum TexFormat { FMT_RG_FLOAT = 1, FMT_RG_HALF };
+#include "watersim.h"
+
+static std::string source;
+
+GLuint program(const char *defs) {
+    const char *vh = "#version 150\n#define VERTEX\n#define varying out\n#define attribute in\n#define texture2D texture\n";
+    const char *fh = "#version 150\n#define FRAGMENT\n#define varying in\n#define texture2D texture\nout vec4 fragColor;\n";
+    GLuint p = glCreateProgram();
+    const char *code[2][3] = { { vh, defs, source.c_str() }, { fh, defs, source.c_str() } };
+    GLenum type[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+    for (int i = 0; i < 2; i++) {
+        GLuint s = glCreateShader(type[i]);
+        glShaderSource(s, 3, code[i], NULL);
+        glCompileShader(s);
+        char info[4096]; info[0] = 0;
+        glGetShaderInfoLog(s, sizeof(info), NULL, info);
+        if (info[0]) printf("shader: %s\n", info);
+        glAttachShader(p, s);
+    }
+    glBindAttribLocation(p, 0, "aCoord");
+    glLinkProgram(p);
+    glUseProgram(p);
+    const char *samplers[] = { "sDiffuse", "sNormal", "sReflect", "sShadow", "sMask" };
+    for (int i = 0; i < 5; i++) {
+        GLint l = glGetUniformLocation(p, samplers[i]);
+        if (l != -1) glUniform1i(l, i);
+    }
+    return p;
+}
+
+void uniform(GLuint p, const char *name, float x, float y, float z, float w) {
+    glUniform4f(glGetUniformLocation(p, name), x, y, z, w);
+}
+
+GLuint texture(GLenum ifmt, int w, int h, GLenum fmt, GLenum type, const void *data, GLenum filter, GLenum wrap) {
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexImage2D(GL_TEXTURE_2D, 0, ifmt, w, h, 0, fmt, type, data);
+    return id;
+}
+
+void bind(int unit, GLuint id) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, id);
+}
+
+int main(int argc, char **argv) {
+    bool half = argc > 1 && !strcmp(argv[1], "half"); // engine data texture format
+
+    PFNEGLGETPLATFORMDISPLAYEXTPROC gpd = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    EGLDisplay d = gpd(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    eglInitialize(d, NULL, NULL);
+    eglBindAPI(EGL_OPENGL_API);
+    EGLContext ctx = eglCreateContext(d, NULL, EGL_NO_CONTEXT, NULL);
+    eglMakeCurrent(d, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    {
+        FILE *f = fopen("../../shaders/water.glsl", "rb");
+        if (!f) {
+            printf("can't open water.glsl\n");
+            return 1;
+        }
+        char buf[65536]; int n = fread(buf, 1, sizeof(buf), f); fclose(f);
+        std::string s(buf, n);
+        s = s.substr(s.find('(') + 1);
+        s = s.substr(0, s.rfind(')'));
+        source = "#line 0\n" + s;
+    }
+
+// engine noise texture
+    uint8 noiseData[32 * 32 * 4];
+    for (int i = 0; i < 32 * 32 * 4; i++)
+        noiseData[i] = rand() % 255;
+
+    const int MW = 3, MH = 2, TILE = 64, W = MW * TILE, H = MH * TILE, CS = 512, GRID = 48;
+    uint8 mask[MW * MH] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0xFF };
+
+    WaterSim sim(MW, MH, mask, TILE, noiseData, CS, GRID);
+
+    GLuint tNoise = texture(GL_RGBA8, 32, 32, GL_RGBA, GL_UNSIGNED_BYTE, noiseData, GL_LINEAR, GL_REPEAT);
+    GLuint tMask  = texture(GL_R8, MW, MH, GL_RED, GL_UNSIGNED_BYTE, mask, GL_NEAREST, GL_CLAMP_TO_EDGE);
+    GLenum dataFmt = half ? GL_RG16F : GL_RG32F;
+    std::vector<float> zero(W * H * 2, 0.0f);
+    GLuint tData[2] = { texture(dataFmt, W, H, GL_RG, GL_FLOAT, zero.data(), GL_LINEAR, GL_CLAMP_TO_EDGE),
+                        texture(dataFmt, W, H, GL_RG, GL_FLOAT, zero.data(), GL_LINEAR, GL_CLAMP_TO_EDGE) };
+    GLuint tCaust = texture(GL_RGBA8, CS, CS, GL_RGBA, GL_UNSIGNED_BYTE, NULL, GL_LINEAR, GL_CLAMP_TO_EDGE);
+
+    GLuint fbo;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    float quad[] = { -32767, -32767, 0, 1,  32767, -32767, 0, 1,  32767, 32767, 0, 1,  -32767, -32767, 0, 1,  32767, 32767, 0, 1,  -32767, 32767, 0, 1 };
+    std::vector<float> plane;
+    for (int j = -GRID; j <= GRID; j++)
+        for (int i = -GRID; i <= GRID; i++) {
+            plane.push_back(i); plane.push_back(j); plane.push_back(0); plane.push_back(1);
+        }
+    std::vector<unsigned int> planeIdx;
+    int C = GRID * 2 + 1;
+    for (int j = 0; j < C - 1; j++)
+        for (int i = 0; i < C - 1; i++) {
+            int idx = j * C + i;
+            unsigned int t[] = { unsigned(idx + C), unsigned(idx + 1), unsigned(idx), unsigned(idx + C + 1), unsigned(idx + 1), unsigned(idx + C) };
+            planeIdx.insert(planeIdx.end(), t, t + 6);
+        }
+
+    GLuint vbo[3];
+    glGenBuffers(3, vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+    glBufferData(GL_ARRAY_BUFFER, plane.size() * 4, plane.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[2]);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, planeIdx.size() * 4, planeIdx.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+
+    GLuint pDrop  = program("#define VER3\n#define WATER_DROP\n");
+    GLuint pSim   = program("#define VER3\n#define WATER_SIMULATE\n");
+    GLuint pCaust = program("#define VER3\n#define WATER_CAUSTICS\n");
+
+    int cur = 0;
+    auto pass = [&](GLuint p) {
+        glUseProgram(p);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tData[cur ^ 1], 0);
+        glViewport(0, 0, W, H);
+        bind(1, tData[cur]);
+        bind(0, tNoise);
+        bind(4, tMask);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        bind(1, 0);
+        cur ^= 1;
+    };
+
+    struct { float x, y, r, s; } drops[] = { { 40.3f, 50.7f, 20.0f, 0.1f }, { 150.0f, 30.0f, 12.0f, 0.05f }, { 96.0f, 100.0f, 30.0f, 0.2f } };
+
+    for (int i = 0; i < 3; i++) {
+        sim.drop(drops[i].x, drops[i].y, drops[i].r, drops[i].s);
+        glUseProgram(pDrop);
+        uniform(pDrop, "uTexParam", 1.0f / W, 1.0f / H, 1.0f, 1.0f);
+        uniform(pDrop, "uParam", drops[i].x, drops[i].y, drops[i].r, -drops[i].s);
+        pass(pDrop);
+    }
+
+    const int STEPS = 200;
+    float time = 3.7f;
+    for (int i = 0; i < STEPS; i++) {
+        time += 0.025f;
+        sim.step(time);
+        glUseProgram(pSim);
+        uniform(pSim, "uParam", 0.995f, 1.0f, 0.0f, time);
+        uniform(pSim, "uTexParam", 1.0f / W, 1.0f / H, 1.0f, 1.0f);
+        uniform(pSim, "uRoomSize", 1.0f / MW, 1.0f / MH, 1.0f, 1.0f);
+        pass(pSim);
+    }
+
+    std::vector<float> gpu(W * H * 2);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tData[cur], 0);
+    glReadPixels(0, 0, W, H, GL_RG, GL_FLOAT, gpu.data());
+
+    float maxH = 0.0f, maxDiff = 0.0f, sumDiff = 0.0f;
+    for (int y = 0; y < H; y++) {
+        float *h = sim.getHeight(y);
+        for (int x = 0; x < W; x++) {
+            float g = gpu[(y * W + x) * 2];
+            maxH = max(maxH, fabsf(g));
+            float d = fabsf(g - h[x]);
+            maxDiff = max(maxDiff, d);
+            sumDiff += d;
+        }
+    }
+    printf("simulate (%s, %d steps): max |h| %.5f, max diff %.6f, mean diff %.7f\n", half ? "RG16F" : "RG32F", STEPS, maxH, maxDiff, sumDiff / (W * H));
+
+// caustics from the same height field (CPU state uploaded to isolate the pass)
+    std::vector<float> state(W * H * 2);
+    sim.getData(FMT_RG_FLOAT, state.data());
+    bind(1, tData[cur]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, W, H, 0, GL_RG, GL_FLOAT, state.data());
+
+    sim.calcCaustics();
+    std::vector<Color32> cpuC(CS * CS);
+    sim.getCaustics(cpuC.data());
+
+    glUseProgram(pCaust);
+    uniform(pCaust, "uTexParam", 1.0f / W, 1.0f / H, 1.0f, 1.0f);
+    float ps[8] = { 0, 0, 0, 0, 32767.0f / GRID, 32767.0f / GRID, 32767.0f / GRID, 32767.0f / GRID };
+    glUniform4fv(glGetUniformLocation(pCaust, "uPosScale"), 2, ps);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tCaust, 0);
+    glViewport(0, 0, CS, CS);
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glViewport(1, 1, CS - 1, CS - 1);
+    bind(1, tData[cur]);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, 0);
+    glDrawElements(GL_TRIANGLES, planeIdx.size(), GL_UNSIGNED_INT, 0);
+
+    std::vector<uint8> gpuC(CS * CS * 4);
+    glReadPixels(0, 0, CS, CS, GL_RGBA, GL_UNSIGNED_BYTE, gpuC.data());
+
+    int diff0 = 0, diff1 = 0, diffBig = 0, maxC = 0, lit = 0;
+    double sum = 0;
+    for (int i = 0; i < CS * CS; i++) {
+        int a = cpuC[i].r, b = gpuC[i * 4];
+        int d = abs(a - b);
+        if (b) lit++;
+        if (d == 0) diff0++; else if (d == 1) diff1++; else diffBig++;
+        maxC = max(maxC, d);
+        sum += d;
+    }
+    printf("caustics %dx%d: %d lit, exact %.2f%%, off by 1 %.2f%%, more %.3f%% (max %d, mean %.4f)\n", CS, CS, lit,
+           diff0 * 100.0 / (CS * CS), diff1 * 100.0 / (CS * CS), diffBig * 100.0 / (CS * CS), maxC, sum / (CS * CS));
+
+// tolerance: float precision for the data texture, and half float rounding; 1/255 for the rasterizer edge cases
+    bool ok = maxDiff < (half ? 0.005f : 0.0001f) && diff0 + diff1 >= CS * CS * 999 / 1000;
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -20,20 +20,20 @@ extern char command[256];
 #endif
 
 namespace UI {
-    IGame    *game;
-    float    width, height;
-    float    helpTipTime;
-    float    hintTime;
-    float    subsTime;
-    int      subsPartTime;
-    int      subsPartLength;
-    int      subsPos;
-    int      subsLength;
+    ENGINE_TLS IGame    *game;
+    ENGINE_TLS float    width, height;
+    ENGINE_TLS float    helpTipTime;
+    ENGINE_TLS float    hintTime;
+    ENGINE_TLS float    subsTime;
+    ENGINE_TLS int      subsPartTime;
+    ENGINE_TLS int      subsPartLength;
+    ENGINE_TLS int      subsPos;
+    ENGINE_TLS int      subsLength;
 
-    StringID hintStr;
-    StringID subsStr;
+    ENGINE_TLS StringID hintStr;
+    ENGINE_TLS StringID subsStr;
 
-    bool     showHelp;
+    ENGINE_TLS bool     showHelp;
 
     struct PickupItem {
         float      time;
@@ -43,9 +43,9 @@ namespace UI {
         Animation *animation;
     };
 
-    Array<PickupItem> pickups;
+    ENGINE_TLS Array<PickupItem> pickups;
 
-    int advGlyphsStart;
+    ENGINE_TLS int advGlyphsStart;
 
     #define RU_MAP              "" "i~\"^"
     #define RU_GLYPH_COUNT      (COUNT(RU_MAP) - 1)
@@ -261,7 +261,7 @@ namespace UI {
     }
 
     #ifdef SPLIT_BY_TILE
-        uint16 curTile, curClut;
+        ENGINE_TLS uint16 curTile, curClut;
     #endif
 
     void begin(float aspect) {
@@ -10,7 +10,7 @@
 #ifdef _DEBUG
     #if defined(_OS_WP8)
         #define debugBreak() /* TODO */
-    #elif defined(_OS_LINUX) || defined(_OS_RPI) || defined(_OS_CLOVER)
+    #elif defined(_OS_LINUX) || defined(_OS_RPI) || defined(_OS_CLOVER) || defined(_OS_HEADLESS)
         #define debugBreak() raise(SIGTRAP);
     #elif defined(_OS_3DS)
         #define debugBreak() svcBreak(USERBREAK_ASSERT);
@@ -265,24 +265,15 @@ void sort(T *items, int count) {
 
 
 namespace Noise { // based on https://github.com/Auburns/FastNoise
-    int seed;
+    ENGINE_TLS int seed;
 
-    uint8 m_perm[512];
-    uint8 m_perm12[512];
+    ENGINE_TLS uint8 m_perm[512];
+    ENGINE_TLS uint8 m_perm12[512];
 
     const float GRAD_X[] = { 1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0 };
     const float GRAD_Y[] = { 1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1 };
     const float GRAD_Z[] = { 0, 0, 0, 0, 1, 1, -1, -1, 1, 1, -1, -1 };
 
-    uint8 index(int x, int y, int z) {
-        return m_perm12[(x & 0xff) + m_perm[(y & 0xff) + m_perm[(z & 0xff)]]];
-    }
-
-    float noise(int x, int y, int z, float xd, float yd, float zd) {
-        uint8 lutPos = index(x, y, z);
-        return xd * GRAD_X[lutPos] + yd * GRAD_Y[lutPos] + zd * GRAD_Z[lutPos];
-    }
-
     void setSeed(int seed) {
         Noise::seed = seed;
         srand(seed);
@@ -299,66 +290,106 @@ namespace Noise { // based on https://github.com/Auburns/FastNoise
         }
     }
 
-    float value(float x, float y, float z, int size) {
-        x *= size;
-        y *= size;
-        z *= size;
-
-        int x0 = (int)x;
-        int y0 = (int)y;
-        int z0 = (int)z;
-        int x1 = (x0 + 1) % size;
-        int y1 = (y0 + 1) % size;
-        int z1 = (z0 + 1) % size;
+    // lattice coordinates along one axis, the volume is separable along x, y and z
+    struct Lattice {
+        int   i0, i1;
+        float d0, d1, f;
+    };
 
-        float dx0 = x - x0;
-        float dy0 = y - y0;
-        float dz0 = z - z0;
-        float dx1 = dx0 - 1;
-        float dy1 = dy0 - 1;
-        float dz1 = dz0 - 1;
+    void getLattice(Lattice *axis, int size, int frequency) {
+        float isize = 1.0f / size;
+        for (int i = 0; i < size; i++) {
+            Lattice &l = axis[i];
+            float t = (i * isize) * frequency;
+            l.i0 = (int)t;
+            l.i1 = (l.i0 + 1) % frequency;
+            l.d0 = t - l.i0;
+            l.d1 = l.d0 - 1;
+            l.f  = quintic(l.d0);
+        }
+    }
 
-        float fx = quintic(dx0);
-        float fy = quintic(dy0);
-        float fz = quintic(dz0);
+    // accumulate one octave into the [zStart, zEnd) slices of the volume
+    // a row is done in two passes: gradient lookups of the 8 cell corners into
+    // contiguous arrays, then the trilinear blend that gets vectorized by the compiler
+    void octave(float *out, const Lattice *axis, int size, float amplitude, int zStart, int zEnd) {
+        float *xf = new float[size * 9];
+        float *n  = xf + size; // 8 corners x size
 
-        return lerp(lerp(lerp(noise(x0, y0, z0, dx0, dy0, dz0), noise(x1, y0, z0, dx1, dy0, dz0), fx),
-                         lerp(noise(x0, y1, z0, dx0, dy1, dz0), noise(x1, y1, z0, dx1, dy1, dz0), fx), fy),
-                    lerp(lerp(noise(x0, y0, z1, dx0, dy0, dz1), noise(x1, y0, z1, dx1, dy0, dz1), fx),
-                         lerp(noise(x0, y1, z1, dx0, dy1, dz1), noise(x1, y1, z1, dx1, dy1, dz1), fx), fy), fz);
-    }
+        for (int x = 0; x < size; x++) {
+            xf[x] = axis[x].f;
+        }
 
-    uint8* generate(uint32 seed, int size, int octaves, int frequency, float amplitude) {
-        setSeed(seed);
+        float *ptr = out + zStart * size * size;
 
-        float *out = new float[size * size * size];
-        memset(out, 0, size * size * size * sizeof(float));
+        for (int z = zStart; z < zEnd; z++) {
+            const Lattice &lz = axis[z];
+            int pz0 = m_perm[lz.i0 & 0xff];
+            int pz1 = m_perm[lz.i1 & 0xff];
 
-        float isize = 1.0f / size;
+            for (int y = 0; y < size; y++, ptr += size) {
+                const Lattice &ly = axis[y];
 
-        for (int j = 0; j < octaves; j++) {
-            float *ptr = out;
+                for (int i = 0; i < 4; i++) {
+                    int   b  = m_perm[(((i & 1) ? ly.i1 : ly.i0) & 0xff) + ((i & 2) ? pz1 : pz0)];
+                    float yd = (i & 1) ? ly.d1 : ly.d0;
+                    float zd = (i & 2) ? lz.d1 : lz.d0;
+                    float *n0 = n + (i * 2 + 0) * size;
+                    float *n1 = n + (i * 2 + 1) * size;
 
-            for (int z = 0; z < size; z++) {
-                float iz = z * isize;
-                for (int y = 0; y < size; y++) {
-                    float iy = y * isize;
                     for (int x = 0; x < size; x++) {
-                        float ix = x * isize;
-                        *ptr++ += value(ix, iy, iz, frequency) * amplitude;
+                        const Lattice &lx = axis[x];
+                        uint8 g0 = m_perm12[(lx.i0 & 0xff) + b];
+                        uint8 g1 = m_perm12[(lx.i1 & 0xff) + b];
+                        n0[x] = lx.d0 * GRAD_X[g0] + yd * GRAD_Y[g0] + zd * GRAD_Z[g0];
+                        n1[x] = lx.d1 * GRAD_X[g1] + yd * GRAD_Y[g1] + zd * GRAD_Z[g1];
                     }
                 }
+
+                const float *n000 = n, *n100 = n + size,     *n010 = n + size * 2, *n110 = n + size * 3;
+                const float *n001 = n + size * 4, *n101 = n + size * 5, *n011 = n + size * 6, *n111 = n + size * 7;
+
+                for (int x = 0; x < size; x++) {
+                    ptr[x] += lerp(lerp(lerp(n000[x], n100[x], xf[x]), lerp(n010[x], n110[x], xf[x]), ly.f),
+                                   lerp(lerp(n001[x], n101[x], xf[x]), lerp(n011[x], n111[x], xf[x]), ly.f), lz.f) * amplitude;
+                }
             }
+        }
 
+        delete[] xf;
+    }
+
+    // fractal noise of the [zStart, zEnd) slices, slices are independent and can be generated in parallel
+    void generate(float *out, int size, int octaves, int frequency, float amplitude, int zStart, int zEnd) {
+        Lattice *axis = new Lattice[size];
+
+        memset(out + zStart * size * size, 0, (zEnd - zStart) * size * size * sizeof(float));
+
+        for (int j = 0; j < octaves; j++) {
+            getLattice(axis, size, frequency);
+            octave(out, axis, size, amplitude, zStart, zEnd);
             frequency *= 2;
             amplitude *= 0.5f;
         }
 
-        uint8 *dst = new uint8[size * size * size];
-        for (int i = 0; i < size * size * size; i++) {
-            dst[i] = clamp(int((out[i] * 0.5f + 0.5f) * 255.0f), 0, 255);
+        delete[] axis;
+    }
+
+    uint8* quantize(const float *data, int count) {
+        uint8 *dst = new uint8[count];
+        for (int i = 0; i < count; i++) {
+            dst[i] = clamp(int((data[i] * 0.5f + 0.5f) * 255.0f), 0, 255);
         }
+        return dst;
+    }
 
+    uint8* generate(uint32 seed, int size, int octaves, int frequency, float amplitude) {
+        setSeed(seed);
+
+        float *out = new float[size * size * size];
+        generate(out, size, octaves, frequency, amplitude, 0, size);
+
+        uint8 *dst = quantize(out, size * size * size);
         delete[] out;
 
         return dst;
@@ -1673,6 +1704,149 @@ struct Array {
 };
 
 
+// linear allocator for data with the same lifetime (level data etc.)
+// memory is zero initialized and released at once by release()
+#define ARENA_BLOCK_SIZE (256 * 1024)
+
+struct Arena {
+    struct Block {
+        Block *next;
+        int32 size;
+        int32 used;
+    } *blocks;
+
+    int32 allocs;
+    int32 bytes;
+    int32 peak;
+
+    Arena() : blocks(NULL), allocs(0), bytes(0), peak(0) {}
+
+    ~Arena() {
+        release();
+    }
+
+    void* alloc(int32 size) {
+        if (size <= 0)
+            return NULL;
+
+        size = (size + 15) & ~15;
+
+        if (!blocks || blocks->used + size > blocks->size) {
+            int32 blockSize = max(size, ARENA_BLOCK_SIZE);
+            Block *block = (Block*)malloc(sizeof(Block) + 16 + blockSize);
+            block->next = blocks;
+            block->size = blockSize;
+            block->used = 0;
+            blocks = block;
+        }
+
+        uint8 *data = (uint8*)(((size_t)(blocks + 1) + 15) & ~size_t(15)) + blocks->used;
+        blocks->used += size;
+
+        allocs++;
+        bytes += size;
+        peak   = max(peak, bytes);
+
+        memset(data, 0, size);
+        return data;
+    }
+
+    template <typename T>
+    T* alloc(int32 count) { // POD types only, no constructor / destructor calls
+        return (T*)alloc(count * int32(sizeof(T)));
+    }
+
+    void release() {
+        while (blocks) {
+            Block *next = blocks->next;
+            ::free(blocks);
+            blocks = next;
+        }
+        allocs = bytes = 0;
+    }
+};
+
+// fixed-size object pool with the intrusive free list
+// used by class operator new / delete, falls back to the heap when exhausted
+struct PoolStats {
+    const char *name;
+    int32      allocs, live, peak, fallbacks;
+    PoolStats  *next;
+
+    static ENGINE_TLS PoolStats *first;
+};
+
+ENGINE_TLS PoolStats *PoolStats::first = NULL;
+
+template <typename T, int N>
+struct Pool {
+    union Slot {
+        Slot   *next;
+        uint8  data[sizeof(T)];
+        double align;
+    };
+
+    static ENGINE_TLS Slot      slots[N];
+    static ENGINE_TLS Slot      *free;
+    static ENGINE_TLS bool      ready;
+    static ENGINE_TLS PoolStats stats;
+
+    static void init() {
+        for (int i = 0; i < N - 1; i++)
+            slots[i].next = &slots[i + 1];
+        slots[N - 1].next = NULL;
+        free  = slots;
+        ready = true;
+
+        stats.next = PoolStats::first;
+        PoolStats::first = &stats;
+    }
+
+    static void* alloc(size_t size, const char *name) {
+        if (!ready) {
+            stats.name = name;
+            init();
+        }
+
+        stats.allocs++;
+
+        if (size > sizeof(Slot) || !free) {
+            stats.fallbacks++;
+            return ::operator new(size);
+        }
+
+        Slot *slot = free;
+        free = slot->next;
+
+        stats.live++;
+        stats.peak = max(stats.peak, stats.live);
+        return slot;
+    }
+
+    static void dealloc(void *ptr) {
+        if (!ptr) return;
+
+        Slot *slot = (Slot*)ptr;
+        if (slot < slots || slot >= slots + N) {
+            ::operator delete(ptr);
+            return;
+        }
+
+        slot->next = free;
+        free = slot;
+        stats.live--;
+    }
+};
+
+template <typename T, int N> ENGINE_TLS typename Pool<T, N>::Slot  Pool<T, N>::slots[N];
+template <typename T, int N> ENGINE_TLS typename Pool<T, N>::Slot *Pool<T, N>::free  = NULL;
+template <typename T, int N> ENGINE_TLS bool                       Pool<T, N>::ready = false;
+template <typename T, int N> ENGINE_TLS PoolStats                  Pool<T, N>::stats;
+
+#define DECL_POOLED(T, N) \
+    static void* operator new(size_t size) { return Pool<T, N>::alloc(size, #T); } \
+    static void  operator delete(void *ptr) { Pool<T, N>::dealloc(ptr); }
+
 struct Stream;
 
 extern void osCacheWrite (Stream *stream);
@@ -1681,6 +1855,17 @@ extern void osCacheRead  (Stream *stream);
 extern void osReadSlot   (Stream *stream);
 extern void osWriteSlot  (Stream *stream);
 
+#if defined(OS_FILEIO_CACHE) && defined(OS_PTHREAD_MT)
+    #define OS_IO_THREAD
+#endif
+
+#ifdef OS_IO_THREAD
+enum IORequestType { IO_OPEN, IO_READ, IO_WRITE };
+
+extern void osIORequest  (Stream *stream, IORequestType type, const char *path);
+extern void osIOCancel   (void *userData);
+#endif
+
 #ifdef _OS_LINUX
 extern const char* osFixFileName(const char* fileName);
 #endif
@@ -1814,9 +1999,9 @@ struct Stream {
         }
     };
 
-    static Pack* packs[MAX_PACKS];
+    static ENGINE_TLS Pack* packs[MAX_PACKS];
 
-    static Array<char*> fileList;
+    static ENGINE_TLS Array<char*> fileList;
 
     static bool addPack(const char *name)
     {
@@ -1863,7 +2048,13 @@ private:
 
     void openFile() {
         char path[255];
+        getFilePath(path);
+        f = fopen(path, "rb");
+        openFinish();
+    }
+public:
 
+    void getFilePath(char *path) {
         path[0] = 0;
         if (contentDir[0] && (!cacheDir[0] || !strstr(name, cacheDir))) {
             strcpy(path, contentDir);
@@ -1876,9 +2067,9 @@ private:
     #endif
 
         fixBackslash(path);
+    }
 
-        f = fopen(path, "rb");
-
+    void openFinish() {
         if (!f) {
             #ifdef _OS_WEB
                 osDownload(this);
@@ -1902,7 +2093,6 @@ private:
             if (callback) callback(this, userData);
         }
     }
-public:
 
     Stream(const char *name, const void *data, int size, Callback *callback = NULL, void *userData = NULL) : callback(callback), userData(userData), f(NULL), data((char*)data), name(NULL), size(size), pos(0), buffer(NULL) {
         this->name = StrUtils::copy(name);
@@ -1966,6 +2156,15 @@ public:
         }*/
     #endif
 
+    #ifdef OS_IO_THREAD
+        if (callback) {
+            char path[255];
+            getFilePath(path);
+            osIORequest(this, IO_OPEN, path);
+            return;
+        }
+    #endif
+
         openFile();
     }
 
@@ -1975,6 +2174,13 @@ public:
         if (f) fclose(f);
     }
 
+    // drops the callbacks of the async requests of the owner, call it before the owner is freed
+    static void cancel(void *userData) {
+    #ifdef OS_IO_THREAD
+        osIOCancel(userData);
+    #endif
+    }
+
 #if _OS_3DS
     static void readDirectory(const FS_Archive &archive, const char* path) {
         char buf[255];
@@ -2281,6 +2487,16 @@ public:
         return a;
     }
 
+    template <typename T>
+    inline T* read(T *&a, int count, Arena &arena) {
+        if (count) {
+            a = arena.alloc<T>(count);
+            raw(a, count * sizeof(T));
+        } else
+            a = NULL;
+        return a;
+    }
+
     inline uint8 read() {
         uint8 x;
         return read(x);
@@ -2312,10 +2528,25 @@ public:
     }
 };
 
-Stream::Pack* Stream::packs[MAX_PACKS];
-Array<char*> Stream::fileList;
+ENGINE_TLS Stream::Pack* Stream::packs[MAX_PACKS];
+ENGINE_TLS Array<char*> Stream::fileList;
 
 #ifdef OS_FILEIO_CACHE
+#ifdef OS_IO_THREAD
+void osDataWrite(Stream *stream, const char *dir) {
+    char path[255];
+    strcpy(path, dir);
+    strcat(path, stream->name);
+    osIORequest(stream, IO_WRITE, path);
+}
+
+void osDataRead(Stream *stream, const char *dir) {
+    char path[255];
+    strcpy(path, dir);
+    strcat(path, stream->name);
+    osIORequest(stream, IO_READ, path);
+}
+#else
 void osDataWrite(Stream *stream, const char *dir) {
     char path[255];
     strcpy(path, dir);
@@ -2353,6 +2584,7 @@ void osDataRead(Stream *stream, const char *dir) {
             stream->callback(NULL, stream->userData);
     delete stream;
 }
+#endif
 
 void osCacheWrite(Stream *stream) {
     osDataWrite(stream, cacheDir);
@@ -2426,6 +2658,306 @@ void osRWLockWrite(void *obj) {
 void osRWUnlockWrite(void *obj) {
     pthread_rwlock_unlock((pthread_rwlock_t*)obj);
 }
+
+typedef void (ThreadProc)(void *arg);
+
+struct ThreadParams {
+    ThreadProc *proc;
+    void       *arg;
+};
+
+void* osThreadEntry(void *arg) {
+    ThreadParams params = *(ThreadParams*)arg;
+    delete (ThreadParams*)arg;
+    params.proc(params.arg);
+    return NULL;
+}
+
+void* osThreadCreate(ThreadProc *proc, void *arg) {
+    ThreadParams *params = new ThreadParams();
+    params->proc = proc;
+    params->arg  = arg;
+
+    pthread_t *thread = new pthread_t();
+    if (pthread_create(thread, NULL, osThreadEntry, params) != 0) {
+        delete params;
+        delete thread;
+        return NULL;
+    }
+    return thread;
+}
+
+void osThreadJoin(void *obj) {
+    pthread_join(*(pthread_t*)obj, NULL);
+    delete (pthread_t*)obj;
+}
+#endif
+
+#ifdef OS_IO_THREAD
+// file requests are served by a single I/O thread in FIFO order
+// completion callbacks are called on the main thread by osIOUpdate
+struct IORequest {
+    IORequest     *next;
+    Stream        *stream;
+    IORequestType type;
+    char          path[255];
+    char          *data;    // IO_WRITE: private copy of the stream data, IO_READ: file content
+    int           size;
+    bool          success;
+    bool          canceled; // the owner of the callback is freed, only release the stream
+    int           time;
+};
+
+struct IOQueue {
+    IORequest *first, *last;
+
+    void push(IORequest *req) {
+        req->next = NULL;
+        if (last)
+            last->next = req;
+        else
+            first = req;
+        last = req;
+    }
+
+    IORequest* pop() {
+        IORequest *req = first;
+        if (req) {
+            first = req->next;
+            if (!first) last = NULL;
+        }
+        return req;
+    }
+};
+
+struct IOStats {
+    int requests;
+    int depth;      // queued, in progress or waiting for the completion callback
+    int maxDepth;
+    int latency;    // ms from the request to its completion callback
+    int maxLatency;
+} ioStats;
+
+pthread_mutex_t ioLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t  ioWake = PTHREAD_COND_INITIALIZER;
+IOQueue         ioPending;
+IOQueue         ioDone;
+IOQueue         ioComplete; // taken from ioDone by osIOUpdate, waiting for the callback call
+IORequest       *ioActive;
+void            *ioThread;
+bool            ioQuit;
+
+extern int osGetTimeMS();
+
+bool osIORead(IORequest *req) {
+    FILE *f = fopen(req->path, "rb");
+    if (!f) return false;
+
+    fseek(f, 0, SEEK_END);
+    req->size = (int)ftell(f);
+    fseek(f, 0, SEEK_SET);
+    req->data = new char[req->size];
+    bool ok = (int)fread(req->data, 1, req->size, f) == req->size;
+    fclose(f);
+    return ok;
+}
+
+// write to a temporary file and rename it over the target,
+// so an interrupted write never leaves a truncated cache or save file
+bool osIOWrite(IORequest *req) {
+    char tmp[260];
+    strcpy(tmp, req->path);
+    strcat(tmp, ".tmp");
+
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return false;
+
+    bool ok = (int)fwrite(req->data, 1, req->size, f) == req->size;
+    ok = (fflush(f) == 0) && ok;
+    ok = (fclose(f) == 0) && ok;
+
+    if (ok) {
+        ok = rename(tmp, req->path) == 0;
+    }
+
+    if (!ok) {
+        remove(tmp);
+    }
+    return ok;
+}
+
+void osIOExecute(IORequest *req) {
+    switch (req->type) {
+        case IO_OPEN  :
+            req->stream->f = fopen(req->path, "rb");
+            req->success = req->stream->f != NULL;
+            break;
+        case IO_READ  : req->success = osIORead(req);  break;
+        case IO_WRITE : req->success = osIOWrite(req); break;
+    }
+}
+
+void osIOWorker(void *arg) {
+    pthread_mutex_lock(&ioLock);
+    while (1) {
+        IORequest *req = ioPending.pop();
+        if (!req) {
+            if (ioQuit) break;
+            pthread_cond_wait(&ioWake, &ioLock);
+            continue;
+        }
+
+        ioActive = req;
+        pthread_mutex_unlock(&ioLock);
+        osIOExecute(req);
+        pthread_mutex_lock(&ioLock);
+        ioActive = NULL;
+
+        ioDone.push(req);
+    }
+    pthread_mutex_unlock(&ioLock);
+}
+
+void osIORequest(Stream *stream, IORequestType type, const char *path) {
+    IORequest *req = new IORequest();
+    req->stream   = stream;
+    req->type     = type;
+    req->data     = NULL;
+    req->size     = 0;
+    req->success  = false;
+    req->canceled = false;
+    req->time     = osGetTimeMS();
+    strcpy(req->path, path);
+
+    if (type == IO_WRITE) { // the caller may free or modify its data right after the request
+        req->size = stream->size;
+        req->data = new char[req->size];
+        memcpy(req->data, stream->data, req->size);
+    }
+
+    pthread_mutex_lock(&ioLock);
+
+    if (!ioThread) {
+        ioThread = osThreadCreate(osIOWorker, NULL);
+    }
+
+    ioStats.depth++;
+    ioStats.maxDepth = max(ioStats.maxDepth, ioStats.depth);
+
+    if (ioThread) {
+        ioPending.push(req);
+        pthread_cond_signal(&ioWake);
+    } else {
+        osIOExecute(req);
+        ioDone.push(req);
+    }
+
+    pthread_mutex_unlock(&ioLock);
+}
+
+void osIOCancel(IOQueue &queue, void *userData) {
+    for (IORequest *req = queue.first; req; req = req->next)
+        if (req->stream->userData == userData)
+            req->canceled = true;
+}
+
+// any thread, the requests in every stage are marked, so the callback is never called after the owner is freed
+void osIOCancel(void *userData) {
+    if (!userData) return;
+
+    pthread_mutex_lock(&ioLock);
+    osIOCancel(ioPending,  userData);
+    osIOCancel(ioDone,     userData);
+    osIOCancel(ioComplete, userData);
+    if (ioActive && ioActive->stream->userData == userData)
+        ioActive->canceled = true;
+    pthread_mutex_unlock(&ioLock);
+}
+
+void osIOComplete(IORequest *req) {
+    Stream *stream = req->stream;
+
+    if (req->canceled) {
+        if (req->type == IO_WRITE && !req->success) {
+            LOG("! can't write \"%s\"\n", req->path);
+        }
+        delete stream;
+        delete[] req->data;
+        delete req;
+        return;
+    }
+
+    switch (req->type) {
+        case IO_OPEN  :
+            stream->openFinish(); // deletes the stream on failure
+            break;
+        case IO_READ  :
+            if (stream->callback)
+                stream->callback(req->success ? new Stream(stream->name, req->data, req->size) : NULL, stream->userData);
+            delete stream;
+            break;
+        case IO_WRITE :
+            if (!req->success) {
+                LOG("! can't write \"%s\"\n", req->path);
+            }
+            if (stream->callback)
+                stream->callback(req->success ? new Stream(stream->name, stream->data, stream->size) : NULL, stream->userData);
+            delete stream;
+            break;
+    }
+
+    delete[] req->data;
+    delete req;
+}
+
+// main thread, called once per frame before the game update
+void osIOUpdate() {
+    pthread_mutex_lock(&ioLock);
+    ioComplete = ioDone;
+    ioDone.first = ioDone.last = NULL;
+    pthread_mutex_unlock(&ioLock);
+
+    int time = osGetTimeMS();
+
+    while (1) {
+        pthread_mutex_lock(&ioLock);
+        IORequest *req = ioComplete.pop(); // a callback may cancel the rest
+        if (req) ioStats.depth--;
+        pthread_mutex_unlock(&ioLock);
+
+        if (!req) break;
+
+        ioStats.requests++;
+        ioStats.latency    = time - req->time;
+        ioStats.maxLatency = max(ioStats.maxLatency, ioStats.latency);
+
+        osIOComplete(req); // may push new requests
+    }
+}
+
+// waits for the pending writes, completion callbacks of the dropped requests are not called
+void osIOFree() {
+    if (ioThread) {
+        pthread_mutex_lock(&ioLock);
+        ioQuit = true;
+        pthread_cond_signal(&ioWake);
+        pthread_mutex_unlock(&ioLock);
+
+        osThreadJoin(ioThread);
+        ioThread = NULL;
+        ioQuit   = false;
+    }
+
+    IORequest *req;
+    while ((req = ioDone.pop())) {
+        delete req->stream;
+        delete[] req->data;
+        delete req;
+    }
+
+    LOG("io: %d requests, max depth = %d, max latency = %d ms\n", ioStats.requests, ioStats.maxDepth, ioStats.maxLatency);
+    memset(&ioStats, 0, sizeof(ioStats));
+}
 #endif
 
 
@@ -1557,6 +1557,7 @@ struct Video {
         LOG("time: %d\n", Core::getTime() - t);
         isPlaying = false;
     #else
+        PROFILE_ZONE("VIDEO_DECODE");
         isPlaying = needUpdate = decoder->decodeVideo(frameData);
     #endif
     }
@@ -0,0 +1,327 @@
+#ifndef H_WATERSIM
+#define H_WATERSIM
+
+#include "core.h"
+
+// CPU version of the WATER_DROP, WATER_SIMULATE and WATER_CAUSTICS shader passes
+// one height field per water surface (WATER_TILE_SIZE texels per sector)
+// the grids have a border of one texel (copy of the edge, as clamp to edge sampling does),
+// so the row loops have no edge cases and can be vectorized by the compiler
+
+#define WATER_SIM_VEL       1.4f
+#define WATER_SIM_VIS       0.995f
+#define WATER_SIM_NOISE     0.00025f
+#define WATER_SIM_NORMAL_Y  (64.0f / (1024.0f * 8.0f))
+#define WATER_SIM_ETA       0.75f
+
+struct WaterSim {
+    int   width, height;    // texels
+    int   stride;           // width + border
+    int   index;
+    float *value[2];        // height
+    float *speed[2];
+    float *mask;            // 0 or 1 per texel
+    float *noiseRow;
+    float noise[NOISE_TEX_SIZE * NOISE_TEX_SIZE * 2]; // G and R channels of Core::noiseTex
+
+    int   grid;             // caustics mesh is (grid * 2) x (grid * 2) quads (PLANE_DETAIL)
+    int   causticsSize;     // caustics texture size
+    float *caustics;        // light intensity per caustics texel
+    float *vertices;        // window x, y and refracted position x, y, z per caustics mesh vertex
+
+    WaterSim(int maskWidth, int maskHeight, const uint8 *sectorMask, int tile, const uint8 *noiseData, int causticsSize, int grid) : index(0), grid(grid), causticsSize(causticsSize) {
+        width  = maskWidth  * tile;
+        height = maskHeight * tile;
+        stride = width + 2;
+
+        int size = stride * (height + 2);
+        for (int i = 0; i < 2; i++) {
+            value[i] = new float[size];
+            speed[i] = new float[size];
+            memset(value[i], 0, sizeof(float) * size);
+            memset(speed[i], 0, sizeof(float) * size);
+        }
+
+        mask     = new float[width * height];
+        noiseRow = new float[width];
+        caustics = new float[causticsSize * causticsSize];
+        vertices = new float[SQR(grid * 2 + 1) * 5];
+
+        for (int y = 0; y < height; y++)
+            for (int x = 0; x < width; x++)
+                mask[y * width + x] = sectorMask[(y / tile) * maskWidth + x / tile] ? 1.0f : 0.0f;
+
+        memset(caustics, 0, sizeof(float) * causticsSize * causticsSize);
+
+        for (int i = 0; i < NOISE_TEX_SIZE * NOISE_TEX_SIZE; i++) {
+            noise[i * 2 + 0] = noiseData[i * 4 + 1] / 255.0f;
+            noise[i * 2 + 1] = noiseData[i * 4 + 0] / 255.0f;
+        }
+    }
+
+    ~WaterSim() {
+        for (int i = 0; i < 2; i++) {
+            delete[] value[i];
+            delete[] speed[i];
+        }
+        delete[] mask;
+        delete[] noiseRow;
+        delete[] caustics;
+        delete[] vertices;
+    }
+
+    float* getHeight(int y) {
+        return value[index] + (y + 1) * stride + 1;
+    }
+
+    // x, y and radius in texels
+    void drop(float px, float py, float radius, float strength) {
+        int x0 = max(0, int(px - radius)), x1 = min(width  - 1, int(px + radius));
+        int y0 = max(0, int(py - radius)), y1 = min(height - 1, int(py + radius));
+
+        for (int y = y0; y <= y1; y++) {
+            float *h = getHeight(y);
+            float dy = py - (y + 0.5f);
+            for (int x = x0; x <= x1; x++) {
+                float dx = px - (x + 0.5f);
+                float d  = max(0.0f, 1.0f - sqrtf(dx * dx + dy * dy) / radius);
+                h[x] -= (0.5f - cosf(d * PI) * 0.5f) * strength;
+            }
+        }
+    }
+
+    // noise3D of the shader, bilinear fetch of the repeated noise texture
+    float getNoise(float x, float y, float z) {
+        float px = floorf(x), py = floorf(y), pz = floorf(z);
+        float fx = x - px, fy = y - py, fz = z - pz;
+        fx = fx * fx * (3.0f - 2.0f * fx);
+        fy = fy * fy * (3.0f - 2.0f * fy);
+        fz = fz * fz * (3.0f - 2.0f * fz);
+
+        int ix = int(px + 37.0f * pz), iy = int(py + 17.0f * pz);
+        #define NOISE(dx, dy) (noise + (((iy + dy) & (NOISE_TEX_SIZE - 1)) * NOISE_TEX_SIZE + ((ix + dx) & (NOISE_TEX_SIZE - 1))) * 2)
+        const float *n00 = NOISE(0, 0), *n10 = NOISE(1, 0), *n01 = NOISE(0, 1), *n11 = NOISE(1, 1);
+        #undef NOISE
+
+        float a = lerp(lerp(n00[0], n10[0], fx), lerp(n01[0], n11[0], fx), fy);
+        float b = lerp(lerp(n00[1], n10[1], fx), lerp(n01[1], n11[1], fx), fy);
+        return lerp(a, b, fz) * 2.0f - 1.0f;
+    }
+
+    // clamp to edge for the neighbour fetches
+    void updateBorder(float *h) {
+        memcpy(h + 1, h + stride + 1, sizeof(float) * width);
+        memcpy(h + (height + 1) * stride + 1, h + height * stride + 1, sizeof(float) * width);
+        for (int y = 1; y <= height; y++) {
+            float *row = h + y * stride;
+            row[0]         = row[1];
+            row[width + 1] = row[width];
+        }
+    }
+
+    void step(float time) {
+        updateBorder(value[index]);
+
+        const float *h = value[index];
+        const float *v = speed[index];
+        float *hOut = value[index ^ 1];
+        float *vOut = speed[index ^ 1];
+
+        float scaleX = 32.0f / width;
+        float scaleY = 32.0f / height;
+
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++)
+                noiseRow[x] = getNoise((x + 0.5f) * scaleX, (y + 0.5f) * scaleY, time) * WATER_SIM_NOISE;
+
+            int row = (y + 1) * stride + 1;
+            const float *c = h + row;
+            const float *s = v + row;
+            const float *m = mask + y * width;
+            const float *n = noiseRow;
+            float *ho = hOut + row;
+            float *vo = vOut + row;
+
+            for (int x = 0; x < width; x++) {
+                float average = (c[x + 1] + c[x + stride] + c[x - 1] + c[x - stride]) * 0.25f;
+                float sp = (s[x] + (average - c[x]) * WATER_SIM_VEL) * WATER_SIM_VIS;
+                ho[x] = (c[x] + sp + n[x]) * m[x];
+                vo[x] = sp * m[x];
+            }
+        }
+
+        index ^= 1;
+    }
+
+    // bilinear fetch of the height texture, u and v in texels
+    float sampleHeight(float u, float v) {
+        u -= 0.5f;
+        v -= 0.5f;
+        float fu = floorf(u), fv = floorf(v);
+        int x0 = clamp(int(fu), 0, width - 1),  x1 = clamp(int(fu) + 1, 0, width - 1);
+        int y0 = clamp(int(fv), 0, height - 1), y1 = clamp(int(fv) + 1, 0, height - 1);
+        u -= fu;
+        v -= fv;
+        const float *r0 = getHeight(y0);
+        const float *r1 = getHeight(y1);
+        return lerp(lerp(r0[x0], r0[x1], u), lerp(r1[x0], r1[x1], u), v);
+    }
+
+    // the WATER_CAUSTICS pass: the plane mesh is displaced by the refracted light rays
+    // and rasterized into the caustics texture (viewport 1, 1, size - 1, size - 1, the last triangle wins),
+    // every triangle writes the ratio of its old and new area in pixels
+    void calcCaustics() {
+        int   count = grid * 2 + 1;
+        float vp    = float(causticsSize - 1);
+
+        float *vtx = vertices;
+        for (int j = -grid; j <= grid; j++)
+            for (int i = -grid; i <= grid; i++) {
+                float rx = float(i) / grid;
+                float ry = float(j) / grid;
+                float u  = (rx * 0.5f + 0.5f) * width;
+                float v  = (ry * 0.5f + 0.5f) * height;
+
+                float h  = sampleHeight(u, v);
+            // calcNormal (xz - plane, y - up), swizzled to z - up
+                float nx = sampleHeight(u + 1.0f, v) - h;
+                float ny = sampleHeight(u, v + 1.0f) - h;
+                float nz = WATER_SIM_NORMAL_Y;
+                float l  = 1.0f / sqrtf(nx * nx + ny * ny + nz * nz);
+                nx *= l;
+                ny *= l;
+                nz  = nz * l + 0.25f;
+                l   = 1.0f / sqrtf(nx * nx + ny * ny + nz * nz);
+                nx *= l;
+                ny *= l;
+                nz *= l;
+            // refract the vertical light ray
+                float k  = max(0.0f, 1.0f - WATER_SIM_ETA * WATER_SIM_ETA * (1.0f - nz * nz));
+                float t  = -WATER_SIM_ETA * nz + sqrtf(k);
+                float lx = -t * nx;
+                float ly = -t * ny;
+                float lz = -WATER_SIM_ETA - t * nz;
+                float d  = (h - 1.0f) / lz;
+
+                float px = rx + lx * d;
+                float py = ry + ly * d;
+            // window coords, snapped to the 1/256 subpixel grid
+                vtx[0] = floorf((1.0f + (px * 0.5f + 0.5f) * vp) * 256.0f + 0.5f) * (1.0f / 256.0f);
+                vtx[1] = floorf((1.0f + (py * 0.5f + 0.5f) * vp) * 256.0f + 0.5f) * (1.0f / 256.0f);
+                vtx[2] = px;
+                vtx[3] = py;
+                vtx[4] = h - 2.0f - lz;
+                vtx += 5;
+            }
+
+        memset(caustics, 0, sizeof(float) * causticsSize * causticsSize);
+
+        for (int j = 0; j < count - 1; j++)
+            for (int i = 0; i < count - 1; i++) {
+                int idx = j * count + i;
+                drawTriangle(idx + count, idx + 1, idx);
+                drawTriangle(idx + count + 1, idx + 1, idx + count);
+            }
+    }
+
+    // screen space gradient of the linear attribute a, b, c
+    static void getGradient(const float *a, const float *b, const float *c, float e1x, float e1y, float e2x, float e2y, float invDet, vec3 &dx, vec3 &dy) {
+        vec3 d1 = vec3(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+        vec3 d2 = vec3(c[0] - a[0], c[1] - a[1], c[2] - a[2]);
+        dx = (d1 * e2y - d2 * e1y) * invDet;
+        dy = (d2 * e1x - d1 * e2x) * invDet;
+    }
+
+    void drawTriangle(int i0, int i1, int i2) {
+        const float *v0 = vertices + i0 * 5;
+        const float *v1 = vertices + i1 * 5;
+        const float *v2 = vertices + i2 * 5;
+
+        float e1x = v1[0] - v0[0], e1y = v1[1] - v0[1];
+        float e2x = v2[0] - v0[0], e2y = v2[1] - v0[1];
+        float det = e1x * e2y - e2x * e1y;
+        if (det == 0.0f)
+            return;
+        float invDet = 1.0f / det;
+
+    // dFdx & dFdy of vOldPos (the undisplaced plane at z = -1) and vNewPos
+        int   count = grid * 2 + 1;
+        float step  = 1.0f / grid;
+        float o0[3] = { float(i0 % count) * step, float(i0 / count) * step, 0.0f };
+        float o1[3] = { float(i1 % count) * step, float(i1 / count) * step, 0.0f };
+        float o2[3] = { float(i2 % count) * step, float(i2 / count) * step, 0.0f };
+
+        vec3 oldX, oldY, newX, newY;
+        getGradient(o0, o1, o2, e1x, e1y, e2x, e2y, invDet, oldX, oldY);
+        getGradient(v0 + 2, v1 + 2, v2 + 2, e1x, e1y, e2x, e2y, invDet, newX, newY);
+
+        float oldArea = oldX.length() * oldY.length();
+        float newArea = max(newX.length() * newY.length(), 0.00002f);
+        float value   = clamp(oldArea / newArea * 0.2f, 0.0f, 1.0f);
+
+    // pixel centers inside the triangle (counter-clockwise order, top-left fill rule)
+        const float *a = v0, *b = v1, *c = v2;
+        if (det < 0.0f)
+            swap(b, c);
+
+        int minX = max(1, int(ceilf(min(a[0], min(b[0], c[0])) - 0.5f)));
+        int maxX = min(causticsSize - 1, int(floorf(max(a[0], max(b[0], c[0])) - 0.5f)));
+        int minY = max(1, int(ceilf(min(a[1], min(b[1], c[1])) - 0.5f)));
+        int maxY = min(causticsSize - 1, int(floorf(max(a[1], max(b[1], c[1])) - 0.5f)));
+
+        for (int y = minY; y <= maxY; y++) {
+            float py = y + 0.5f;
+            float *dst = caustics + y * causticsSize;
+            for (int x = minX; x <= maxX; x++) {
+                float px = x + 0.5f;
+                if (isInside(a, b, px, py) && isInside(b, c, px, py) && isInside(c, a, px, py))
+                    dst[x] = value;
+            }
+        }
+    }
+
+    static bool isInside(const float *a, const float *b, float px, float py) {
+        float ex = b[0] - a[0], ey = b[1] - a[1];
+        float w  = ex * (py - a[1]) - ey * (px - a[0]);
+        return w > 0.0f || (w == 0.0f && (ey < 0.0f || (ey == 0.0f && ex > 0.0f)));
+    }
+
+    static uint16 toHalf(float value) {
+        union { float f; uint32 i; } u;
+        u.f = value;
+        uint32 sign = (u.i >> 16) & 0x8000;
+        int32  exp  = int32((u.i >> 23) & 0xFF) - 127 + 15;
+        if (exp <= 0)  return uint16(sign); // flush denormals
+        if (exp >= 31) return uint16(sign | 0x7C00);
+        return uint16(sign | (exp << 10) | ((u.i & 0x7FFFFF) >> 13));
+    }
+
+    // height & speed in the layout of the data texture (origWidth x origHeight)
+    void getData(TexFormat format, void *data) {
+        for (int y = 0; y < height; y++) {
+            const float *h = value[index] + (y + 1) * stride + 1;
+            const float *s = speed[index] + (y + 1) * stride + 1;
+            if (format == FMT_RG_HALF) {
+                uint16 *dst = (uint16*)data + y * width * 2;
+                for (int x = 0; x < width; x++) {
+                    dst[x * 2 + 0] = toHalf(h[x]);
+                    dst[x * 2 + 1] = toHalf(s[x]);
+                }
+            } else {
+                float *dst = (float*)data + y * width * 2;
+                for (int x = 0; x < width; x++) {
+                    dst[x * 2 + 0] = h[x];
+                    dst[x * 2 + 1] = s[x];
+                }
+            }
+        }
+    }
+
+    // caustics texture data, the value in the red channel as the shader writes it
+    void getCaustics(Color32 *data) {
+        for (int i = 0; i < causticsSize * causticsSize; i++)
+            data[i] = Color32(uint8(caustics[i] * 255.0f + 0.5f), 0, 0, 0);
+    }
+};
+
+#endif